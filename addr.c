@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Range Range;
+
+enum {
+	Radixbits = 11,			/* Radix sort digit */
+	Radix = 1<<Radixbits,
+};
+
+struct Range {
+	uint64_t start;
+	uint64_t end;
+	uint32_t sym;
+	uint8_t bind;
+};
+
+/*
+ * Order ranges by start; among aliases, the preferred one comes
+ * first: global, then weak, then local, then the largest
+ */
+static int
+rangecmp(const void *a, const void *b)
+{
+	const Range *x, *y;
+	int bx, by;
+
+	x = a;
+	y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+
+	bx = x->bind == STB_GLOBAL ? 0 : x->bind == STB_WEAK ? 1 : 2;
+	by = y->bind == STB_GLOBAL ? 0 : y->bind == STB_WEAK ? 1 : 2;
+	if (bx != by)
+		return bx - by;
+
+	if (x->end != y->end)
+		return x->end > y->end ? -1 : 1;
+
+	return x->sym < y->sym ? -1 : x->sym > y->sym;
+}
+
+/*
+ * Lay out the sorted keys in Eytzinger order
+ */
+static uint32_t
+eytzinger(Symidx *ix, uint32_t i, uint32_t k)
+{
+	if (k <= ix->n) {
+		i = eytzinger(ix, i, 2*k);
+		ix->keys[k] = ix->start[i];
+		ix->keyend[k] = ix->end[i];
+		ix->keysym[k] = ix->sym[i];
+		i++;
+		i = eytzinger(ix, i, 2*k + 1);
+	}
+
+	return i;
+}
+
+/*
+ * Build the address index of the function symbols of a Symbol Table.
+ * Aliases collapse to one symbol, an overlapping range is cut at the
+ * start of the next one, and addresses in gaps resolve to nothing.
+ */
+int
+buildelfsymidx(Symtab *st, Symidx *ix)
+{
+	uint32_t i, n, m;
+	Range *r;
+	uint8_t type;
+	size_t len;
+	void *mem;
+
+	memset(ix, 0, sizeof(*ix));
+
+	r = malloc((size_t)st->nsym * sizeof(r[0]) + 1);
+	if (r == NULL)
+		return -1;
+
+	n = 0;
+	for (i = 0; i < st->nsym; i++) {
+		type = ELF_ST_TYPE(st->info[i]);
+		if (type != STT_FUNC && type != STT_GNU_IFUNC)
+			continue;
+		if (st->shndx[i] == SHN_UNDEF || st->size[i] == 0)
+			continue;
+		if (st->value[i] + st->size[i] < st->value[i])
+			continue;
+		r[n].start = st->value[i];
+		r[n].end = st->value[i] + st->size[i];
+		r[n].sym = i;
+		r[n].bind = ELF_ST_BIND(st->info[i]);
+		n++;
+	}
+
+	qsort(r, n, sizeof(r[0]), rangecmp);
+
+	m = 0;
+	for (i = 0; i < n; i++) {
+		if (m > 0 && r[m - 1].start == r[i].start)
+			continue;
+		if (m > 0 && r[m - 1].end > r[i].start)
+			r[m - 1].end = r[i].start;
+		r[m++] = r[i];
+	}
+
+	ix->n = m;
+
+	/* Keys first, on their own cache lines */
+	len = ((size_t)m + 1) * sizeof(uint64_t);
+	len = (len + 63) & ~(size_t)63;
+	if (posix_memalign(&mem, 64, 2*len + (size_t)m * 2*sizeof(uint64_t) + ((size_t)m * 2 + 1) * sizeof(uint32_t)) != 0) {
+		free(r);
+		return -1;
+	}
+	ix->mem = mem;
+	ix->keys = mem;
+	ix->keyend = (uint64_t*)((uint8_t*)mem + len);
+	ix->start = (uint64_t*)((uint8_t*)mem + 2*len);
+	ix->end = ix->start + m;
+	ix->keysym = (uint32_t*)(ix->end + m);
+	ix->sym = ix->keysym + m + 1;
+
+	for (i = 0; i < m; i++) {
+		ix->start[i] = r[i].start;
+		ix->end[i] = r[i].end;
+		ix->sym[i] = r[i].sym;
+	}
+
+	ix->keys[0] = 0;
+	ix->keyend[0] = 0;
+	ix->keysym[0] = 0;
+	eytzinger(ix, 0, 1);
+
+	free(r);
+
+	return 0;
+}
+
+/*
+ * Read the Symbol Table, or the Dynamic Symbol Table of a stripped
+ * file, and build its address index
+ */
+int
+readelfsymidx(FILE *f, Symtab *st, Symidx *ix, Fhdr *fp)
+{
+	Shdr *sh;
+
+	sh = elfshdrtype(fp, SHT_SYMTAB, NULL);
+	if (sh == NULL)
+		sh = elfshdrtype(fp, SHT_DYNSYM, NULL);
+	if (sh == NULL) {
+		fprintf(stderr, "missing symbol table\n");
+		return -1;
+	}
+
+	if (readelfsymtab(f, sh, st, fp) < 0)
+		return -1;
+
+	if (buildelfsymidx(st, ix) < 0) {
+		freeelfsymtab(st);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the symbol whose range holds addr
+ */
+int
+lookupelfsym(Symidx *ix, uint64_t addr, uint32_t *sym)
+{
+	uint32_t k;
+
+	k = 1;
+	while (k <= ix->n) {
+		__builtin_prefetch(ix->keys + 16*(size_t)k);
+		k = 2*k + (ix->keys[k] <= addr);
+	}
+
+	/* Back up to the last key at or below addr; 0 when there is none */
+	k >>= __builtin_ffs(k);
+
+	if (k == 0 || addr >= ix->keyend[k])
+		return -1;
+
+	*sym = ix->keysym[k];
+
+	return 0;
+}
+
+/*
+ * Sort items holding an address offset in the high 32 bits by least
+ * significant digit radix sort on the low bits bits of the offset
+ */
+static uint64_t*
+radixsort(uint64_t *item, uint64_t *tmp, uint32_t n, int bits)
+{
+	uint32_t count[Radix], sum, c, i, j;
+	uint64_t *t;
+	int shift;
+
+	for (shift = 32; shift < 32 + bits; shift += Radixbits) {
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++)
+			count[(item[i] >> shift) & (Radix - 1)]++;
+
+		sum = 0;
+		for (j = 0; j < Radix; j++) {
+			c = count[j];
+			count[j] = sum;
+			sum += c;
+		}
+
+		for (i = 0; i < n; i++)
+			tmp[count[(item[i] >> shift) & (Radix - 1)]++] = item[i];
+
+		t = item;
+		item = tmp;
+		tmp = t;
+	}
+
+	return item;
+}
+
+/*
+ * Get the symbols of n addresses, in the order of the addresses.
+ * Addresses without a symbol get ELFSYM_NONE. Returns the number of
+ * addresses with a symbol.
+ */
+int64_t
+lookupelfsyms(Symidx *ix, uint64_t *addrs, uint32_t n, uint32_t *syms)
+{
+	uint32_t i, m, r, step, lo, hi, mid;
+	uint64_t base, span, a;
+	uint64_t *item, *sorted;
+	int64_t found;
+	int bits;
+
+	found = 0;
+
+	/* Small batches, and empty indexes or those spanning 4GB or more, go one by one */
+	span = ix->n > 0 ? ix->end[ix->n - 1] - ix->start[0] : 0;
+	if (n < 64 || ix->n == 0 || span > UINT32_MAX) {
+		for (i = 0; i < n; i++) {
+			if (lookupelfsym(ix, addrs[i], &syms[i]) < 0)
+				syms[i] = ELFSYM_NONE;
+			else
+				found++;
+		}
+		return found;
+	}
+
+	item = malloc((size_t)n * 2*sizeof(item[0]));
+	if (item == NULL)
+		return -1;
+
+	/*
+	 * Addresses outside the index resolve to nothing right away; the
+	 * others are sorted as their offset from the first range, paired
+	 * with their position.
+	 */
+	base = ix->start[0];
+	m = 0;
+	for (i = 0; i < n; i++) {
+		if (addrs[i] < base || addrs[i] - base >= span) {
+			syms[i] = ELFSYM_NONE;
+			continue;
+		}
+		item[m++] = (addrs[i] - base) << 32 | i;
+	}
+
+	bits = 0;
+	while (bits < 32 && (span - 1) >> bits != 0)
+		bits++;
+	sorted = radixsort(item, item + n, m, bits);
+
+	/* Walk the sorted addresses and ranges together */
+	r = 0;
+	for (i = 0; i < m; i++) {
+		a = base + (sorted[i] >> 32);
+
+		/* Gallop to the last range starting at or below a */
+		if (r + 1 < ix->n && ix->start[r + 1] <= a) {
+			lo = r + 1;
+			step = 1;
+			while (lo + step < ix->n && ix->start[lo + step] <= a) {
+				lo += step;
+				step *= 2;
+			}
+			hi = lo + step < ix->n ? lo + step : ix->n;
+			while (hi - lo > 1) {
+				mid = lo + (hi - lo) / 2;
+				if (ix->start[mid] <= a)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			r = lo;
+		}
+
+		if (a < ix->end[r]) {
+			syms[(uint32_t)sorted[i]] = ix->sym[r];
+			found++;
+		} else
+			syms[(uint32_t)sorted[i]] = ELFSYM_NONE;
+	}
+
+	free(item);
+
+	return found;
+}
+
+void
+freeelfsymidx(Symidx *ix)
+{
+	free(ix->mem);
+	memset(ix, 0, sizeof(*ix));
+}
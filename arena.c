@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	Chunksize = 16*1024,	/* Default chunk size */
+	Align = 16,
+};
+
+typedef struct Chunk Chunk;
+
+struct Chunk {
+	Chunk		*next;
+	uint64_t	size;
+	uint64_t	used;
+};
+
+/*
+ * Bump allocator. Chunks of the arena size are kept across resets,
+ * larger ones are released. The first chunk follows the arena.
+ */
+struct Arena {
+	pthread_mutex_t	lk;
+	Chunk		*chunk;		/* Chunks in use, the current one first */
+	Chunk		*spare;		/* Chunks kept by the last reset */
+	uint64_t	size;		/* Chunk size */
+};
+
+/*
+ * Table read from a handle, kept for the reads that follow. It is
+ * found by its kind and the section it was read from, and its
+ * struct follows.
+ */
+struct Elftab {
+	Elftab		*next;
+	int		kind;
+	uint64_t	off;		/* Section offset */
+	uint64_t	size;		/* Section size */
+	int		r;		/* Result of the read */
+};
+
+#define CHUNKHDR	((sizeof(Chunk) + Align - 1) & ~(uint64_t)(Align - 1))
+#define ARENAHDR	((sizeof(Arena) + Align - 1) & ~(uint64_t)(Align - 1))
+#define TABHDR		((sizeof(Elftab) + Align - 1) & ~(uint64_t)(Align - 1))
+
+static uint8_t*
+chunkbase(Chunk *c)
+{
+	return (uint8_t*)c + CHUNKHDR;
+}
+
+static Chunk*
+firstchunk(Arena *a)
+{
+	return (Chunk*)((uint8_t*)a + ARENAHDR);
+}
+
+/*
+ * Create an arena allocating in chunks of size bytes, or of a
+ * default size when size is 0
+ */
+Arena*
+newelfarena(uint64_t size)
+{
+	Arena *a;
+	Chunk *c;
+
+	if (size == 0)
+		size = Chunksize;
+	size = (size + Align - 1) & ~(uint64_t)(Align - 1);
+	if (size > SIZE_MAX - ARENAHDR - CHUNKHDR)
+		return NULL;
+
+	a = malloc(ARENAHDR + CHUNKHDR + size);
+	if (a == NULL)
+		return NULL;
+
+	pthread_mutex_init(&a->lk, NULL);
+	a->size = size;
+	a->spare = NULL;
+
+	c = firstchunk(a);
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	a->chunk = c;
+
+	return a;
+}
+
+/*
+ * Allocate size bytes, aligned for any type. Handles shared between
+ * threads build their indexes lazily, so allocating is locked.
+ */
+void*
+arenaalloc(Arena *a, uint64_t size)
+{
+	Chunk *c;
+	void *p;
+
+	if (size > SIZE_MAX - CHUNKHDR - Align)
+		return NULL;
+	size = (size + Align - 1) & ~(uint64_t)(Align - 1);
+
+	pthread_mutex_lock(&a->lk);
+
+	c = a->chunk;
+	if (c->size - c->used >= size) {
+		p = chunkbase(c) + c->used;
+		c->used += size;
+		pthread_mutex_unlock(&a->lk);
+		return p;
+	}
+
+	/* Large blocks get a chunk of their own behind the current one */
+	if (size > a->size / 4) {
+		c = malloc(CHUNKHDR + size);
+		if (c == NULL) {
+			pthread_mutex_unlock(&a->lk);
+			return NULL;
+		}
+		c->size = size;
+		c->used = size;
+		c->next = a->chunk->next;
+		a->chunk->next = c;
+		pthread_mutex_unlock(&a->lk);
+		return chunkbase(c);
+	}
+
+	c = a->spare;
+	if (c != NULL)
+		a->spare = c->next;
+	else {
+		c = malloc(CHUNKHDR + a->size);
+		if (c == NULL) {
+			pthread_mutex_unlock(&a->lk);
+			return NULL;
+		}
+		c->size = a->size;
+	}
+	c->used = size;
+	c->next = a->chunk;
+	a->chunk = c;
+
+	pthread_mutex_unlock(&a->lk);
+
+	return chunkbase(c);
+}
+
+/*
+ * Release every allocation of the arena at once, keeping its chunks
+ * for the next file. No handle may still use the arena.
+ */
+void
+resetelfarena(Arena *a)
+{
+	Chunk *c, *next, *first;
+
+	first = firstchunk(a);
+	for (c = a->chunk; c != NULL; c = next) {
+		next = c->next;
+		if (c == first)
+			continue;
+		if (c->size == a->size) {
+			c->next = a->spare;
+			a->spare = c;
+		} else
+			free(c);
+	}
+
+	first->next = NULL;
+	first->used = 0;
+	a->chunk = first;
+}
+
+void
+freeelfarena(Arena *a)
+{
+	Chunk *c, *next;
+
+	if (a == NULL)
+		return;
+
+	resetelfarena(a);
+	for (c = a->spare; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+
+	pthread_mutex_destroy(&a->lk);
+	free(a);
+}
+
+/*
+ * Get the bytes held by the arena
+ */
+uint64_t
+arenasize(Arena *a)
+{
+	uint64_t n;
+	Chunk *c;
+
+	n = ARENAHDR;
+	pthread_mutex_lock(&a->lk);
+	for (c = a->chunk; c != NULL; c = c->next)
+		n += CHUNKHDR + c->size;
+	for (c = a->spare; c != NULL; c = c->next)
+		n += CHUNKHDR + c->size;
+	pthread_mutex_unlock(&a->lk);
+
+	return n;
+}
+
+/*
+ * Allocate from the arena of a handle, giving the handle an arena
+ * of its own on the first allocation when the caller gave none.
+ * Tables of a shared handle are built lazily from several threads:
+ * the arena is installed with a compare-and-swap, and the one of a
+ * thread losing the race is released.
+ */
+void*
+elfalloc(Fhdr *fp, uint64_t size)
+{
+	Arena *a, *old;
+
+	a = __atomic_load_n(&fp->arena, __ATOMIC_ACQUIRE);
+	if (a == NULL) {
+		a = newelfarena(0);
+		if (a == NULL)
+			return NULL;
+		old = NULL;
+		if (__atomic_compare_exchange_n(&fp->arena, &old, a, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&fp->ownarena, 1, __ATOMIC_RELEASE);
+		} else {
+			freeelfarena(a);
+			a = old;
+		}
+	}
+
+	return arenaalloc(a, size);
+}
+
+/*
+ * Copy size bytes at p to the arena of a handle. Tables grown on the
+ * heap end there once their size is known.
+ */
+void*
+elfdup(Fhdr *fp, void *p, uint64_t size)
+{
+	void *q;
+
+	q = elfalloc(fp, size);
+	if (q == NULL)
+		return NULL;
+
+	if (size > 0)
+		memcpy(q, p, size);
+
+	return q;
+}
+
+static Elftab*
+lookuptab(Elftab *t, Elftab *end, int kind, uint64_t off, uint64_t size)
+{
+	for (; t != end; t = t->next) {
+		if (t->kind == kind && t->off == off && t->size == size)
+			return t;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get a table of a kind already read from the section at off of a
+ * handle into t, whose struct is tsize bytes. Returns the result of
+ * the read, or 1 when it wasn't read yet.
+ */
+int
+findelftab(Fhdr *fp, int kind, uint64_t off, uint64_t size, void *t, size_t tsize)
+{
+	Elftab *e;
+
+	e = lookuptab(__atomic_load_n(&fp->tabs, __ATOMIC_ACQUIRE), NULL, kind, off, size);
+	if (e == NULL)
+		return 1;
+
+	memcpy(t, (uint8_t*)e + TABHDR, tsize);
+
+	return e->r;
+}
+
+/*
+ * Keep the table t, read with result r, for the reads that follow.
+ * When another thread kept the same table first, t becomes its
+ * table and the one read here stays in the arena. Returns the result
+ * of the read kept.
+ */
+int
+keepelftab(Fhdr *fp, int kind, uint64_t off, uint64_t size, int r, void *t, size_t tsize)
+{
+	Elftab *e, *head, *old;
+
+	e = elfalloc(fp, TABHDR + tsize);
+	if (e == NULL)
+		return r;
+
+	e->kind = kind;
+	e->off = off;
+	e->size = size;
+	e->r = r;
+	memcpy((uint8_t*)e + TABHDR, t, tsize);
+
+	head = __atomic_load_n(&fp->tabs, __ATOMIC_ACQUIRE);
+	for (;;) {
+		e->next = head;
+		if (__atomic_compare_exchange_n(&fp->tabs, &head, e, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return r;
+
+		/* Only the tables kept since are new */
+		old = lookuptab(head, e->next, kind, off, size);
+		if (old != NULL) {
+			memcpy(t, (uint8_t*)old + TABHDR, tsize);
+			return old->r;
+		}
+	}
+}
+
+static void*
+keepalloc(void *ctx, size_t size)
+{
+	return elfalloc(ctx, size);
+}
+
+static void
+keepfree(void *ctx, void *p)
+{
+	USED(ctx);
+	USED(p);
+}
+
+/*
+ * Set a to allocate from the arena of a handle, for buffers kept as
+ * long as the handle
+ */
+void
+keepallocator(Fhdr *fp, Elfalloc *a)
+{
+	a->alloc = keepalloc;
+	a->free = keepfree;
+	a->ctx = fp;
+}
+
+/*
+ * Allocator of the section buffers handed to callers, when they
+ * didn't set one on the handle
+ */
+static Elfalloc *defalloc;
+
+/*
+ * Set the allocator of the section buffers returned by the reads
+ * of a handle, or by default when fp is NULL. A NULL allocator
+ * restores malloc and free.
+ */
+void
+setelfalloc(Fhdr *fp, Elfalloc *a)
+{
+	if (fp == NULL) {
+		__atomic_store_n(&defalloc, a, __ATOMIC_RELEASE);
+		return;
+	}
+
+	fp->alloc = a;
+}
+
+/*
+ * Get the allocator of the section buffers of a handle, NULL for
+ * the heap
+ */
+Elfalloc*
+elfallocator(Fhdr *fp)
+{
+	if (fp->alloc != NULL)
+		return fp->alloc;
+
+	return __atomic_load_n(&defalloc, __ATOMIC_ACQUIRE);
+}
+
+void*
+allocbuf(Elfalloc *a, uint64_t size)
+{
+	if (size > SIZE_MAX - 1)
+		return NULL;
+
+	/* Empty sections still get a buffer */
+	if (a == NULL)
+		return malloc(size + 1);
+
+	return a->alloc(a->ctx, size + 1);
+}
+
+void
+freebuf(Elfalloc *a, void *p)
+{
+	if (a == NULL)
+		free(p);
+	else if (p != NULL)
+		a->free(a->ctx, p);
+}
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Throughput of the Section Header Table decoders, per field through
+ * the get16/get32/get64 callbacks, generic bulk, and specialized by
+ * selectcodec, on a synthetic table of each class and data encoding;
+ * and of symbol lookups, one by one and batched, on random addresses
+ * in a synthetic Symbol Table
+ */
+
+enum {
+	Nshdr = 65000,		/* Below SHN_LORESERVE */
+	Nround = 20,		/* The best round is reported */
+	Nsym = 100000,		/* Function symbols */
+	Naddr = 1000000,	/* Addresses looked up */
+};
+
+typedef struct Img Img;
+
+struct Img {
+	uint8_t		*buf;
+	uint8_t		*p;
+	int		data;
+};
+
+static void
+put(Img *m, uint64_t v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (m->data == ELFDATA2LSB)
+			m->p[i] = v >> 8*i;
+		else
+			m->p[i] = v >> 8*(n - 1 - i);
+	}
+	m->p += n;
+}
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+
+	return *x;
+}
+
+/*
+ * Build an image of nshdr Section Headers of random contents, but
+ * for the Section Header String Table
+ */
+static uint8_t*
+mkimage(int class, int data, uint32_t nshdr, size_t *size)
+{
+	static char shstr[] = "\0.shstrtab";
+	uint64_t ehsize, shentsize, shoff, stroff, x;
+	int w;
+	uint32_t i;
+	Img m;
+
+	w = class == ELFCLASS32 ? 4 : 8;
+	ehsize = class == ELFCLASS32 ? Eh32sz : Eh64sz;
+	shentsize = class == ELFCLASS32 ? Sh32sz : Sh64sz;
+	shoff = (ehsize + 7) & ~7;
+	stroff = shoff + nshdr * shentsize;
+
+	*size = stroff + sizeof(shstr);
+	m.buf = calloc(1, *size);
+	if (m.buf == NULL)
+		return NULL;
+	m.data = data;
+
+	m.p = m.buf;
+	memcpy(m.p, "\177ELF", 4);
+	m.p[EI_CLASS] = class;
+	m.p[EI_DATA] = data;
+	m.p[EI_VERSION] = EV_CURRENT;
+	m.p += EI_NIDENT;
+	put(&m, ET_REL, 2);
+	put(&m, 0, 2);
+	put(&m, EV_CURRENT, 4);
+	put(&m, 0, w);
+	put(&m, 0, w);
+	put(&m, shoff, w);
+	put(&m, 0, 4);
+	put(&m, ehsize, 2);
+	put(&m, 0, 2);
+	put(&m, 0, 2);
+	put(&m, shentsize, 2);
+	put(&m, nshdr, 2);
+	put(&m, 1, 2);
+
+	x = 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < nshdr; i++) {
+		m.p = m.buf + shoff + i * shentsize;
+		if (i == 0)
+			continue;
+		if (i == 1) {
+			put(&m, 1, 4);
+			put(&m, SHT_STRTAB, 4);
+			put(&m, 0, w);
+			put(&m, 0, w);
+			put(&m, stroff, w);
+			put(&m, sizeof(shstr), w);
+			continue;
+		}
+		xorshift(&x);
+		put(&m, 0, 4);
+		put(&m, SHT_PROGBITS, 4);
+		put(&m, x & 0xff, w);
+		put(&m, x, w);
+		put(&m, 0, w);
+		put(&m, 0, w);
+		put(&m, x >> 48, 4);
+		put(&m, x >> 32 & 0xffff, 4);
+		put(&m, 1 << (x & 7), w);
+		put(&m, x >> 56, w);
+	}
+
+	memcpy(m.buf + stroff, shstr, sizeof(shstr));
+
+	return m.buf;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+perfield(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (fp->unpackelfshdr(src + (size_t)i * fp->shentsize, fp->shentsize, &dst[i], fp) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the best throughput of decode, in millions of entries per second
+ */
+static double
+rate(int (*decode)(uint8_t*, uint32_t, Shdr*, Fhdr*), Shdr *dst, Fhdr *fp)
+{
+	double t, best;
+	int i;
+
+	best = 0;
+	for (i = 0; i < Nround; i++) {
+		t = now();
+		if (decode(fp->map + fp->shoff, fp->shnum, dst, fp) < 0)
+			return -1;
+		t = now() - t;
+		if (i == 0 || t < best)
+			best = t;
+	}
+
+	return fp->shnum / best / 1e6;
+}
+
+static int
+single(Symidx *ix, uint64_t *addrs, uint32_t n, uint32_t *syms)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (lookupelfsym(ix, addrs[i], &syms[i]) < 0)
+			syms[i] = ELFSYM_NONE;
+	}
+
+	return 0;
+}
+
+static int
+batch(Symidx *ix, uint64_t *addrs, uint32_t n, uint32_t *syms)
+{
+	return lookupelfsyms(ix, addrs, n, syms) < 0 ? -1 : 0;
+}
+
+/*
+ * Get the best throughput of lookup, in millions of addresses per
+ * second
+ */
+static double
+lookuprate(int (*lookup)(Symidx*, uint64_t*, uint32_t, uint32_t*), Symidx *ix, uint64_t *addrs, uint32_t *syms)
+{
+	double t, best;
+	int i;
+
+	best = 0;
+	for (i = 0; i < Nround; i++) {
+		t = now();
+		if (lookup(ix, addrs, Naddr, syms) < 0)
+			return -1;
+		t = now() - t;
+		if (i == 0 || t < best)
+			best = t;
+	}
+
+	return Naddr / best / 1e6;
+}
+
+/*
+ * Build the index of a Symbol Table of Nsym functions of random sizes
+ * separated by random gaps, then look up Naddr random addresses in
+ * its span, one by one and batched, after checking that they agree
+ */
+static int
+benchsyms(void)
+{
+	uint64_t *addrs, x, pc, span;
+	uint32_t *syms, *ref;
+	Symtab st;
+	Symidx ix;
+	uint32_t i;
+	int r;
+
+	memset(&st, 0, sizeof(st));
+	st.nsym = Nsym;
+	st.value = malloc(Nsym * sizeof(st.value[0]));
+	st.size = malloc(Nsym * sizeof(st.size[0]));
+	st.shndx = malloc(Nsym * sizeof(st.shndx[0]));
+	st.info = malloc(Nsym * sizeof(st.info[0]));
+	addrs = malloc(Naddr * sizeof(addrs[0]));
+	syms = malloc(Naddr * sizeof(syms[0]));
+	ref = malloc(Naddr * sizeof(ref[0]));
+	if (st.value == NULL || st.size == NULL || st.shndx == NULL || st.info == NULL || addrs == NULL || syms == NULL || ref == NULL)
+		return -1;
+
+	x = 0x9e3779b97f4a7c15ULL;
+	pc = 0x400000;
+	for (i = 0; i < Nsym; i++) {
+		xorshift(&x);
+		pc += x & 0x3f;
+		st.value[i] = pc;
+		st.size[i] = 16 + (x >> 8 & 0x3ff);
+		st.shndx[i] = 1;
+		st.info[i] = STB_GLOBAL << 4 | STT_FUNC;
+		pc += st.size[i];
+	}
+
+	r = -1;
+	if (buildelfsymidx(&st, &ix) < 0)
+		goto out;
+
+	span = ix.end[ix.n - 1] - ix.start[0];
+	for (i = 0; i < Naddr; i++)
+		addrs[i] = ix.start[0] + xorshift(&x) % span;
+
+	/* Both must give the same symbols before they are timed */
+	single(&ix, addrs, Naddr, ref);
+	batch(&ix, addrs, Naddr, syms);
+	r = memcmp(ref, syms, Naddr * sizeof(syms[0])) == 0 ? 0 : -1;
+	if (r < 0)
+		fprintf(stderr, "symbol lookup mismatch\n");
+
+	printf("\nSymbol lookup, %u addresses in %u ranges, millions of addresses/s\n", Naddr, ix.n);
+	printf("%-10s %10s %10s\n", "", "single", "batch");
+	printf("%-10s %10.1f %10.1f\n", "Symidx",
+		lookuprate(single, &ix, addrs, syms),
+		lookuprate(batch, &ix, addrs, syms));
+
+	freeelfsymidx(&ix);
+
+out:
+	free(st.value);
+	free(st.size);
+	free(st.shndx);
+	free(st.info);
+	free(addrs);
+	free(syms);
+	free(ref);
+
+	return r;
+}
+
+int
+main(void)
+{
+	static int classes[] = { ELFCLASS32, ELFCLASS64 };
+	static int datas[] = { ELFDATA2LSB, ELFDATA2MSB };
+	unsigned int i, j;
+	uint8_t *img;
+	size_t size;
+	Shdr *dst;
+	Fhdr fp;
+	int r;
+
+	dst = malloc(Nshdr * sizeof(dst[0]));
+	if (dst == NULL)
+		return 1;
+
+	printf("Section Header decode, %u entries, millions of entries/s\n", Nshdr);
+	printf("%-10s %10s %10s %12s\n", "", "per-field", "generic", "specialized");
+
+	r = 0;
+	for (i = 0; i < nelem(classes); i++) {
+		for (j = 0; j < nelem(datas); j++) {
+			img = mkimage(classes[i], datas[j], Nshdr, &size);
+			if (img == NULL || openelfmem(img, size, &fp) < 0) {
+				fprintf(stderr, "cannot open image\n");
+				return 1;
+			}
+
+			/* The three decoders must agree before they are timed */
+			if (verifyelfshdrs(NULL, &fp) < 0)
+				r = 1;
+
+			printf("ELF%d %s %10.1f %10.1f %12.1f\n",
+				classes[i] == ELFCLASS32 ? 32 : 64,
+				datas[j] == ELFDATA2LSB ? "LSB" : "MSB",
+				rate(perfield, dst, &fp),
+				rate(refdecodeelfshdrs, dst, &fp),
+				rate(fp.decodeelfshdrs, dst, &fp));
+
+			freeelf(&fp);
+			free(img);
+		}
+	}
+
+	free(dst);
+
+	if (benchsyms() < 0)
+		r = 1;
+
+	return r;
+}
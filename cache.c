@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	Nstripe = 16,			/* Locks, a power of two */
+	Nbucket = 16,			/* Initial buckets of a stripe */
+	Budget = 64*1024*1024,		/* Default memory budget */
+};
+
+typedef struct Centry Centry;
+typedef struct Stripe Stripe;
+typedef struct Ckey Ckey;
+
+/*
+ * Identity of a file
+ */
+struct Ckey {
+	uint64_t	dev;
+	uint64_t	ino;
+	int64_t		mtime;		/* Nanoseconds */
+	int64_t		size;
+};
+
+/*
+ * Cached handle. The handle comes first, putelfcache gets back to
+ * its entry from it.
+ */
+struct Centry {
+	Fhdr		fh;
+	Ckey		key;
+	uint64_t	hash;
+	uint64_t	cost;		/* Bytes charged to the budget */
+	int		ref;		/* Users, under the stripe lock */
+	int		dead;		/* Evicted, freed by its last user */
+	Centry		*hnext;
+	Centry		*prev;		/* Least recently used order */
+	Centry		*next;
+};
+
+/*
+ * Entries of the files hashing to a lock, with their own share of
+ * the budget and their own LRU order
+ */
+struct Stripe {
+	pthread_mutex_t	lk;
+	Centry		**tab;
+	uint32_t	mask;
+	uint32_t	n;
+	Centry		*head;		/* Most recently used */
+	Centry		*tail;		/* Next to evict */
+	uint64_t	size;		/* Bytes charged */
+	uint64_t	hits;
+	uint64_t	misses;
+	uint64_t	evictions;
+};
+
+struct Cache {
+	Stripe		stripe[Nstripe];
+	uint64_t	budget;		/* Budget of a stripe */
+	int		flags;		/* ELFMAP flags of the handles */
+};
+
+static void
+statkey(struct stat *st, Ckey *k)
+{
+	k->dev = st->st_dev;
+	k->ino = st->st_ino;
+	k->mtime = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+	k->size = st->st_size;
+}
+
+static uint64_t
+keyhash(Ckey *k)
+{
+	uint64_t h;
+
+	h = k->dev * 0x9e3779b97f4a7c15ULL ^ k->ino;
+	h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL ^ (uint64_t)k->mtime;
+	h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL ^ (uint64_t)k->size;
+	h ^= h >> 33;
+
+	return h;
+}
+
+static Stripe*
+getstripe(Cache *c, uint64_t h)
+{
+	return &c->stripe[h & (Nstripe - 1)];
+}
+
+static Centry*
+findentry(Stripe *s, Ckey *k, uint64_t h)
+{
+	Centry *e;
+
+	for (e = s->tab[(h >> 4) & s->mask]; e != NULL; e = e->hnext) {
+		if (e->hash == h && memcmp(&e->key, k, sizeof(*k)) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void
+unlinklru(Stripe *s, Centry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		s->head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		s->tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void
+pushlru(Stripe *s, Centry *e)
+{
+	e->prev = NULL;
+	e->next = s->head;
+	if (s->head != NULL)
+		s->head->prev = e;
+	else
+		s->tail = e;
+	s->head = e;
+}
+
+/*
+ * Double the buckets of a stripe. The chains just get longer when
+ * memory is short.
+ */
+static void
+growstripe(Stripe *s)
+{
+	Centry **tab, *e, *next;
+	uint32_t i, mask;
+
+	mask = 2 * s->mask + 1;
+	tab = calloc((size_t)mask + 1, sizeof(tab[0]));
+	if (tab == NULL)
+		return;
+
+	for (i = 0; i <= s->mask; i++) {
+		for (e = s->tab[i]; e != NULL; e = next) {
+			next = e->hnext;
+			e->hnext = tab[(e->hash >> 4) & mask];
+			tab[(e->hash >> 4) & mask] = e;
+		}
+	}
+
+	free(s->tab);
+	s->tab = tab;
+	s->mask = mask;
+}
+
+static void
+removeentry(Stripe *s, Centry *e)
+{
+	Centry **l;
+
+	for (l = &s->tab[(e->hash >> 4) & s->mask]; *l != NULL; l = &(*l)->hnext) {
+		if (*l == e) {
+			*l = e->hnext;
+			break;
+		}
+	}
+	unlinklru(s, e);
+	s->n--;
+	s->size -= e->cost;
+	e->dead = 1;
+}
+
+static void
+freeentry(Centry *e)
+{
+	freeelf(&e->fh);
+	free(e);
+}
+
+/*
+ * Get the bytes of an entry and of the tables of its handle
+ */
+static uint64_t
+entrycost(Centry *e)
+{
+	uint64_t cost;
+
+	cost = sizeof(*e);
+	if (e->fh.arena != NULL)
+		cost += arenasize(e->fh.arena);
+
+	return cost;
+}
+
+/*
+ * Evict the least recently used entries until the stripe fits its
+ * budget. Returns those no one uses, chained by hnext, for freeing
+ * outside the lock; the others are freed by their last user.
+ */
+static Centry*
+evict(Cache *c, Stripe *s)
+{
+	Centry *e, *dead;
+
+	dead = NULL;
+	while (s->size > c->budget && s->tail != NULL) {
+		e = s->tail;
+		removeentry(s, e);
+		s->evictions++;
+		if (e->ref == 0) {
+			e->hnext = dead;
+			dead = e;
+		}
+	}
+
+	return dead;
+}
+
+/*
+ * Create a cache of handles opened with openelfmap and flags, whose
+ * tables hold at most budget bytes, or a default when budget is 0.
+ * Tables built lazily are charged when their handle is returned. The
+ * mappings are not charged, the kernel pages them in and out.
+ */
+Cache*
+newelfcache(uint64_t budget, int flags)
+{
+	Stripe *s;
+	Cache *c;
+	int i;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return NULL;
+
+	if (budget == 0)
+		budget = Budget;
+	c->budget = budget / Nstripe > 0 ? budget / Nstripe : 1;
+	c->flags = flags;
+
+	for (i = 0; i < Nstripe; i++) {
+		s = &c->stripe[i];
+		s->tab = calloc(Nbucket, sizeof(s->tab[0]));
+		if (s->tab == NULL) {
+			while (--i >= 0) {
+				pthread_mutex_destroy(&c->stripe[i].lk);
+				free(c->stripe[i].tab);
+			}
+			free(c);
+			return NULL;
+		}
+		s->mask = Nbucket - 1;
+		pthread_mutex_init(&s->lk, NULL);
+	}
+
+	return c;
+}
+
+/*
+ * Get a handle on the file at path, shared read-only with the other
+ * users of the cache until putelfcache. A file is known by its
+ * device, inode, modification time and size, so a file replaced or
+ * modified in place is opened again.
+ */
+Fhdr*
+openelfcache(Cache *c, char *path)
+{
+	Centry *e, *old, *dead, *next;
+	struct stat st;
+	uint64_t h;
+	Stripe *s;
+	Ckey k;
+	int fd;
+
+	if (stat(path, &st) < 0)
+		return NULL;
+
+	statkey(&st, &k);
+	h = keyhash(&k);
+	s = getstripe(c, h);
+
+	pthread_mutex_lock(&s->lk);
+	e = findentry(s, &k, h);
+	if (e != NULL) {
+		e->ref++;
+		if (s->head != e) {
+			unlinklru(s, e);
+			pushlru(s, e);
+		}
+		s->hits++;
+		pthread_mutex_unlock(&s->lk);
+		return &e->fh;
+	}
+	s->misses++;
+	pthread_mutex_unlock(&s->lk);
+
+	/* Open outside the lock, keyed by what was actually opened */
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL || fstat(fd, &st) < 0 || mapelffd(fd, st.st_size, c->flags, NULL, &e->fh) < 0) {
+		free(e);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	statkey(&st, &e->key);
+	e->hash = keyhash(&e->key);
+	e->cost = entrycost(e);
+	e->ref = 1;
+	s = getstripe(c, e->hash);
+
+	pthread_mutex_lock(&s->lk);
+
+	/* Another thread may have opened it meanwhile */
+	old = findentry(s, &e->key, e->hash);
+	if (old != NULL) {
+		old->ref++;
+		pthread_mutex_unlock(&s->lk);
+		freeentry(e);
+		return &old->fh;
+	}
+
+	e->hnext = s->tab[(e->hash >> 4) & s->mask];
+	s->tab[(e->hash >> 4) & s->mask] = e;
+	pushlru(s, e);
+	s->n++;
+	s->size += e->cost;
+	if (s->n > s->mask + 1)
+		growstripe(s);
+
+	/* A file larger than the budget is evicted as soon as it is returned */
+	dead = evict(c, s);
+
+	pthread_mutex_unlock(&s->lk);
+
+	for (; dead != NULL; dead = next) {
+		next = dead->hnext;
+		freeentry(dead);
+	}
+
+	return &e->fh;
+}
+
+/*
+ * Return a handle got from openelfcache
+ */
+void
+putelfcache(Cache *c, Fhdr *fp)
+{
+	Centry *e, *dead, *next;
+	uint64_t cost;
+	Stripe *s;
+
+	e = (Centry*)fp;
+	s = getstripe(c, e->hash);
+
+	/* Charge the tables built since the handle was last charged */
+	cost = entrycost(e);
+
+	pthread_mutex_lock(&s->lk);
+	if (e->dead) {
+		dead = NULL;
+		if (--e->ref == 0) {
+			e->hnext = NULL;
+			dead = e;
+		}
+	} else {
+		e->ref--;
+		s->size = s->size - e->cost + cost;
+		e->cost = cost;
+		dead = evict(c, s);
+	}
+	pthread_mutex_unlock(&s->lk);
+
+	for (; dead != NULL; dead = next) {
+		next = dead->hnext;
+		freeentry(dead);
+	}
+}
+
+void
+elfcachestat(Cache *c, Cachestat *cs)
+{
+	Stripe *s;
+	int i;
+
+	memset(cs, 0, sizeof(*cs));
+
+	for (i = 0; i < Nstripe; i++) {
+		s = &c->stripe[i];
+		pthread_mutex_lock(&s->lk);
+		cs->hits += s->hits;
+		cs->misses += s->misses;
+		cs->evictions += s->evictions;
+		cs->entries += s->n;
+		cs->size += s->size;
+		pthread_mutex_unlock(&s->lk);
+	}
+}
+
+/*
+ * Free the cache. Every handle must have been returned.
+ */
+void
+freeelfcache(Cache *c)
+{
+	Centry *e, *next;
+	Stripe *s;
+	int i;
+
+	if (c == NULL)
+		return;
+
+	for (i = 0; i < Nstripe; i++) {
+		s = &c->stripe[i];
+		for (e = s->head; e != NULL; e = next) {
+			next = e->next;
+			freeentry(e);
+		}
+		free(s->tab);
+		pthread_mutex_destroy(&s->lk);
+	}
+
+	free(c);
+}
@@ -0,0 +1,1280 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Cie Cie;
+typedef struct Fde Fde;
+typedef struct Cfiexec Cfiexec;
+
+enum {
+	Cfidepth	= 8,		/* DW_CFA_remember_state nesting */
+	Exprdepth	= 64,		/* DWARF expression stack */
+	Exprsteps	= 4096,		/* DWARF expression operations run */
+};
+
+/*
+ * Common Information Entry
+ */
+struct Cie {
+	uint64_t	codealign;
+	int64_t		dataalign;
+	uint32_t	ra;		/* Return address column */
+	uint8_t		fdeenc;		/* Encoding of the FDE addresses */
+	uint8_t		aug;		/* FDEs have augmentation data */
+	uint8_t		signal;
+	uint8_t		*insns;		/* Initial instructions */
+	uint8_t		*end;
+};
+
+/*
+ * Frame Description Entry
+ */
+struct Fde {
+	uint64_t	lo;
+	uint64_t	hi;
+	uint8_t		*insns;
+	uint8_t		*end;
+};
+
+/*
+ * Rows of an FDE, by address
+ */
+struct Cfifde {
+	uint64_t	lo;
+	uint64_t	hi;
+	Cfirow		*rows;
+	uint32_t	nrow;
+};
+
+/*
+ * State of the call frame instructions of an FDE
+ */
+struct Cfiexec {
+	Cfitab		*ct;
+	Cie		*cie;
+	Cfirow		row;		/* Current rules */
+	Cfirow		*init;		/* Rules after the CIE, NULL while running it */
+	uint64_t	loc;
+	uint64_t	hi;
+	Cfirow		stack[Cfidepth];
+	int		depth;
+	Cfirow		*rows;
+	uint32_t	nrow;
+	uint32_t	cap;
+	int		nomem;
+};
+
+/* Published for FDEs that can't be decoded */
+static Cfifde badfde;
+
+/*
+ * Stack pointer of each machine, by DWARF number: the CFA is its
+ * value in the caller
+ */
+static struct {
+	uint16_t machine;
+	uint32_t sp;
+} stackreg[] = {
+	{ EM_386,	4 },
+	{ EM_X86_64,	7 },
+	{ EM_ARM,	13 },
+	{ EM_AARCH64,	31 },
+	{ EM_PPC,	1 },
+	{ EM_PPC64,	1 },
+	{ EM_S390,	15 },
+	{ EM_RISCV,	2 },
+};
+
+static uint32_t
+spreg(uint16_t machine)
+{
+	unsigned int i;
+
+	for (i = 0; i < nelem(stackreg); i++) {
+		if (stackreg[i].machine == machine)
+			return stackreg[i].sp;
+	}
+
+	return ~(uint32_t)0;
+}
+
+/*
+ * Read a pointer in an exception handling encoding, at b in a
+ * section starting at sect, loaded at addr
+ */
+static int
+readptr(Cfitab *ct, Dwbuf *b, uint8_t *sect, uint64_t addr, uint8_t enc, uint64_t *v)
+{
+	uint64_t pos, val;
+
+	*v = 0;
+	if (enc == DW_EH_PE_omit)
+		return 0;
+
+	pos = addr + (b->p - sect);
+
+	switch (enc & 0x0f) {
+	case DW_EH_PE_absptr:
+		val = getdwfixed(b, ct->fp->class == ELFCLASS32 ? 4 : 8);
+		break;
+	case DW_EH_PE_uleb128:
+		val = getdwuleb(b);
+		break;
+	case DW_EH_PE_udata2:
+		val = getdwfixed(b, 2);
+		break;
+	case DW_EH_PE_udata4:
+		val = getdwfixed(b, 4);
+		break;
+	case DW_EH_PE_udata8:
+		val = getdwfixed(b, 8);
+		break;
+	case DW_EH_PE_sleb128:
+		val = getdwsleb(b);
+		break;
+	case DW_EH_PE_sdata2:
+		val = (int16_t)getdwfixed(b, 2);
+		break;
+	case DW_EH_PE_sdata4:
+		val = (int32_t)getdwfixed(b, 4);
+		break;
+	case DW_EH_PE_sdata8:
+		val = getdwfixed(b, 8);
+		break;
+	default:
+		return -1;
+	}
+
+	switch (enc & 0x70) {
+	case DW_EH_PE_absptr:
+		break;
+	case DW_EH_PE_pcrel:
+		val += pos;
+		break;
+	case DW_EH_PE_datarel:
+		val += ct->hdraddr;
+		break;
+	default:
+		return -1;
+	}
+
+	if (ct->fp->class == ELFCLASS32)
+		val &= 0xffffffff;
+
+	*v = val;
+
+	return b->err ? -1 : 0;
+}
+
+/*
+ * Start reading the entry of .eh_frame at off. Returns the offset of
+ * its CIE pointer, a CIE has none, or -1.
+ */
+static int
+readentry(Cfitab *ct, uint64_t off, Dwbuf *b, uint64_t *cie)
+{
+	uint8_t offsz, *idpos;
+	uint64_t id;
+
+	if (off >= ct->ehframesize)
+		return -1;
+
+	b->p = ct->ehframe + off;
+	b->end = ct->ehframe + ct->ehframesize;
+	b->fp = ct->fp;
+	b->err = 0;
+
+	b->end = getdwunitlen(b, &offsz);
+	if (b->end == NULL || b->end == b->p)
+		return -1;
+
+	idpos = b->p;
+	id = getdwfixed(b, offsz);
+	if (b->err)
+		return -1;
+
+	/* FDEs point back to their CIE */
+	*cie = ~(uint64_t)0;
+	if (id != 0) {
+		if (id > (uint64_t)(idpos - ct->ehframe))
+			return -1;
+		*cie = idpos - ct->ehframe - id;
+	}
+
+	return 0;
+}
+
+static int
+readcie(Cfitab *ct, uint64_t off, Cie *c)
+{
+	uint64_t cie, auglen, v;
+	uint8_t version, *augend;
+	char *aug, *s;
+	Dwbuf b;
+
+	memset(c, 0, sizeof(*c));
+
+	if (readentry(ct, off, &b, &cie) < 0 || cie != ~(uint64_t)0)
+		return -1;
+
+	version = getdwfixed(&b, 1);
+	if (version != 1 && version != 3 && version != 4)
+		return -1;
+
+	aug = getdwcstr(&b);
+	if (aug == NULL)
+		return -1;
+
+	/* Address and segment selector sizes */
+	if (version == 4)
+		getdwfixed(&b, 2);
+
+	c->codealign = getdwuleb(&b);
+	c->dataalign = getdwsleb(&b);
+	c->ra = version == 1 ? getdwfixed(&b, 1) : getdwuleb(&b);
+	c->fdeenc = DW_EH_PE_absptr;
+
+	if (aug[0] == 'z') {
+		c->aug = 1;
+		auglen = getdwuleb(&b);
+		if (b.err || auglen > (uint64_t)(b.end - b.p))
+			return -1;
+		augend = b.p + auglen;
+		for (s = aug + 1; *s != '\0'; s++) {
+			switch (*s) {
+			case 'L':
+				getdwfixed(&b, 1);
+				continue;
+			case 'P':
+				if (readptr(ct, &b, ct->ehframe, ct->ehframeaddr, getdwfixed(&b, 1) & ~DW_EH_PE_indirect, &v) < 0)
+					return -1;
+				continue;
+			case 'R':
+				c->fdeenc = getdwfixed(&b, 1);
+				continue;
+			case 'S':
+				c->signal = 1;
+				continue;
+			case 'B':
+			case 'G':
+				continue;
+			}
+			break;
+		}
+		b.p = augend;
+	} else if (aug[0] != '\0') {
+		return -1;
+	}
+
+	if (b.err)
+		return -1;
+
+	c->insns = b.p;
+	c->end = b.end;
+
+	return 0;
+}
+
+static int
+readfde(Cfitab *ct, uint64_t off, Fde *f, Cie *c)
+{
+	uint64_t cie, range, auglen;
+	Dwbuf b;
+
+	if (readentry(ct, off, &b, &cie) < 0 || cie == ~(uint64_t)0)
+		return -1;
+
+	if (readcie(ct, cie, c) < 0)
+		return -1;
+
+	if (readptr(ct, &b, ct->ehframe, ct->ehframeaddr, c->fdeenc, &f->lo) < 0)
+		return -1;
+
+	/* The range has the format of the address, without its base */
+	if (readptr(ct, &b, ct->ehframe, ct->ehframeaddr, c->fdeenc & 0x0f, &range) < 0)
+		return -1;
+	f->hi = f->lo + range;
+
+	if (c->aug) {
+		auglen = getdwuleb(&b);
+		if (b.err || auglen > (uint64_t)(b.end - b.p))
+			return -1;
+		b.p += auglen;
+	}
+
+	f->insns = b.p;
+	f->end = b.end;
+
+	return 0;
+}
+
+/*
+ * Close the current row at loc
+ */
+static void
+advance(Cfiexec *x, uint64_t loc)
+{
+	Cfirow *r;
+
+	if (x->init == NULL || loc <= x->loc) {
+		x->loc = loc;
+		return;
+	}
+
+	if (loc > x->hi)
+		loc = x->hi;
+
+	if (x->nrow == x->cap) {
+		x->cap = x->cap ? 2 * x->cap : 4;
+		r = realloc(x->rows, x->cap * sizeof(x->rows[0]));
+		if (r == NULL) {
+			x->nomem = 1;
+			return;
+		}
+		x->rows = r;
+	}
+
+	r = &x->rows[x->nrow++];
+	*r = x->row;
+	r->start = x->loc;
+	r->end = loc;
+
+	x->loc = loc;
+}
+
+static void
+setrule(Cfiexec *x, uint64_t reg, uint8_t type, uint64_t reg2, int64_t off, uint8_t *expr)
+{
+	Cfirule r;
+
+	r.type = type;
+	r.reg = reg2;
+	r.off = off;
+	r.expr = expr;
+
+	if (reg == x->cie->ra)
+		x->row.rarule = r;
+	if (reg < ELFCFI_NREG)
+		x->row.regs[reg] = r;
+}
+
+/*
+ * Restore the rule of a register after the CIE instructions
+ */
+static void
+restore(Cfiexec *x, uint64_t reg)
+{
+	if (x->init == NULL) {
+		setrule(x, reg, ELFCFI_SAME, 0, 0, NULL);
+		return;
+	}
+
+	if (reg == x->cie->ra)
+		x->row.rarule = x->init->rarule;
+	if (reg < ELFCFI_NREG)
+		x->row.regs[reg] = x->init->regs[reg];
+}
+
+/*
+ * Run call frame instructions
+ */
+static int
+runcfi(Cfiexec *x, uint8_t *p, uint8_t *end)
+{
+	uint64_t reg, reg2, n, loc;
+	Cie *c;
+	Dwbuf b;
+	uint8_t op;
+
+	c = x->cie;
+
+	b.p = p;
+	b.end = end;
+	b.fp = x->ct->fp;
+	b.err = 0;
+
+	while (b.p < b.end && !x->nomem) {
+		op = getdwfixed(&b, 1);
+
+		switch (op & 0xc0) {
+		case DW_CFA_advance_loc:
+			advance(x, x->loc + (op & 0x3f) * c->codealign);
+			continue;
+		case DW_CFA_offset:
+			setrule(x, op & 0x3f, ELFCFI_OFFSET, 0, getdwuleb(&b) * c->dataalign, NULL);
+			continue;
+		case DW_CFA_restore:
+			restore(x, op & 0x3f);
+			continue;
+		}
+
+		switch (op) {
+		case DW_CFA_nop:
+			break;
+		case DW_CFA_set_loc:
+			if (readptr(x->ct, &b, x->ct->ehframe, x->ct->ehframeaddr, c->fdeenc, &loc) < 0)
+				return -1;
+			advance(x, loc);
+			break;
+		case DW_CFA_advance_loc1:
+			advance(x, x->loc + getdwfixed(&b, 1) * c->codealign);
+			break;
+		case DW_CFA_advance_loc2:
+			advance(x, x->loc + getdwfixed(&b, 2) * c->codealign);
+			break;
+		case DW_CFA_advance_loc4:
+			advance(x, x->loc + getdwfixed(&b, 4) * c->codealign);
+			break;
+		case DW_CFA_offset_extended:
+			reg = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_OFFSET, 0, getdwuleb(&b) * c->dataalign, NULL);
+			break;
+		case DW_CFA_offset_extended_sf:
+			reg = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_OFFSET, 0, getdwsleb(&b) * c->dataalign, NULL);
+			break;
+		case DW_CFA_GNU_negative_offset_extended:
+			reg = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_OFFSET, 0, -(int64_t)getdwuleb(&b) * c->dataalign, NULL);
+			break;
+		case DW_CFA_val_offset:
+			reg = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_VALOFFSET, 0, getdwuleb(&b) * c->dataalign, NULL);
+			break;
+		case DW_CFA_val_offset_sf:
+			reg = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_VALOFFSET, 0, getdwsleb(&b) * c->dataalign, NULL);
+			break;
+		case DW_CFA_restore_extended:
+			restore(x, getdwuleb(&b));
+			break;
+		case DW_CFA_undefined:
+			setrule(x, getdwuleb(&b), ELFCFI_UNDEF, 0, 0, NULL);
+			break;
+		case DW_CFA_same_value:
+			setrule(x, getdwuleb(&b), ELFCFI_SAME, 0, 0, NULL);
+			break;
+		case DW_CFA_register:
+			reg = getdwuleb(&b);
+			reg2 = getdwuleb(&b);
+			setrule(x, reg, ELFCFI_REG, reg2, 0, NULL);
+			break;
+		case DW_CFA_expression:
+		case DW_CFA_val_expression:
+			reg = getdwuleb(&b);
+			n = getdwuleb(&b);
+			if (b.err || n > (uint64_t)(b.end - b.p))
+				return -1;
+			setrule(x, reg, op == DW_CFA_expression ? ELFCFI_EXPR : ELFCFI_VALEXPR, 0, n, b.p);
+			b.p += n;
+			break;
+		case DW_CFA_remember_state:
+			if (x->depth == Cfidepth)
+				return -1;
+			x->stack[x->depth++] = x->row;
+			break;
+		case DW_CFA_restore_state:
+			if (x->depth == 0)
+				return -1;
+			x->row = x->stack[--x->depth];
+			break;
+		case DW_CFA_def_cfa:
+			x->row.cfa.type = ELFCFI_CFAREG;
+			x->row.cfa.reg = getdwuleb(&b);
+			x->row.cfa.off = getdwuleb(&b);
+			break;
+		case DW_CFA_def_cfa_sf:
+			x->row.cfa.type = ELFCFI_CFAREG;
+			x->row.cfa.reg = getdwuleb(&b);
+			x->row.cfa.off = getdwsleb(&b) * c->dataalign;
+			break;
+		case DW_CFA_def_cfa_register:
+			x->row.cfa.type = ELFCFI_CFAREG;
+			x->row.cfa.reg = getdwuleb(&b);
+			break;
+		case DW_CFA_def_cfa_offset:
+			x->row.cfa.off = getdwuleb(&b);
+			break;
+		case DW_CFA_def_cfa_offset_sf:
+			x->row.cfa.off = getdwsleb(&b) * c->dataalign;
+			break;
+		case DW_CFA_def_cfa_expression:
+			n = getdwuleb(&b);
+			if (b.err || n > (uint64_t)(b.end - b.p))
+				return -1;
+			x->row.cfa.type = ELFCFI_CFAEXPR;
+			x->row.cfa.off = n;
+			x->row.cfa.expr = b.p;
+			b.p += n;
+			break;
+		case DW_CFA_GNU_args_size:
+			getdwuleb(&b);
+			break;
+		case DW_CFA_GNU_window_save:
+			/* Return address signing state, left to the caller */
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	return b.err ? -1 : 0;
+}
+
+/*
+ * Run the instructions of the FDE at off into rows, grown on the
+ * heap and kept at their size in the arena of the handle. Returns
+ * NULL when out of memory.
+ */
+static Cfifde*
+decodefde(Cfitab *ct, uint64_t off)
+{
+	Cfiexec *x;
+	Cfifde *d;
+	Cfirow init;
+	Fde f;
+	Cie c;
+
+	if (readfde(ct, off, &f, &c) < 0 || f.hi <= f.lo)
+		return &badfde;
+
+	x = calloc(1, sizeof(*x));
+	if (x == NULL)
+		return NULL;
+
+	x->ct = ct;
+	x->cie = &c;
+	x->loc = f.lo;
+	x->hi = f.hi;
+	x->row.ra = c.ra;
+	x->row.signal = c.signal;
+
+	if (runcfi(x, c.insns, c.end) < 0)
+		goto bad;
+
+	init = x->row;
+	x->init = &init;
+	x->loc = f.lo;
+
+	if (runcfi(x, f.insns, f.end) < 0)
+		goto bad;
+	advance(x, f.hi);
+	if (x->nomem)
+		goto nomem;
+
+	d = elfalloc(ct->fp, sizeof(*d) + (uint64_t)x->nrow * sizeof(x->rows[0]));
+	if (d == NULL)
+		goto nomem;
+	d->lo = f.lo;
+	d->hi = f.hi;
+	d->rows = (Cfirow*)(d + 1);
+	d->nrow = x->nrow;
+	if (x->nrow > 0)
+		memcpy(d->rows, x->rows, x->nrow * sizeof(x->rows[0]));
+
+	free(x->rows);
+	free(x);
+
+	return d;
+
+bad:
+	if (x->nomem)
+		goto nomem;
+	free(x->rows);
+	free(x);
+	return &badfde;
+
+nomem:
+	free(x->rows);
+	free(x);
+	return NULL;
+}
+
+/*
+ * Get the start PC and the .eh_frame offset of the FDE i of the
+ * search table
+ */
+static int
+tableent(Cfitab *ct, uint32_t i, uint64_t *pc, uint64_t *off)
+{
+	uint64_t addr;
+	Dwbuf b;
+
+	if (ct->table == NULL) {
+		*pc = ct->ents[2*i];
+		*off = ct->ents[2*i+1];
+		return 0;
+	}
+
+	b.p = ct->table + (uint64_t)i * ct->tableent;
+	b.end = b.p + ct->tableent;
+	b.fp = ct->fp;
+	b.err = 0;
+
+	if (readptr(ct, &b, ct->hdr, ct->hdraddr, ct->tableenc, pc) < 0)
+		return -1;
+	if (readptr(ct, &b, ct->hdr, ct->hdraddr, ct->tableenc, &addr) < 0)
+		return -1;
+
+	*off = addr - ct->ehframeaddr;
+
+	return 0;
+}
+
+/*
+ * Get the rows of FDE i of the search table, running its
+ * instructions on first use. FDEs decoded by several threads at
+ * once are published once.
+ */
+static Cfifde*
+getfde(Cfitab *ct, uint32_t i)
+{
+	Cfifde *d, *old;
+	uint64_t pc, off;
+
+	d = __atomic_load_n(&ct->fdes[i], __ATOMIC_ACQUIRE);
+	if (d != NULL)
+		return d;
+
+	if (tableent(ct, i, &pc, &off) < 0)
+		d = &badfde;
+	else
+		d = decodefde(ct, off);
+	if (d == NULL)
+		return NULL;
+
+	/* The rows of a thread losing the race stay in the arena */
+	old = NULL;
+	if (!__atomic_compare_exchange_n(&ct->fdes[i], &old, d, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		d = old;
+
+	return d;
+}
+
+/*
+ * Read the header of .eh_frame_hdr. Its search table is used in
+ * place when its entries have a fixed size.
+ */
+static int
+readhdr(Cfitab *ct, uint64_t *ehframe)
+{
+	uint8_t ptrenc, countenc, enc;
+	uint64_t count;
+	Dwbuf b;
+
+	b.p = ct->hdr;
+	b.end = ct->hdr + ct->hdrsize;
+	b.fp = ct->fp;
+	b.err = 0;
+
+	if (getdwfixed(&b, 1) != 1)
+		return -1;
+	ptrenc = getdwfixed(&b, 1);
+	countenc = getdwfixed(&b, 1);
+	enc = getdwfixed(&b, 1);
+
+	if (readptr(ct, &b, ct->hdr, ct->hdraddr, ptrenc, ehframe) < 0)
+		return -1;
+
+	if (countenc == DW_EH_PE_omit || enc == DW_EH_PE_omit)
+		return 0;
+	if (readptr(ct, &b, ct->hdr, ct->hdraddr, countenc, &count) < 0)
+		return 0;
+
+	switch (enc & 0x0f) {
+	case DW_EH_PE_udata2:
+	case DW_EH_PE_sdata2:
+		ct->tableent = 4;
+		break;
+	case DW_EH_PE_udata4:
+	case DW_EH_PE_sdata4:
+		ct->tableent = 8;
+		break;
+	case DW_EH_PE_udata8:
+	case DW_EH_PE_sdata8:
+		ct->tableent = 16;
+		break;
+	default:
+		return 0;
+	}
+
+	if ((enc & 0x70) != DW_EH_PE_absptr && (enc & 0x70) != DW_EH_PE_datarel)
+		return 0;
+	if (count > (uint64_t)(b.end - b.p) / ct->tableent)
+		return 0;
+
+	ct->table = b.p;
+	ct->tableenc = enc;
+	ct->nfde = count;
+
+	return 0;
+}
+
+static int
+entcmp(const void *a, const void *b)
+{
+	const uint64_t *x, *y;
+
+	x = a;
+	y = b;
+
+	if (x[0] != y[0])
+		return x[0] < y[0] ? -1 : 1;
+
+	return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+/*
+ * Build the search table from the FDEs of .eh_frame, for files
+ * without a usable .eh_frame_hdr. It grows on the heap, and is kept
+ * at its size in the arena of the handle.
+ */
+static int
+buildtable(Cfitab *ct)
+{
+	uint64_t off, cie, *ents, *p;
+	uint32_t n;
+	Dwbuf b;
+	Fde f;
+	Cie c;
+
+	ents = NULL;
+	n = 0;
+	for (off = 0; readentry(ct, off, &b, &cie) == 0; off = b.end - ct->ehframe) {
+		if (cie == ~(uint64_t)0 || readfde(ct, off, &f, &c) < 0 || f.hi <= f.lo)
+			continue;
+		if ((n & (n - 1)) == 0) {
+			p = realloc(ents, (n ? 2 * n : 1) * 2 * sizeof(ents[0]));
+			if (p == NULL) {
+				free(ents);
+				return -1;
+			}
+			ents = p;
+		}
+		ents[2*n] = f.lo;
+		ents[2*n+1] = off;
+		n++;
+	}
+
+	qsort(ents, n, 2 * sizeof(ents[0]), entcmp);
+
+	ct->ents = elfdup(ct->fp, ents, (uint64_t)n * 2 * sizeof(ents[0]));
+	free(ents);
+	if (ct->ents == NULL)
+		return -1;
+	ct->nfde = n;
+
+	return 0;
+}
+
+/*
+ * Decode the call frame information
+ */
+static int
+readcfi(FILE *f, Cfitab *ct, Fhdr *fp)
+{
+	uint64_t ehframe;
+	Shdr eh, hdr, *s;
+	Phdr *ph;
+
+	memset(ct, 0, sizeof(*ct));
+	memset(&eh, 0, sizeof(eh));
+	memset(&hdr, 0, sizeof(hdr));
+	ct->fp = fp;
+	ct->sp = spreg(fp->machine);
+
+	if (fp->shdrs != NULL) {
+		s = elfshdrname(fp, ".eh_frame");
+		if (s == NULL || s->type == SHT_NOBITS)
+			goto notfound;
+		eh = *s;
+		s = elfshdrname(fp, ".eh_frame_hdr");
+		if (s != NULL && s->type != SHT_NOBITS)
+			hdr = *s;
+	} else {
+		ph = elfphdrtype(fp, PT_GNU_EH_FRAME, NULL);
+		if (ph == NULL)
+			goto notfound;
+		hdr.offset = ph->offset;
+		hdr.size = ph->filesz;
+		hdr.addr = ph->vaddr;
+	}
+
+	if (hdr.size > 0) {
+		ct->hdr = keepsection(f, &hdr, fp);
+		if (ct->hdr == NULL)
+			goto err;
+		ct->hdrsize = hdr.size;
+		ct->hdraddr = hdr.addr;
+		if (readhdr(ct, &ehframe) < 0 && fp->shdrs == NULL)
+			goto notfound;
+
+		/* Without sections, .eh_frame runs to the end of its segment */
+		if (fp->shdrs == NULL) {
+			ph = findload(fp, ehframe, 0);
+			if (ph == NULL || elfvaddroff(fp, ehframe, &eh.offset) < 0)
+				goto notfound;
+			eh.addr = ehframe;
+			eh.size = ph->vaddr + ph->filesz - ehframe;
+		}
+	}
+
+	ct->ehframe = keepsection(f, &eh, fp);
+	if (ct->ehframe == NULL)
+		goto err;
+	ct->ehframesize = eh.size;
+	ct->ehframeaddr = eh.addr;
+
+	if (ct->table == NULL && buildtable(ct) < 0)
+		goto err;
+
+	ct->fdes = elfalloc(fp, (uint64_t)(ct->nfde + 1) * sizeof(ct->fdes[0]));
+	if (ct->fdes == NULL)
+		goto err;
+	memset(ct->fdes, 0, (uint64_t)(ct->nfde + 1) * sizeof(ct->fdes[0]));
+
+	return 0;
+
+notfound:
+	fprintf(stderr, "call frame information not found\n");
+err:
+	freeelfcfi(ct);
+	return -1;
+}
+
+/*
+ * Read the call frame information of .eh_frame, from the sections or
+ * from the PT_GNU_EH_FRAME segment, which locates it. FDEs are found
+ * by binary search in the table of .eh_frame_hdr, used in place, and
+ * their instructions are run on the first lookup into them. The
+ * handle keeps the table for the reads that follow; it and the rows
+ * are allocated from the arena of the handle, and live as long as it.
+ */
+int
+readelfcfi(FILE *f, Cfitab *ct, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Tcfi, 0, 0, ct, sizeof(*ct));
+	if (r <= 0)
+		return r;
+
+	r = readcfi(f, ct, fp);
+
+	return keepelftab(fp, Tcfi, 0, 0, r, ct, sizeof(*ct));
+}
+
+/*
+ * Get the row of the call frame information of a pc, or NULL. Rows
+ * stay valid as long as the handle. The pc of a caller is a return
+ * address, past its call: unless the frame is a signal frame, its
+ * row is the one of pc - 1.
+ */
+const Cfirow*
+lookupelfcfi(Cfitab *ct, uint64_t pc)
+{
+	uint32_t lo, hi, mid;
+	uint64_t start, off;
+	Cfifde *d;
+
+	lo = 0;
+	hi = ct->nfde;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (tableent(ct, mid, &start, &off) < 0)
+			return NULL;
+		if (start <= pc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+
+	d = getfde(ct, lo - 1);
+	if (d == NULL || pc < d->lo || pc >= d->hi)
+		return NULL;
+
+	lo = 0;
+	hi = d->nrow;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (d->rows[mid].start <= pc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0 || pc >= d->rows[lo-1].end)
+		return NULL;
+
+	return &d->rows[lo-1];
+}
+
+/*
+ * Read a word of the class of the file
+ */
+static int
+readword(Cfitab *ct, uint64_t addr, uint64_t *v, int (*readmem)(void*, uint64_t, uint64_t, void*), void *arg)
+{
+	uint8_t buf[8];
+	uint32_t v32;
+
+	if (ct->fp->class == ELFCLASS32) {
+		if (readmem(arg, addr, 4, buf) < 0)
+			return -1;
+		ct->fp->get32(buf, &v32);
+		*v = v32;
+		return 0;
+	}
+
+	if (readmem(arg, addr, 8, buf) < 0)
+		return -1;
+	ct->fp->get64(buf, v);
+
+	return 0;
+}
+
+/*
+ * Evaluate a DWARF expression of the call frame information, with
+ * the CFA pushed first for register rules
+ */
+static int
+evalexpr(Cfitab *ct, const Cfirule *rule, uint64_t *regs, uint64_t *push, int (*readmem)(void*, uint64_t, uint64_t, void*), void *arg, uint64_t *out)
+{
+	uint64_t st[Exprdepth], a, reg;
+	uint8_t op, buf[8], *start;
+	int64_t off;
+	int sp, steps;
+	Dwbuf b, m;
+
+	start = (uint8_t*)rule->expr;
+	b.p = start;
+	b.end = start + rule->off;
+	b.fp = ct->fp;
+	b.err = 0;
+
+	sp = 0;
+	if (push != NULL)
+		st[sp++] = *push;
+
+	for (steps = 0; b.p < b.end; steps++) {
+		if (steps == Exprsteps || sp == Exprdepth)
+			return -1;
+
+		op = getdwfixed(&b, 1);
+
+		if (op >= DW_OP_lit0 && op <= DW_OP_lit31) {
+			st[sp++] = op - DW_OP_lit0;
+			continue;
+		}
+		if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+			reg = op - DW_OP_breg0;
+			off = getdwsleb(&b);
+			if (reg >= ELFCFI_NREG)
+				return -1;
+			st[sp++] = regs[reg] + off;
+			continue;
+		}
+
+		switch (op) {
+		case DW_OP_nop:
+			continue;
+		case DW_OP_addr:
+			st[sp++] = getdwfixed(&b, ct->fp->class == ELFCLASS32 ? 4 : 8);
+			continue;
+		case DW_OP_const1u:
+			st[sp++] = getdwfixed(&b, 1);
+			continue;
+		case DW_OP_const1s:
+			st[sp++] = (int8_t)getdwfixed(&b, 1);
+			continue;
+		case DW_OP_const2u:
+			st[sp++] = getdwfixed(&b, 2);
+			continue;
+		case DW_OP_const2s:
+			st[sp++] = (int16_t)getdwfixed(&b, 2);
+			continue;
+		case DW_OP_const4u:
+			st[sp++] = getdwfixed(&b, 4);
+			continue;
+		case DW_OP_const4s:
+			st[sp++] = (int32_t)getdwfixed(&b, 4);
+			continue;
+		case DW_OP_const8u:
+		case DW_OP_const8s:
+			st[sp++] = getdwfixed(&b, 8);
+			continue;
+		case DW_OP_constu:
+			st[sp++] = getdwuleb(&b);
+			continue;
+		case DW_OP_consts:
+			st[sp++] = getdwsleb(&b);
+			continue;
+		case DW_OP_bregx:
+			reg = getdwuleb(&b);
+			off = getdwsleb(&b);
+			if (reg >= ELFCFI_NREG)
+				return -1;
+			st[sp++] = regs[reg] + off;
+			continue;
+		case DW_OP_skip:
+		case DW_OP_bra:
+			off = (int16_t)getdwfixed(&b, 2);
+			if (op == DW_OP_bra) {
+				if (sp < 1)
+					return -1;
+				if (st[--sp] == 0)
+					continue;
+			}
+			if (off < start - b.p || off > b.end - b.p)
+				return -1;
+			b.p += off;
+			continue;
+		}
+
+		/* Operations on the top of the stack */
+		if (sp < 1)
+			return -1;
+		a = st[sp-1];
+
+		switch (op) {
+		case DW_OP_dup:
+			st[sp++] = a;
+			continue;
+		case DW_OP_drop:
+			sp--;
+			continue;
+		case DW_OP_pick:
+			reg = getdwfixed(&b, 1);
+			if (reg >= (uint64_t)sp)
+				return -1;
+			st[sp] = st[sp-1-reg];
+			sp++;
+			continue;
+		case DW_OP_deref:
+			if (readword(ct, a, &st[sp-1], readmem, arg) < 0)
+				return -1;
+			continue;
+		case DW_OP_deref_size:
+			reg = getdwfixed(&b, 1);
+			if (reg == 0 || reg > 8 || readmem(arg, a, reg, buf) < 0)
+				return -1;
+			m.p = buf;
+			m.end = buf + reg;
+			m.fp = ct->fp;
+			m.err = 0;
+			st[sp-1] = getdwfixed(&m, reg);
+			continue;
+		case DW_OP_abs:
+			if ((int64_t)a < 0)
+				st[sp-1] = -a;
+			continue;
+		case DW_OP_neg:
+			st[sp-1] = -a;
+			continue;
+		case DW_OP_not:
+			st[sp-1] = ~a;
+			continue;
+		case DW_OP_plus_uconst:
+			st[sp-1] = a + getdwuleb(&b);
+			continue;
+		case DW_OP_over:
+			if (sp < 2)
+				return -1;
+			st[sp] = st[sp-2];
+			sp++;
+			continue;
+		case DW_OP_swap:
+			if (sp < 2)
+				return -1;
+			st[sp-1] = st[sp-2];
+			st[sp-2] = a;
+			continue;
+		case DW_OP_rot:
+			if (sp < 3)
+				return -1;
+			st[sp-1] = st[sp-2];
+			st[sp-2] = st[sp-3];
+			st[sp-3] = a;
+			continue;
+		}
+
+		/* Operations on the two top entries */
+		if (sp < 2)
+			return -1;
+		sp--;
+		reg = st[sp-1];
+
+		switch (op) {
+		case DW_OP_and:
+			st[sp-1] = reg & a;
+			break;
+		case DW_OP_or:
+			st[sp-1] = reg | a;
+			break;
+		case DW_OP_xor:
+			st[sp-1] = reg ^ a;
+			break;
+		case DW_OP_plus:
+			st[sp-1] = reg + a;
+			break;
+		case DW_OP_minus:
+			st[sp-1] = reg - a;
+			break;
+		case DW_OP_mul:
+			st[sp-1] = reg * a;
+			break;
+		case DW_OP_div:
+			if (a == 0)
+				return -1;
+			st[sp-1] = (int64_t)reg / (int64_t)a;
+			break;
+		case DW_OP_mod:
+			if (a == 0)
+				return -1;
+			st[sp-1] = reg % a;
+			break;
+		case DW_OP_shl:
+			st[sp-1] = a < 64 ? reg << a : 0;
+			break;
+		case DW_OP_shr:
+			st[sp-1] = a < 64 ? reg >> a : 0;
+			break;
+		case DW_OP_shra:
+			st[sp-1] = (int64_t)reg >> (a < 64 ? a : 63);
+			break;
+		case DW_OP_eq:
+			st[sp-1] = (int64_t)reg == (int64_t)a;
+			break;
+		case DW_OP_ne:
+			st[sp-1] = (int64_t)reg != (int64_t)a;
+			break;
+		case DW_OP_ge:
+			st[sp-1] = (int64_t)reg >= (int64_t)a;
+			break;
+		case DW_OP_gt:
+			st[sp-1] = (int64_t)reg > (int64_t)a;
+			break;
+		case DW_OP_le:
+			st[sp-1] = (int64_t)reg <= (int64_t)a;
+			break;
+		case DW_OP_lt:
+			st[sp-1] = (int64_t)reg < (int64_t)a;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (b.err || sp < 1)
+		return -1;
+
+	*out = st[sp-1];
+	if (ct->fp->class == ELFCLASS32)
+		*out &= 0xffffffff;
+
+	return 0;
+}
+
+/*
+ * Recover the value of a register in the caller. Returns 1 when it
+ * is undefined.
+ */
+static int
+applyrule(Cfitab *ct, const Cfirule *r, uint64_t cfa, uint64_t *regs, uint64_t *v, int (*readmem)(void*, uint64_t, uint64_t, void*), void *arg)
+{
+	uint64_t a;
+
+	switch (r->type) {
+	case ELFCFI_SAME:
+		return 0;
+	case ELFCFI_UNDEF:
+		return 1;
+	case ELFCFI_OFFSET:
+		return readword(ct, cfa + r->off, v, readmem, arg);
+	case ELFCFI_VALOFFSET:
+		*v = cfa + r->off;
+		return 0;
+	case ELFCFI_REG:
+		if (r->reg >= ELFCFI_NREG)
+			return -1;
+		*v = regs[r->reg];
+		return 0;
+	case ELFCFI_EXPR:
+		if (evalexpr(ct, r, regs, &cfa, readmem, arg, &a) < 0)
+			return -1;
+		return readword(ct, a, v, readmem, arg);
+	case ELFCFI_VALEXPR:
+		return evalexpr(ct, r, regs, &cfa, readmem, arg, v);
+	}
+
+	return -1;
+}
+
+/*
+ * Unwind a frame with its row: from the registers of the frame, by
+ * DWARF number, compute those of its caller, and the return address
+ * into pc. Saved registers are read through readmem(arg, addr, len,
+ * buf), from a copy of the stack for instance. Registers without a
+ * rule keep their value. Returns 1 at the outermost frame, whose
+ * return address is undefined.
+ */
+int
+unwindelfcfi(Cfitab *ct, const Cfirow *r, uint64_t *regs, uint64_t *pc, int (*readmem)(void*, uint64_t, uint64_t, void*), void *arg)
+{
+	uint64_t caller[ELFCFI_NREG], cfa, ra;
+	uint32_t i;
+	int n;
+
+	switch (r->cfa.type) {
+	case ELFCFI_CFAREG:
+		if (r->cfa.reg >= ELFCFI_NREG)
+			return -1;
+		cfa = regs[r->cfa.reg] + r->cfa.off;
+		break;
+	case ELFCFI_CFAEXPR:
+		if (evalexpr(ct, &r->cfa, regs, NULL, readmem, arg, &cfa) < 0)
+			return -1;
+		break;
+	default:
+		return -1;
+	}
+
+	if (r->ra >= ELFCFI_NREG && r->rarule.type == ELFCFI_SAME)
+		return -1;
+	ra = r->ra < ELFCFI_NREG ? regs[r->ra] : 0;
+	n = applyrule(ct, &r->rarule, cfa, regs, &ra, readmem, arg);
+	if (n != 0)
+		return n;
+
+	for (i = 0; i < ELFCFI_NREG; i++) {
+		caller[i] = regs[i];
+		if (applyrule(ct, &r->regs[i], cfa, regs, &caller[i], readmem, arg) < 0)
+			return -1;
+	}
+
+	/* The CFA is the stack pointer of the caller */
+	if (ct->sp < ELFCFI_NREG && r->regs[ct->sp].type == ELFCFI_SAME)
+		caller[ct->sp] = cfa;
+	if (r->ra < ELFCFI_NREG)
+		caller[r->ra] = ra;
+
+	memcpy(regs, caller, sizeof(caller));
+	*pc = ra;
+
+	return 0;
+}
+
+/*
+ * Forget call frame information, whose memory goes with the arena
+ */
+void
+freeelfcfi(Cfitab *ct)
+{
+	memset(ct, 0, sizeof(*ct));
+}
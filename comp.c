@@ -0,0 +1,564 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <pthread.h>
+#include <zstd.h>
+#endif
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	Zinsz = 64*1024,	/* Compressed bytes read at a time */
+};
+
+#ifdef HAVE_ZSTD
+typedef struct Zframe Zframe;
+typedef struct Zjob Zjob;
+
+/*
+ * Independent zstd frame and its place in the output
+ */
+struct Zframe {
+	uint8_t		*src;
+	size_t		srclen;
+	uint8_t		*dst;
+	size_t		dstlen;
+};
+
+/*
+ * Frames shared by the decompression threads
+ */
+struct Zjob {
+	Zframe		*fr;
+	uint32_t	n;
+	uint32_t	next;		/* Next frame to decompress */
+	int		err;
+};
+#endif
+
+/*
+ * Decode ELF Compression Header. Returns the header size.
+ */
+int
+readelfchdr(uint8_t *buf, uint64_t len, Chdr *ch, Fhdr *fp)
+{
+	Elf32_Chdr c32;
+	Elf64_Chdr c64;
+	uint8_t *p;
+
+	p = buf;
+
+	switch (fp->class) {
+	case ELFCLASS32:
+		if (len < Ch32sz)
+			return -1;
+		p += fp->get32(p, &c32.type);
+		p += fp->get32(p, &c32.size);
+		p += fp->get32(p, &c32.addralign);
+		ch->type = c32.type;
+		ch->size = c32.size;
+		ch->addralign = c32.addralign;
+		break;
+	case ELFCLASS64:
+		if (len < Ch64sz)
+			return -1;
+		p += fp->get32(p, &c64.type);
+		p += fp->get32(p, &c64.reserved);
+		p += fp->get64(p, &c64.size);
+		p += fp->get64(p, &c64.addralign);
+		ch->type = c64.type;
+		ch->size = c64.size;
+		ch->addralign = c64.addralign;
+		break;
+	default:
+		return -1;
+	}
+
+	return p - buf;
+}
+
+/*
+ * Set up the decompressor of a stream
+ */
+static int
+initzstream(Zstream *s)
+{
+	switch (s->ch.type) {
+#ifdef HAVE_ZLIB
+	case ELFCOMPRESS_ZLIB:
+		s->z = calloc(1, sizeof(z_stream));
+		if (s->z == NULL)
+			return -1;
+		if (inflateInit(s->z) != Z_OK) {
+			free(s->z);
+			s->z = NULL;
+			return -1;
+		}
+		return 0;
+#endif
+#ifdef HAVE_ZSTD
+	case ELFCOMPRESS_ZSTD:
+		s->z = ZSTD_createDStream();
+		if (s->z == NULL)
+			return -1;
+		ZSTD_initDStream(s->z);
+		return 0;
+#endif
+	default:
+		fprintf(stderr, "unsupported compression %u\n", s->ch.type);
+		return -1;
+	}
+}
+
+/*
+ * Refill the input buffer of a stream
+ */
+static int
+fillzstream(Zstream *s)
+{
+	uint64_t n;
+
+	if (s->in == NULL || s->off >= s->end) {
+		fprintf(stderr, "truncated compressed section\n");
+		return -1;
+	}
+
+	n = s->end - s->off;
+	if (n > Zinsz)
+		n = Zinsz;
+
+	if (readat(s->f, s->fp, s->in, n, s->off) < 0)
+		return -1;
+
+	s->off += n;
+	s->next = s->in;
+	s->avail = n;
+
+	return 0;
+}
+
+/*
+ * Decompress pending input into buf. Returns the number of bytes
+ * produced and sets *used to the number of bytes consumed.
+ */
+static int64_t
+stepzstream(Zstream *s, uint8_t *buf, uint64_t len, uint64_t *used)
+{
+#ifdef HAVE_ZLIB
+	z_stream *z;
+	int r;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+#endif
+
+	USED(buf);
+	USED(len);
+	USED(used);
+
+	switch (s->ch.type) {
+#ifdef HAVE_ZLIB
+	case ELFCOMPRESS_ZLIB:
+		z = s->z;
+		z->next_in = s->next;
+		z->avail_in = s->avail > UINT32_MAX ? UINT32_MAX : s->avail;
+		z->next_out = buf;
+		z->avail_out = len > UINT32_MAX ? UINT32_MAX : len;
+		r = inflate(z, Z_NO_FLUSH);
+		if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR)
+			return -1;
+		*used = z->next_in - s->next;
+		return z->next_out - buf;
+#endif
+#ifdef HAVE_ZSTD
+	case ELFCOMPRESS_ZSTD:
+		in.src = s->next;
+		in.size = s->avail;
+		in.pos = 0;
+		out.dst = buf;
+		out.size = len;
+		out.pos = 0;
+		if (ZSTD_isError(ZSTD_decompressStream(s->z, &out, &in)))
+			return -1;
+		*used = in.pos;
+		return out.pos;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Open a stream over a compressed section
+ */
+int
+openelfzstream(FILE *f, Shdr *sh, Zstream *s, Fhdr *fp)
+{
+	uint8_t buf[Ch64sz];
+	int n;
+
+	memset(s, 0, sizeof(*s));
+
+	if (!(sh->flags & SHF_COMPRESSED) || sh->type == SHT_NOBITS) {
+		fprintf(stderr, "section not compressed\n");
+		return -1;
+	}
+
+	n = fp->class == ELFCLASS32 ? Ch32sz : Ch64sz;
+	if (sh->size < (uint64_t)n || readat(f, fp, buf, n, sh->offset) < 0)
+		return -1;
+
+	if (readelfchdr(buf, n, &s->ch, fp) < 0)
+		return -1;
+
+	s->f = f;
+	s->fp = fp;
+	s->off = sh->offset + n;
+	s->end = sh->offset + sh->size;
+
+	/* A mapping is consumed in place */
+	if (fp->map != NULL) {
+		s->next = (uint8_t*)mapelfshdrsection(fp, sh);
+		if (s->next == NULL)
+			return -1;
+		s->next += n;
+		s->avail = s->end - s->off;
+		s->off = s->end;
+	} else {
+		s->in = malloc(Zinsz);
+		if (s->in == NULL)
+			return -1;
+	}
+
+	if (initzstream(s) < 0) {
+		closeelfzstream(s);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Decompress up to len bytes of the section into buf. Returns the
+ * number of bytes produced, 0 at the end of the section, or -1.
+ */
+int64_t
+readelfzstream(Zstream *s, uint8_t *buf, uint64_t len)
+{
+	uint64_t n, used;
+	int64_t r;
+
+	if (len > s->ch.size - s->out)
+		len = s->ch.size - s->out;
+
+	for (n = 0; n < len;) {
+		if (s->avail == 0 && fillzstream(s) < 0)
+			return -1;
+
+		r = stepzstream(s, buf + n, len - n, &used);
+		if (r < 0 || (r == 0 && used == 0)) {
+			fprintf(stderr, "corrupt compressed section\n");
+			return -1;
+		}
+
+		s->next += used;
+		s->avail -= used;
+		n += r;
+	}
+
+	s->out += n;
+
+	return n;
+}
+
+void
+closeelfzstream(Zstream *s)
+{
+	switch (s->ch.type) {
+#ifdef HAVE_ZLIB
+	case ELFCOMPRESS_ZLIB:
+		if (s->z != NULL)
+			inflateEnd(s->z);
+		free(s->z);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case ELFCOMPRESS_ZSTD:
+		ZSTD_freeDStream(s->z);
+		break;
+#endif
+	}
+
+	free(s->in);
+	s->in = NULL;
+	s->z = NULL;
+}
+
+#ifdef HAVE_ZSTD
+static void*
+zworker(void *v)
+{
+	ZSTD_DCtx *dc;
+	Zframe *fr;
+	uint32_t i;
+	size_t r;
+	Zjob *j;
+
+	j = v;
+
+	dc = ZSTD_createDCtx();
+	if (dc == NULL) {
+		__atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	while ((i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < j->n) {
+		fr = &j->fr[i];
+		r = ZSTD_decompressDCtx(dc, fr->dst, fr->dstlen, fr->src, fr->srclen);
+		if (ZSTD_isError(r) || r != fr->dstlen)
+			__atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+	}
+
+	ZSTD_freeDCtx(dc);
+
+	return NULL;
+}
+
+/*
+ * Decompress the independent frames of a zstd payload on up to
+ * nthread threads. Returns 1 when the payload can't be split, when
+ * it is a single frame or a frame doesn't record its size.
+ */
+static int
+zstdframes(uint8_t *dst, uint64_t dstlen, uint8_t *src, uint64_t srclen, int nthread)
+{
+	unsigned long long d;
+	uint64_t p, total;
+	pthread_t *th;
+	Zjob j;
+	size_t c;
+	int i, n;
+
+	memset(&j, 0, sizeof(j));
+
+	/* Count the frames, then record them */
+	for (i = 0; i < 2; i++) {
+		total = 0;
+		for (p = 0, j.n = 0; p < srclen; p += c, j.n++) {
+			c = ZSTD_findFrameCompressedSize(src + p, srclen - p);
+			if (ZSTD_isError(c))
+				goto err;
+			d = ZSTD_getFrameContentSize(src + p, srclen - p);
+			if (d == ZSTD_CONTENTSIZE_UNKNOWN || d == ZSTD_CONTENTSIZE_ERROR)
+				goto one;
+			if (d > dstlen - total)
+				goto err;
+			if (j.fr != NULL) {
+				j.fr[j.n].src = src + p;
+				j.fr[j.n].srclen = c;
+				j.fr[j.n].dst = dst + total;
+				j.fr[j.n].dstlen = d;
+			}
+			total += d;
+		}
+		if (total != dstlen)
+			goto err;
+		if (j.n < 2)
+			goto one;
+		if (j.fr == NULL) {
+			j.fr = malloc(j.n * sizeof(j.fr[0]));
+			if (j.fr == NULL)
+				goto err;
+		}
+	}
+
+	if (nthread > (int)j.n)
+		nthread = j.n;
+
+	th = malloc(nthread * sizeof(th[0]));
+	if (th == NULL)
+		goto err;
+
+	/* The calling thread takes frames too */
+	for (n = 0; n < nthread - 1; n++) {
+		if (pthread_create(&th[n], NULL, zworker, &j) != 0)
+			break;
+	}
+	zworker(&j);
+	for (i = 0; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	free(th);
+	free(j.fr);
+
+	return j.err ? -1 : 0;
+
+one:
+	free(j.fr);
+	return 1;
+
+err:
+	free(j.fr);
+	return -1;
+}
+#endif
+
+/*
+ * Decompress the bytes of a compressed section that follow its
+ * Compression Header into out, of ch->size bytes
+ */
+static int
+unpackto(Chdr *ch, uint8_t *src, uint64_t len, uint8_t *out, int nthread)
+{
+	Zstream s;
+
+	USED(nthread);
+#ifdef HAVE_ZSTD
+	if (ch->type == ELFCOMPRESS_ZSTD && nthread > 1) {
+		switch (zstdframes(out, ch->size, src, len, nthread)) {
+		case 0:
+			return 0;
+		case -1:
+			fprintf(stderr, "corrupt compressed section\n");
+			return -1;
+		}
+	}
+#endif
+
+	memset(&s, 0, sizeof(s));
+	s.ch = *ch;
+	s.next = src;
+	s.avail = len;
+
+	if (initzstream(&s) < 0)
+		return -1;
+
+	if (readelfzstream(&s, out, ch->size) != (int64_t)ch->size) {
+		closeelfzstream(&s);
+		return -1;
+	}
+
+	closeelfzstream(&s);
+
+	return 0;
+}
+
+/*
+ * Decompress a compressed section held in memory into a buffer of
+ * the allocator a, or of the heap when a is NULL
+ */
+uint8_t*
+unpacksection(uint8_t *sect, uint64_t len, uint64_t *size, int nthread, Elfalloc *a, Fhdr *fp)
+{
+	uint8_t *out;
+	Chdr ch;
+	int n;
+
+	n = readelfchdr(sect, len, &ch, fp);
+	if (n < 0)
+		return NULL;
+
+	if (ch.size > SIZE_MAX - 1)
+		return NULL;
+
+	out = allocbuf(a, ch.size);
+	if (out == NULL)
+		return NULL;
+
+	if (unpackto(&ch, sect + n, len - n, out, nthread) < 0) {
+		freebuf(a, out);
+		return NULL;
+	}
+
+	*size = ch.size;
+
+	return out;
+}
+
+/*
+ * Read ELF Section from its Section Header, decompressed. zstd
+ * sections made of several frames are decompressed on up to nthread
+ * threads.
+ */
+uint8_t*
+readelfzsection(FILE *f, Shdr *sh, uint64_t *size, int nthread, Fhdr *fp)
+{
+	uint8_t *sect, *out;
+	int mapped;
+
+	if (!(sh->flags & SHF_COMPRESSED)) {
+		out = readelfshdrsection(f, sh, fp);
+		if (out != NULL)
+			*size = sh->size;
+		return out;
+	}
+
+	sect = getsection(f, sh, fp, &mapped);
+	if (sect == NULL)
+		return NULL;
+
+	out = unpacksection(sect, sh->size, size, nthread, elfallocator(fp), fp);
+
+	putsection(sect, mapped);
+
+	return out;
+}
+
+/*
+ * Read ELF Section from its Section Header into buf, decompressed.
+ * Returns the section size, reading nothing when it is larger than
+ * len, or -1.
+ */
+int64_t
+readelfzsectionbuf(FILE *f, Shdr *sh, uint8_t *buf, uint64_t len, int nthread, Fhdr *fp)
+{
+	uint8_t hdr[Ch64sz];
+	const uint8_t *sect;
+	Zstream zs;
+	Chdr ch;
+	int n;
+
+	if (!(sh->flags & SHF_COMPRESSED))
+		return readelfshdrsectionbuf(f, sh, buf, len, fp);
+
+	if (sh->type == SHT_NOBITS)
+		return -1;
+
+	n = fp->class == ELFCLASS32 ? Ch32sz : Ch64sz;
+	if (sh->size < (uint64_t)n || readat(f, fp, hdr, n, sh->offset) < 0)
+		return -1;
+	if (readelfchdr(hdr, n, &ch, fp) < 0 || ch.size > INT64_MAX)
+		return -1;
+
+	if (buf == NULL || len < ch.size)
+		return ch.size;
+
+	/* A mapping is decompressed in place, on up to nthread threads */
+	if (fp->map != NULL) {
+		sect = mapelfshdrsection(fp, sh);
+		if (sect == NULL || unpackto(&ch, (uint8_t*)sect + n, sh->size - n, buf, nthread) < 0)
+			return -1;
+		return ch.size;
+	}
+
+	if (openelfzstream(f, sh, &zs, fp) < 0)
+		return -1;
+
+	if (readelfzstream(&zs, buf, ch.size) != (int64_t)ch.size) {
+		closeelfzstream(&zs);
+		return -1;
+	}
+
+	closeelfzstream(&zs);
+
+	return ch.size;
+}
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Offsets in struct elf_prstatus
+ */
+enum {
+	Prsigno		= 0,
+	Prcursig	= 12,
+	Pr32pid		= 24,
+	Pr32reg		= 72,
+	Pr64pid		= 32,
+	Pr64reg		= 112,
+};
+
+/*
+ * Get a long of the class of the core
+ */
+static uint64_t
+getlong(uint8_t *p, Fhdr *fp)
+{
+	uint32_t v32;
+	uint64_t v;
+
+	if (fp->class == ELFCLASS32) {
+		fp->get32(p, &v32);
+		return v32;
+	}
+
+	fp->get64(p, &v);
+
+	return v;
+}
+
+/*
+ * Add a thread from a NT_PRSTATUS note
+ */
+static int
+coreprstatus(Core *c, Note *n)
+{
+	uint32_t pid, reg, tail, signo;
+	uint16_t cursig;
+	Prstatus *t, *threads;
+	Fhdr *fp;
+	uint8_t *p;
+
+	fp = &c->fh;
+
+	if (fp->class == ELFCLASS32) {
+		pid = Pr32pid;
+		reg = Pr32reg;
+		tail = 4;
+	} else {
+		pid = Pr64pid;
+		reg = Pr64reg;
+		tail = 8;
+	}
+
+	/* pr_fpvalid and padding follow the registers */
+	if (n->descsz < reg + tail)
+		return -1;
+
+	/* Grow by doubling */
+	if ((c->nthread & (c->nthread - 1)) == 0) {
+		threads = realloc(c->threads, (c->nthread ? 2 * c->nthread : 1) * sizeof(c->threads[0]));
+		if (threads == NULL)
+			return -1;
+		c->threads = threads;
+	}
+
+	t = &c->threads[c->nthread++];
+	memset(t, 0, sizeof(*t));
+
+	fp->get32(n->desc + Prsigno, &signo);
+	fp->get16(n->desc + Prcursig, &cursig);
+	t->signo = signo;
+	t->cursig = cursig;
+
+	p = n->desc + pid;
+	p += fp->get32(p, &t->pid);
+	p += fp->get32(p, &t->ppid);
+	p += fp->get32(p, &t->pgrp);
+	fp->get32(p, &t->sid);
+
+	t->regs = n->desc + reg;
+	t->regsize = n->descsz - reg - tail;
+
+	return 0;
+}
+
+/*
+ * Read the NT_FILE table of mapped files: a count, a page size, the
+ * start, end and page offset of each mapping, then their names
+ */
+static int
+corefiles(Core *c, Note *n)
+{
+	uint64_t count, pagesz, i, w;
+	uint8_t *p, *end;
+	Corefile *cf;
+	Fhdr *fp;
+	char *s;
+
+	fp = &c->fh;
+	w = fp->class == ELFCLASS32 ? 4 : 8;
+
+	if (c->files != NULL || n->descsz < 2 * w)
+		return -1;
+
+	p = n->desc;
+	end = n->desc + n->descsz;
+
+	count = getlong(p, fp);
+	pagesz = getlong(p + w, fp);
+	p += 2 * w;
+
+	if (count > (uint64_t)(end - p) / (3 * w))
+		return -1;
+
+	c->files = calloc(count + 1, sizeof(c->files[0]));
+	if (c->files == NULL)
+		return -1;
+
+	s = (char*)p + count * 3 * w;
+	for (i = 0; i < count; i++, p += 3 * w) {
+		cf = &c->files[i];
+		cf->start = getlong(p, fp);
+		cf->end = getlong(p + w, fp);
+		cf->offset = getlong(p + 2 * w, fp) * pagesz;
+
+		/* Names are NUL-terminated, in the order of the table */
+		cf->name = s;
+		s = memchr(s, '\0', (char*)end - s);
+		if (s == NULL)
+			return -1;
+		s++;
+	}
+	c->nfile = count;
+
+	return 0;
+}
+
+/*
+ * Read the NT_AUXV auxiliary vector, up to its AT_NULL entry
+ */
+static int
+coreauxv(Core *c, Note *n)
+{
+	uint64_t i, max, w;
+	Fhdr *fp;
+
+	fp = &c->fh;
+	w = fp->class == ELFCLASS32 ? 4 : 8;
+
+	if (c->auxv != NULL)
+		return -1;
+
+	max = n->descsz / (2 * w);
+
+	c->auxv = malloc((max + 1) * 2 * sizeof(c->auxv[0]));
+	if (c->auxv == NULL)
+		return -1;
+
+	for (i = 0; i < max; i++) {
+		c->auxv[2*i] = getlong(n->desc + 2*i*w, fp);
+		c->auxv[2*i+1] = getlong(n->desc + (2*i+1)*w, fp);
+		if (c->auxv[2*i] == 0)
+			break;
+	}
+	c->nauxv = i;
+
+	return 0;
+}
+
+static int
+corenote(void *arg, Note *n)
+{
+	Core *c;
+
+	c = arg;
+
+	/* Extended register sets, named LINUX, are left to the caller */
+	if (n->namesz != 5 || strcmp(n->name, "CORE") != 0)
+		return 0;
+
+	switch (n->type) {
+	case NT_PRSTATUS:
+		return coreprstatus(c, n);
+	case NT_PRFPREG:
+		/* Floating-point registers follow the thread they belong to */
+		if (c->nthread > 0) {
+			c->threads[c->nthread-1].fpregs = n->desc;
+			c->threads[c->nthread-1].fpregsize = n->descsz;
+		}
+		return 0;
+	case NT_FILE:
+		return corefiles(c, n);
+	case NT_AUXV:
+		return coreauxv(c, n);
+	}
+
+	return 0;
+}
+
+/*
+ * Open a core file. The core is mapped and its memory is read on
+ * demand, so even cores much larger than memory cost only the pages
+ * touched. The notes of the threads, the mapped files and the
+ * auxiliary vector are indexed, pointing into the mapping.
+ */
+int
+openelfcore(char *path, int flags, Core *c)
+{
+	memset(c, 0, sizeof(*c));
+
+	if (openelfmap(path, flags, &c->fh) < 0)
+		return -1;
+
+	if (c->fh.type != ET_CORE) {
+		fprintf(stderr, "%s: not a core file\n", path);
+		freeelf(&c->fh);
+		return -1;
+	}
+
+	if (readelfnotes(NULL, &c->fh, corenote, c) != 0) {
+		freeelfcore(c);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the number of bytes of the file behind a segment, fewer than
+ * its file size in a truncated core
+ */
+static uint64_t
+corefilesz(Fhdr *fp, Phdr *ph)
+{
+	if (ph->offset >= fp->mapsize)
+		return 0;
+
+	if (ph->filesz > fp->mapsize - ph->offset)
+		return fp->mapsize - ph->offset;
+
+	return ph->filesz;
+}
+
+/*
+ * Get a view of len bytes of the process memory at addr, held by a
+ * single segment of the core, or NULL
+ */
+const uint8_t*
+mapelfcoremem(Core *c, uint64_t addr, uint64_t len)
+{
+	Phdr *ph;
+	uint64_t o;
+
+	ph = findload(&c->fh, addr, 0);
+	if (ph == NULL)
+		return NULL;
+
+	o = addr - ph->vaddr;
+	if (o >= corefilesz(&c->fh, ph) || len > corefilesz(&c->fh, ph) - o)
+		return NULL;
+
+	return c->fh.map + ph->offset + o;
+}
+
+/*
+ * Read len bytes of the process memory at addr, across adjacent
+ * segments. Memory the core doesn't hold, like file mappings left
+ * out of the dump, ends the read. Returns the number of bytes read.
+ */
+int64_t
+readelfcoremem(Core *c, uint64_t addr, void *buf, uint64_t len)
+{
+	uint64_t n, o, avail, done;
+	uint8_t *p;
+	Phdr *ph;
+
+	p = buf;
+
+	for (done = 0; done < len; done += n, addr += n) {
+		ph = findload(&c->fh, addr, 0);
+		if (ph == NULL)
+			break;
+
+		o = addr - ph->vaddr;
+		avail = corefilesz(&c->fh, ph);
+		if (o >= avail)
+			break;
+
+		n = len - done;
+		if (n > avail - o)
+			n = avail - o;
+		memmove(p + done, c->fh.map + ph->offset + o, n);
+	}
+
+	return done;
+}
+
+/*
+ * Get the mapped file holding addr, from the NT_FILE table, which
+ * lists the mappings by address
+ */
+Corefile*
+elfcorefile(Core *c, uint64_t addr)
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = c->nfile;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (c->files[mid].start <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0 || addr >= c->files[lo-1].end)
+		return NULL;
+
+	return &c->files[lo-1];
+}
+
+/*
+ * Get an entry of the auxiliary vector by type
+ */
+int
+elfcoreauxv(Core *c, uint64_t type, uint64_t *val)
+{
+	uint32_t i;
+
+	for (i = 0; i < c->nauxv; i++) {
+		if (c->auxv[2*i] == type) {
+			*val = c->auxv[2*i+1];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void
+freeelfcore(Core *c)
+{
+	free(c->threads);
+	c->threads = NULL;
+	c->nthread = 0;
+
+	free(c->files);
+	c->files = NULL;
+	c->nfile = 0;
+
+	free(c->auxv);
+	c->auxv = NULL;
+	c->nauxv = 0;
+
+	freeelf(&c->fh);
+}
@@ -1,6 +1,17 @@
 #define USED(x) if(x){}else{}
 #define nelem(x) (sizeof(x)/sizeof((x)[0]))
 
+/*
+ * Fixed byte order field getters, which compilers reduce to a load
+ * and, for the opposite byte order, a byte swap
+ */
+#define LE16(p) ((uint16_t)((uint16_t)(p)[0] | (uint16_t)(p)[1]<<8))
+#define LE32(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1]<<8 | (uint32_t)(p)[2]<<16 | (uint32_t)(p)[3]<<24)
+#define LE64(p) ((uint64_t)LE32(p) | (uint64_t)LE32((p)+4)<<32)
+#define BE16(p) ((uint16_t)((uint16_t)(p)[0]<<8 | (uint16_t)(p)[1]))
+#define BE32(p) ((uint32_t)(p)[0]<<24 | (uint32_t)(p)[1]<<16 | (uint32_t)(p)[2]<<8 | (uint32_t)(p)[3])
+#define BE64(p) ((uint64_t)BE32(p)<<32 | (uint64_t)BE32((p)+4))
+
 extern char *machinestr[];
 
 #define EI_NIDENT 16
@@ -12,6 +23,17 @@ enum {
 	Eh64sz = 64,
 	Sh64sz = 64,
 	Ph64sz = 56,
+	Sym32sz = 16,
+	Sym64sz = 24,
+	Ch32sz = 12,
+	Ch64sz = 24,
+	Rel32sz = 8,
+	Rela32sz = 12,
+	Rel64sz = 16,
+	Rela64sz = 24,
+	Dyn32sz = 8,
+	Dyn64sz = 16,
+	Nhdrsz = 12,
 };
 
 /*
@@ -114,6 +136,72 @@ typedef struct {
 	uint64_t	align;
 } Elf64_Phdr;
 
+/*
+ * ELF32 Symbol
+ */
+typedef struct {
+	uint32_t	name;
+	uint32_t	value;
+	uint32_t	size;
+	uint8_t		info;
+	uint8_t		other;
+	uint16_t	shndx;
+} Elf32_Sym;
+
+/*
+ * ELF64 Symbol
+ */
+typedef struct {
+	uint32_t	name;
+	uint8_t		info;
+	uint8_t		other;
+	uint16_t	shndx;
+	uint64_t	value;
+	uint64_t	size;
+} Elf64_Sym;
+
+/*
+ * ELF32 Compression Header
+ */
+typedef struct {
+	uint32_t	type;
+	uint32_t	size;
+	uint32_t	addralign;
+} Elf32_Chdr;
+
+/*
+ * ELF64 Compression Header
+ */
+typedef struct {
+	uint32_t	type;
+	uint32_t	reserved;
+	uint64_t	size;
+	uint64_t	addralign;
+} Elf64_Chdr;
+
+/*
+ * Cursor over DWARF bytes
+ */
+typedef struct {
+	uint8_t		*p;
+	uint8_t		*end;
+	struct Fhdr	*fp;
+	int		err;		/* Read past the end */
+} Dwbuf;
+
+/*
+ * Kinds of the tables kept by a handle, see findelftab
+ */
+enum {
+	Tsymtab,
+	Treltab,
+	Trels,
+	Tdynamic,
+	Tsymhash,
+	Tlines,
+	Tcfi,
+};
+
 /*
  * Object file type
  */
@@ -417,6 +505,13 @@ enum {
 	SHN_HIRESERVE	= 0xffff,
 };
 
+/*
+ * Extended Program Header number
+ */
+enum {
+	PN_XNUM		= 0xffff,
+};
+
 /*
  * Section Types
  */
@@ -438,7 +533,9 @@ enum {
 	SHT_PREINIT_ARRAY	= 16,
 	SHT_GROUP		= 17,
 	SHT_SYMTAB_SHNDX	= 18,
+	SHT_RELR		= 19,
 	SHT_LOOS		= 0x60000000,
+	SHT_GNU_HASH		= 0x6ffffff6,
 	SHT_HIOS		= 0x6fffffff,
 	SHT_LOPROC		= 0x70000000,
 	SHT_HIPROC		= 0x7fffffff,
@@ -465,6 +562,18 @@ enum {
 	SHF_MASKPROC		= 0xf0000000,
 };
 
+/*
+ * Compression Algorithms
+ */
+enum {
+	ELFCOMPRESS_ZLIB	= 1,
+	ELFCOMPRESS_ZSTD	= 2,
+	ELFCOMPRESS_LOOS	= 0x60000000,
+	ELFCOMPRESS_HIOS	= 0x6fffffff,
+	ELFCOMPRESS_LOPROC	= 0x70000000,
+	ELFCOMPRESS_HIPROC	= 0x7fffffff,
+};
+
 /*
  * Section Attribute Flags
  */
@@ -473,3 +582,407 @@ enum {
 	GRP_MASKOS	= 0x0ff00000,
 	GRP_MASKPROC	= 0xf0000000,
 };
+
+/*
+ * Symbol Binding
+ */
+enum {
+	STB_LOCAL	= 0,
+	STB_GLOBAL	= 1,
+	STB_WEAK	= 2,
+	STB_LOOS	= 10,
+	STB_HIOS	= 12,
+	STB_LOPROC	= 13,
+	STB_HIPROC	= 15,
+};
+
+/*
+ * Symbol Types
+ */
+enum {
+	STT_NOTYPE	= 0,
+	STT_OBJECT	= 1,
+	STT_FUNC	= 2,
+	STT_SECTION	= 3,
+	STT_FILE	= 4,
+	STT_COMMON	= 5,
+	STT_TLS		= 6,
+	STT_LOOS	= 10,
+	STT_GNU_IFUNC	= 10,
+	STT_HIOS	= 12,
+	STT_LOPROC	= 13,
+	STT_HIPROC	= 15,
+};
+
+/*
+ * Symbol Visibility
+ */
+enum {
+	STV_DEFAULT	= 0,
+	STV_INTERNAL	= 1,
+	STV_HIDDEN	= 2,
+	STV_PROTECTED	= 3,
+};
+
+/*
+ * Segment Types
+ */
+enum {
+	PT_NULL		= 0,
+	PT_LOAD		= 1,
+	PT_DYNAMIC	= 2,
+	PT_INTERP	= 3,
+	PT_NOTE		= 4,
+	PT_SHLIB	= 5,
+	PT_PHDR		= 6,
+	PT_TLS		= 7,
+	PT_LOOS		= 0x60000000,
+	PT_GNU_EH_FRAME	= 0x6474e550,
+	PT_GNU_STACK	= 0x6474e551,
+	PT_GNU_RELRO	= 0x6474e552,
+	PT_GNU_PROPERTY	= 0x6474e553,
+	PT_HIOS		= 0x6fffffff,
+	PT_LOPROC	= 0x70000000,
+	PT_HIPROC	= 0x7fffffff,
+};
+
+/*
+ * Segment Flags
+ */
+enum {
+	PF_X		= 0x1,
+	PF_W		= 0x2,
+	PF_R		= 0x4,
+	PF_MASKOS	= 0x0ff00000,
+	PF_MASKPROC	= 0xf0000000,
+};
+
+/*
+ * GNU Note Types
+ */
+enum {
+	NT_GNU_ABI_TAG		= 1,
+	NT_GNU_HWCAP		= 2,
+	NT_GNU_BUILD_ID		= 3,
+	NT_GNU_GOLD_VERSION	= 4,
+	NT_GNU_PROPERTY_TYPE_0	= 5,
+};
+
+/*
+ * Dynamic Array Tags
+ */
+enum {
+	DT_NULL			= 0,
+	DT_NEEDED		= 1,
+	DT_PLTRELSZ		= 2,
+	DT_PLTGOT		= 3,
+	DT_HASH			= 4,
+	DT_STRTAB		= 5,
+	DT_SYMTAB		= 6,
+	DT_RELA			= 7,
+	DT_RELASZ		= 8,
+	DT_RELAENT		= 9,
+	DT_STRSZ		= 10,
+	DT_SYMENT		= 11,
+	DT_INIT			= 12,
+	DT_FINI			= 13,
+	DT_SONAME		= 14,
+	DT_RPATH		= 15,
+	DT_SYMBOLIC		= 16,
+	DT_REL			= 17,
+	DT_RELSZ		= 18,
+	DT_RELENT		= 19,
+	DT_PLTREL		= 20,
+	DT_DEBUG		= 21,
+	DT_TEXTREL		= 22,
+	DT_JMPREL		= 23,
+	DT_BIND_NOW		= 24,
+	DT_INIT_ARRAY		= 25,
+	DT_FINI_ARRAY		= 26,
+	DT_INIT_ARRAYSZ		= 27,
+	DT_FINI_ARRAYSZ		= 28,
+	DT_RUNPATH		= 29,
+	DT_FLAGS		= 30,
+	DT_PREINIT_ARRAY	= 32,
+	DT_PREINIT_ARRAYSZ	= 33,
+	DT_SYMTAB_SHNDX		= 34,
+	DT_RELRSZ		= 35,
+	DT_RELR			= 36,
+	DT_RELRENT		= 37,
+	DT_LOOS			= 0x6000000d,
+	DT_HIOS			= 0x6ffff000,
+	DT_GNU_HASH		= 0x6ffffef5,
+	DT_VERSYM		= 0x6ffffff0,
+	DT_RELACOUNT		= 0x6ffffff9,
+	DT_RELCOUNT		= 0x6ffffffa,
+	DT_FLAGS_1		= 0x6ffffffb,
+	DT_VERDEF		= 0x6ffffffc,
+	DT_VERDEFNUM		= 0x6ffffffd,
+	DT_VERNEED		= 0x6ffffffe,
+	DT_VERNEEDNUM		= 0x6fffffff,
+	DT_LOPROC		= 0x70000000,
+	DT_HIPROC		= 0x7fffffff,
+};
+
+/*
+ * DT_FLAGS Values
+ */
+enum {
+	DF_ORIGIN	= 0x1,
+	DF_SYMBOLIC	= 0x2,
+	DF_TEXTREL	= 0x4,
+	DF_BIND_NOW	= 0x8,
+	DF_STATIC_TLS	= 0x10,
+};
+
+/*
+ * DT_FLAGS_1 Values
+ */
+enum {
+	DF_1_NOW	= 0x1,
+	DF_1_GLOBAL	= 0x2,
+	DF_1_NODELETE	= 0x8,
+	DF_1_NOOPEN	= 0x40,
+	DF_1_ORIGIN	= 0x80,
+	DF_1_NODEFLIB	= 0x800,
+	DF_1_PIE	= 0x8000000,
+};
+
+/*
+ * DWARF Line Number Standard Opcodes
+ */
+enum {
+	DW_LNS_copy			= 1,
+	DW_LNS_advance_pc		= 2,
+	DW_LNS_advance_line		= 3,
+	DW_LNS_set_file			= 4,
+	DW_LNS_set_column		= 5,
+	DW_LNS_negate_stmt		= 6,
+	DW_LNS_set_basic_block		= 7,
+	DW_LNS_const_add_pc		= 8,
+	DW_LNS_fixed_advance_pc		= 9,
+	DW_LNS_set_prologue_end		= 10,
+	DW_LNS_set_epilogue_begin	= 11,
+	DW_LNS_set_isa			= 12,
+};
+
+/*
+ * DWARF Line Number Extended Opcodes
+ */
+enum {
+	DW_LNE_end_sequence		= 1,
+	DW_LNE_set_address		= 2,
+	DW_LNE_define_file		= 3,
+	DW_LNE_set_discriminator	= 4,
+};
+
+/*
+ * DWARF Line Number Header Entry Formats
+ */
+enum {
+	DW_LNCT_path			= 1,
+	DW_LNCT_directory_index		= 2,
+	DW_LNCT_timestamp		= 3,
+	DW_LNCT_size			= 4,
+	DW_LNCT_MD5			= 5,
+};
+
+/*
+ * DWARF Attributes, the ones read
+ */
+enum {
+	DW_AT_stmt_list		= 0x10,
+};
+
+/*
+ * DWARF Unit Types
+ */
+enum {
+	DW_UT_compile		= 0x01,
+	DW_UT_type		= 0x02,
+	DW_UT_partial		= 0x03,
+	DW_UT_skeleton		= 0x04,
+	DW_UT_split_compile	= 0x05,
+	DW_UT_split_type	= 0x06,
+};
+
+/*
+ * DWARF Attribute Forms
+ */
+enum {
+	DW_FORM_addr		= 0x01,
+	DW_FORM_block2		= 0x03,
+	DW_FORM_block4		= 0x04,
+	DW_FORM_data2		= 0x05,
+	DW_FORM_data4		= 0x06,
+	DW_FORM_data8		= 0x07,
+	DW_FORM_string		= 0x08,
+	DW_FORM_block		= 0x09,
+	DW_FORM_block1		= 0x0a,
+	DW_FORM_data1		= 0x0b,
+	DW_FORM_flag		= 0x0c,
+	DW_FORM_sdata		= 0x0d,
+	DW_FORM_strp		= 0x0e,
+	DW_FORM_udata		= 0x0f,
+	DW_FORM_ref_addr	= 0x10,
+	DW_FORM_ref1		= 0x11,
+	DW_FORM_ref2		= 0x12,
+	DW_FORM_ref4		= 0x13,
+	DW_FORM_ref8		= 0x14,
+	DW_FORM_ref_udata	= 0x15,
+	DW_FORM_indirect	= 0x16,
+	DW_FORM_sec_offset	= 0x17,
+	DW_FORM_exprloc		= 0x18,
+	DW_FORM_flag_present	= 0x19,
+	DW_FORM_strx		= 0x1a,
+	DW_FORM_addrx		= 0x1b,
+	DW_FORM_ref_sup4	= 0x1c,
+	DW_FORM_strp_sup	= 0x1d,
+	DW_FORM_data16		= 0x1e,
+	DW_FORM_line_strp	= 0x1f,
+	DW_FORM_ref_sig8	= 0x20,
+	DW_FORM_implicit_const	= 0x21,
+	DW_FORM_loclistx	= 0x22,
+	DW_FORM_rnglistx	= 0x23,
+	DW_FORM_ref_sup8	= 0x24,
+	DW_FORM_strx1		= 0x25,
+	DW_FORM_strx2		= 0x26,
+	DW_FORM_strx3		= 0x27,
+	DW_FORM_strx4		= 0x28,
+	DW_FORM_addrx1		= 0x29,
+	DW_FORM_addrx2		= 0x2a,
+	DW_FORM_addrx3		= 0x2b,
+	DW_FORM_addrx4		= 0x2c,
+	DW_FORM_GNU_addr_index	= 0x1f01,
+	DW_FORM_GNU_str_index	= 0x1f02,
+	DW_FORM_GNU_ref_alt	= 0x1f20,
+	DW_FORM_GNU_strp_alt	= 0x1f21,
+};
+
+/*
+ * DWARF Call Frame Instructions
+ */
+enum {
+	DW_CFA_advance_loc		= 0x40,	/* Delta in the low 6 bits */
+	DW_CFA_offset			= 0x80,	/* Register in the low 6 bits */
+	DW_CFA_restore			= 0xc0,	/* Register in the low 6 bits */
+	DW_CFA_nop			= 0x00,
+	DW_CFA_set_loc			= 0x01,
+	DW_CFA_advance_loc1		= 0x02,
+	DW_CFA_advance_loc2		= 0x03,
+	DW_CFA_advance_loc4		= 0x04,
+	DW_CFA_offset_extended		= 0x05,
+	DW_CFA_restore_extended		= 0x06,
+	DW_CFA_undefined		= 0x07,
+	DW_CFA_same_value		= 0x08,
+	DW_CFA_register			= 0x09,
+	DW_CFA_remember_state		= 0x0a,
+	DW_CFA_restore_state		= 0x0b,
+	DW_CFA_def_cfa			= 0x0c,
+	DW_CFA_def_cfa_register		= 0x0d,
+	DW_CFA_def_cfa_offset		= 0x0e,
+	DW_CFA_def_cfa_expression	= 0x0f,
+	DW_CFA_expression		= 0x10,
+	DW_CFA_offset_extended_sf	= 0x11,
+	DW_CFA_def_cfa_sf		= 0x12,
+	DW_CFA_def_cfa_offset_sf	= 0x13,
+	DW_CFA_val_offset		= 0x14,
+	DW_CFA_val_offset_sf		= 0x15,
+	DW_CFA_val_expression		= 0x16,
+	DW_CFA_GNU_window_save		= 0x2d,	/* DW_CFA_AARCH64_negate_ra_state */
+	DW_CFA_GNU_args_size		= 0x2e,
+	DW_CFA_GNU_negative_offset_extended = 0x2f,
+};
+
+/*
+ * Exception Handling Pointer Encodings
+ */
+enum {
+	DW_EH_PE_absptr		= 0x00,
+	DW_EH_PE_uleb128	= 0x01,
+	DW_EH_PE_udata2		= 0x02,
+	DW_EH_PE_udata4		= 0x03,
+	DW_EH_PE_udata8		= 0x04,
+	DW_EH_PE_sleb128	= 0x09,
+	DW_EH_PE_sdata2		= 0x0a,
+	DW_EH_PE_sdata4		= 0x0b,
+	DW_EH_PE_sdata8		= 0x0c,
+	DW_EH_PE_pcrel		= 0x10,
+	DW_EH_PE_textrel	= 0x20,
+	DW_EH_PE_datarel	= 0x30,
+	DW_EH_PE_funcrel	= 0x40,
+	DW_EH_PE_aligned	= 0x50,
+	DW_EH_PE_indirect	= 0x80,
+	DW_EH_PE_omit		= 0xff,
+};
+
+/*
+ * DWARF Expression Operations
+ */
+enum {
+	DW_OP_addr		= 0x03,
+	DW_OP_deref		= 0x06,
+	DW_OP_const1u		= 0x08,
+	DW_OP_const1s		= 0x09,
+	DW_OP_const2u		= 0x0a,
+	DW_OP_const2s		= 0x0b,
+	DW_OP_const4u		= 0x0c,
+	DW_OP_const4s		= 0x0d,
+	DW_OP_const8u		= 0x0e,
+	DW_OP_const8s		= 0x0f,
+	DW_OP_constu		= 0x10,
+	DW_OP_consts		= 0x11,
+	DW_OP_dup		= 0x12,
+	DW_OP_drop		= 0x13,
+	DW_OP_over		= 0x14,
+	DW_OP_pick		= 0x15,
+	DW_OP_swap		= 0x16,
+	DW_OP_rot		= 0x17,
+	DW_OP_abs		= 0x19,
+	DW_OP_and		= 0x1a,
+	DW_OP_div		= 0x1b,
+	DW_OP_minus		= 0x1c,
+	DW_OP_mod		= 0x1d,
+	DW_OP_mul		= 0x1e,
+	DW_OP_neg		= 0x1f,
+	DW_OP_not		= 0x20,
+	DW_OP_or		= 0x21,
+	DW_OP_plus		= 0x22,
+	DW_OP_plus_uconst	= 0x23,
+	DW_OP_shl		= 0x24,
+	DW_OP_shr		= 0x25,
+	DW_OP_shra		= 0x26,
+	DW_OP_xor		= 0x27,
+	DW_OP_bra		= 0x28,
+	DW_OP_eq		= 0x29,
+	DW_OP_ge		= 0x2a,
+	DW_OP_gt		= 0x2b,
+	DW_OP_le		= 0x2c,
+	DW_OP_lt		= 0x2d,
+	DW_OP_ne		= 0x2e,
+	DW_OP_skip		= 0x2f,
+	DW_OP_lit0		= 0x30,
+	DW_OP_lit31		= 0x4f,
+	DW_OP_breg0		= 0x70,
+	DW_OP_breg31		= 0x8f,
+	DW_OP_bregx		= 0x92,
+	DW_OP_deref_size	= 0x94,
+	DW_OP_nop		= 0x96,
+};
+
+/*
+ * Core Note Types
+ */
+enum {
+	NT_PRSTATUS	= 1,
+	NT_PRFPREG	= 2,
+	NT_PRPSINFO	= 3,
+	NT_TASKSTRUCT	= 4,
+	NT_AUXV		= 6,
+	NT_SIGINFO	= 0x53494749,
+	NT_FILE		= 0x46494c45,
+};
+
+#define ELF_ST_BIND(i) ((i)>>4)
+#define ELF_ST_TYPE(i) ((i)&0xf)
+#define ELF_ST_VISIBILITY(o) ((o)&0x3)
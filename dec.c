@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Decoders specialized for each class and data encoding. They are
+ * generated from the same template with fixed byte order getters,
+ * so their loops contain no indirect calls. The dynamic decoders
+ * in elf.c remain as the reference.
+ */
+
+typedef struct Codec Codec;
+
+struct Codec {
+	int class;
+	int data;
+	int (*decodeelfshdrs)(uint8_t*, uint32_t, Shdr*, Fhdr*);
+	int (*decodeelfsyms)(uint8_t*, uint32_t, Symtab*);
+	void (*unpackelfsym)(uint8_t*, Sym*);
+	int (*decodeelfrels)(uint8_t*, uint32_t, int, Reltab*, uint32_t);
+};
+
+#define SHDRS32(fn, G32) \
+static int \
+fn(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp) \
+{ \
+	uint8_t *p; \
+	uint32_t i; \
+\
+	USED(fp); \
+	for (i = 0, p = src; i < n; i++, p += Sh32sz) { \
+		dst[i].name = G32(p); \
+		dst[i].type = G32(p + 4); \
+		dst[i].flags = G32(p + 8); \
+		dst[i].addr = G32(p + 12); \
+		dst[i].offset = G32(p + 16); \
+		dst[i].size = G32(p + 20); \
+		dst[i].link = G32(p + 24); \
+		dst[i].info = G32(p + 28); \
+		dst[i].addralign = G32(p + 32); \
+		dst[i].entsize = G32(p + 36); \
+	} \
+\
+	return 0; \
+}
+
+#define SHDRS64(fn, G32, G64) \
+static int \
+fn(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp) \
+{ \
+	uint8_t *p; \
+	uint32_t i; \
+\
+	USED(fp); \
+	for (i = 0, p = src; i < n; i++, p += Sh64sz) { \
+		dst[i].name = G32(p); \
+		dst[i].type = G32(p + 4); \
+		dst[i].flags = G64(p + 8); \
+		dst[i].addr = G64(p + 16); \
+		dst[i].offset = G64(p + 24); \
+		dst[i].size = G64(p + 32); \
+		dst[i].link = G32(p + 40); \
+		dst[i].info = G32(p + 44); \
+		dst[i].addralign = G64(p + 48); \
+		dst[i].entsize = G64(p + 56); \
+	} \
+\
+	return 0; \
+}
+
+#define SYMS32(fn, G16, G32) \
+static int \
+fn(uint8_t *src, uint32_t n, Symtab *st) \
+{ \
+	uint8_t *p; \
+	uint32_t i; \
+\
+	for (i = 0, p = src; i < n; i++, p += Sym32sz) { \
+		st->name[i] = G32(p); \
+		st->value[i] = G32(p + 4); \
+		st->size[i] = G32(p + 8); \
+		st->info[i] = p[12]; \
+		st->other[i] = p[13]; \
+		st->shndx[i] = G16(p + 14); \
+	} \
+\
+	return 0; \
+}
+
+#define SYMS64(fn, G16, G32, G64) \
+static int \
+fn(uint8_t *src, uint32_t n, Symtab *st) \
+{ \
+	uint8_t *p; \
+	uint32_t i; \
+\
+	for (i = 0, p = src; i < n; i++, p += Sym64sz) { \
+		st->name[i] = G32(p); \
+		st->info[i] = p[4]; \
+		st->other[i] = p[5]; \
+		st->shndx[i] = G16(p + 6); \
+		st->value[i] = G64(p + 8); \
+		st->size[i] = G64(p + 16); \
+	} \
+\
+	return 0; \
+}
+
+#define SYM32(fn, G16, G32) \
+static void \
+fn(uint8_t *p, Sym *s) \
+{ \
+	s->name = G32(p); \
+	s->value = G32(p + 4); \
+	s->size = G32(p + 8); \
+	s->info = p[12]; \
+	s->other = p[13]; \
+	s->shndx = G16(p + 14); \
+}
+
+#define SYM64(fn, G16, G32, G64) \
+static void \
+fn(uint8_t *p, Sym *s) \
+{ \
+	s->name = G32(p); \
+	s->info = p[4]; \
+	s->other = p[5]; \
+	s->shndx = G16(p + 6); \
+	s->value = G64(p + 8); \
+	s->size = G64(p + 16); \
+}
+
+#define RELS32(fn, G32) \
+static int \
+fn(uint8_t *src, uint32_t n, int rela, Reltab *rt, uint32_t at) \
+{ \
+	uint32_t i, info, sz; \
+	uint8_t *p; \
+\
+	sz = rela ? Rela32sz : Rel32sz; \
+	for (i = 0, p = src; i < n; i++, p += sz) { \
+		info = G32(p + 4); \
+		rt->offset[at+i] = G32(p); \
+		rt->sym[at+i] = info >> 8; \
+		rt->type[at+i] = info & 0xff; \
+		rt->addend[at+i] = rela ? (int32_t)G32(p + 8) : 0; \
+	} \
+\
+	return 0; \
+}
+
+#define RELS64(fn, G64) \
+static int \
+fn(uint8_t *src, uint32_t n, int rela, Reltab *rt, uint32_t at) \
+{ \
+	uint32_t i, sz; \
+	uint64_t info; \
+	uint8_t *p; \
+\
+	sz = rela ? Rela64sz : Rel64sz; \
+	for (i = 0, p = src; i < n; i++, p += sz) { \
+		info = G64(p + 8); \
+		rt->offset[at+i] = G64(p); \
+		rt->sym[at+i] = info >> 32; \
+		rt->type[at+i] = info & 0xffffffff; \
+		rt->addend[at+i] = rela ? (int64_t)G64(p + 16) : 0; \
+	} \
+\
+	return 0; \
+}
+
+SHDRS32(decodeelf32lshdrs, LE32)
+SHDRS32(decodeelf32bshdrs, BE32)
+SHDRS64(decodeelf64lshdrs, LE32, LE64)
+SHDRS64(decodeelf64bshdrs, BE32, BE64)
+
+SYMS32(decodeelf32lsyms, LE16, LE32)
+SYMS32(decodeelf32bsyms, BE16, BE32)
+SYMS64(decodeelf64lsyms, LE16, LE32, LE64)
+SYMS64(decodeelf64bsyms, BE16, BE32, BE64)
+
+SYM32(unpackelf32lsym, LE16, LE32)
+SYM32(unpackelf32bsym, BE16, BE32)
+SYM64(unpackelf64lsym, LE16, LE32, LE64)
+SYM64(unpackelf64bsym, BE16, BE32, BE64)
+
+RELS32(decodeelf32lrels, LE32)
+RELS32(decodeelf32brels, BE32)
+RELS64(decodeelf64lrels, LE64)
+RELS64(decodeelf64brels, BE64)
+
+static Codec codec[] = {
+	{
+		ELFCLASS32,
+		ELFDATA2LSB,
+		decodeelf32lshdrs,
+		decodeelf32lsyms,
+		unpackelf32lsym,
+		decodeelf32lrels,
+	},
+	{
+		ELFCLASS32,
+		ELFDATA2MSB,
+		decodeelf32bshdrs,
+		decodeelf32bsyms,
+		unpackelf32bsym,
+		decodeelf32brels,
+	},
+	{
+		ELFCLASS64,
+		ELFDATA2LSB,
+		decodeelf64lshdrs,
+		decodeelf64lsyms,
+		unpackelf64lsym,
+		decodeelf64lrels,
+	},
+	{
+		ELFCLASS64,
+		ELFDATA2MSB,
+		decodeelf64bshdrs,
+		decodeelf64bsyms,
+		unpackelf64bsym,
+		decodeelf64brels,
+	},
+};
+
+/*
+ * Select the decoders specialized for the class and data encoding
+ */
+int
+selectcodec(Fhdr *fp)
+{
+	unsigned int i;
+
+	for (i = 0; i < nelem(codec); i++) {
+		if (codec[i].class != fp->class || codec[i].data != fp->data)
+			continue;
+		fp->decodeelfsyms = codec[i].decodeelfsyms;
+		fp->unpackelfsym = codec[i].unpackelfsym;
+		fp->decodeelfrels = codec[i].decodeelfrels;
+		/* A native ELF64 table is best copied as is */
+		if (fp->class == ELFCLASS64 && fp->data == hostdata())
+			return 0;
+		fp->decodeelfshdrs = codec[i].decodeelfshdrs;
+		return 0;
+	}
+
+	return -1;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Read a value of n bytes, in the byte order of the file
+ */
+uint64_t
+getdwfixed(Dwbuf *b, int n)
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	if (n > b->end - b->p) {
+		b->err = 1;
+		b->p = b->end;
+		return 0;
+	}
+
+	switch (n) {
+	case 1:
+		v64 = *b->p;
+		break;
+	case 2:
+		b->fp->get16(b->p, &v16);
+		v64 = v16;
+		break;
+	case 4:
+		b->fp->get32(b->p, &v32);
+		v64 = v32;
+		break;
+	case 8:
+		b->fp->get64(b->p, &v64);
+		break;
+	default:
+		v64 = 0;
+		break;
+	}
+	b->p += n;
+
+	return v64;
+}
+
+/*
+ * Read an unsigned LEB128 value
+ */
+uint64_t
+getdwuleb(Dwbuf *b)
+{
+	uint64_t v;
+	uint8_t c;
+	int shift;
+
+	v = 0;
+	shift = 0;
+	do {
+		if (b->p >= b->end) {
+			b->err = 1;
+			return 0;
+		}
+		c = *b->p++;
+		if (shift < 64)
+			v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	return v;
+}
+
+/*
+ * Read a signed LEB128 value
+ */
+int64_t
+getdwsleb(Dwbuf *b)
+{
+	uint64_t v;
+	uint8_t c;
+	int shift;
+
+	v = 0;
+	shift = 0;
+	do {
+		if (b->p >= b->end) {
+			b->err = 1;
+			return 0;
+		}
+		c = *b->p++;
+		if (shift < 64)
+			v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	if (shift < 64 && (c & 0x40))
+		v |= ~(uint64_t)0 << shift;
+
+	return (int64_t)v;
+}
+
+/*
+ * Read a NUL-terminated string in place
+ */
+char*
+getdwcstr(Dwbuf *b)
+{
+	uint8_t *q;
+	char *s;
+
+	q = memchr(b->p, '\0', b->end - b->p);
+	if (q == NULL) {
+		b->err = 1;
+		b->p = b->end;
+		return NULL;
+	}
+
+	s = (char*)b->p;
+	b->p = q + 1;
+
+	return s;
+}
+
+/*
+ * Read the length of a unit, and the size of its offsets. Returns
+ * the end of the unit, or NULL.
+ */
+uint8_t*
+getdwunitlen(Dwbuf *b, uint8_t *offsz)
+{
+	uint64_t len;
+
+	*offsz = 4;
+	len = getdwfixed(b, 4);
+	if (len == 0xffffffff) {
+		*offsz = 8;
+		len = getdwfixed(b, 8);
+	} else if (len >= 0xfffffff0) {
+		return NULL;
+	}
+
+	if (b->err || len > (uint64_t)(b->end - b->p))
+		return NULL;
+
+	return b->p + len;
+}
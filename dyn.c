@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Get the bytes of the dynamic section, from the Section Header
+ * Table or from the PT_DYNAMIC segment of a file without one, and
+ * the Section Header of its String Table. The segment names it by
+ * address, in DT_STRTAB and DT_STRSZ.
+ */
+static uint8_t*
+getdynamic(FILE *f, Shdr *sh, Shdr *str, Fhdr *fp, int *mapped)
+{
+	Shdr *s;
+	Phdr *ph;
+
+	memset(sh, 0, sizeof(*sh));
+	memset(str, 0, sizeof(*str));
+
+	if (fp->shdrs != NULL) {
+		s = elfshdrtype(fp, SHT_DYNAMIC, NULL);
+		if (s == NULL)
+			return NULL;
+		*sh = *s;
+		s = elfshdr(fp, sh->link);
+		if (s == NULL || s->type != SHT_STRTAB)
+			return NULL;
+		*str = *s;
+		return getsection(f, sh, fp, mapped);
+	}
+
+	ph = elfphdrtype(fp, PT_DYNAMIC, NULL);
+	if (ph == NULL)
+		return NULL;
+
+	sh->type = SHT_DYNAMIC;
+	sh->offset = ph->offset;
+	sh->size = ph->filesz;
+	str->type = SHT_STRTAB;
+
+	return getsection(f, sh, fp, mapped);
+}
+
+/*
+ * Get a string of the Dynamic String Table
+ */
+static char*
+dynstr(Dynamic *d, uint64_t i)
+{
+	if (i >= d->strtabsize)
+		return NULL;
+
+	return (char*)d->strtab + i;
+}
+
+/*
+ * Decode the dynamic section
+ */
+static int
+readdynamic(FILE *f, Dynamic *d, Fhdr *fp)
+{
+	uint64_t entsize, n, i, strtab, strsz;
+	uint32_t tag32, val32;
+	Shdr sh, str;
+	uint8_t *sect, *p;
+	int mapped;
+	Dyn *e;
+
+	memset(d, 0, sizeof(*d));
+
+	sect = getdynamic(f, &sh, &str, fp, &mapped);
+	if (sect == NULL) {
+		fprintf(stderr, "dynamic section not found\n");
+		return -1;
+	}
+
+	entsize = fp->class == ELFCLASS32 ? Dyn32sz : Dyn64sz;
+	n = sh.size / entsize;
+
+	d->dyn = elfalloc(fp, (n + 1) * sizeof(d->dyn[0]));
+	if (d->dyn == NULL) {
+		putsection(sect, mapped);
+		return -1;
+	}
+
+	strtab = 0;
+	strsz = 0;
+	for (i = 0, p = sect; i < n; i++, p += entsize) {
+		e = &d->dyn[i];
+		if (fp->class == ELFCLASS32) {
+			fp->get32(p, &tag32);
+			fp->get32(p + 4, &val32);
+			e->tag = (int32_t)tag32;
+			e->val = val32;
+		} else {
+			fp->get64(p, (uint64_t*)&e->tag);
+			fp->get64(p + 8, &e->val);
+		}
+		if (e->tag == DT_NULL)
+			break;
+		if (e->tag == DT_STRTAB)
+			strtab = e->val;
+		if (e->tag == DT_STRSZ)
+			strsz = e->val;
+	}
+	d->ndyn = i;
+
+	putsection(sect, mapped);
+
+	/* The segment locates the String Table by address */
+	if (fp->shdrs == NULL) {
+		if (strtab == 0 || elfvaddroff(fp, strtab, &str.offset) < 0) {
+			fprintf(stderr, "missing dynamic string table\n");
+			goto err;
+		}
+		str.size = strsz;
+	}
+
+	if (str.size == 0)
+		goto err;
+
+	d->strtab = keepsection(f, &str, fp);
+	if (d->strtab == NULL)
+		goto err;
+	d->strtabsize = str.size;
+
+	/* Names are used in place, the table must be terminated */
+	if (d->strtab[d->strtabsize - 1] != '\0')
+		goto err;
+
+	d->needed = elfalloc(fp, (d->ndyn + 1) * sizeof(d->needed[0]));
+	if (d->needed == NULL)
+		goto err;
+
+	for (i = 0; i < d->ndyn; i++) {
+		e = &d->dyn[i];
+		switch (e->tag) {
+		case DT_NEEDED:
+			d->needed[d->nneeded] = dynstr(d, e->val);
+			if (d->needed[d->nneeded] == NULL)
+				goto err;
+			d->nneeded++;
+			break;
+		case DT_SONAME:
+			d->soname = dynstr(d, e->val);
+			break;
+		case DT_RPATH:
+			d->rpath = dynstr(d, e->val);
+			break;
+		case DT_RUNPATH:
+			d->runpath = dynstr(d, e->val);
+			break;
+		case DT_FLAGS:
+			d->flags = e->val;
+			break;
+		case DT_FLAGS_1:
+			d->flags1 = e->val;
+			break;
+		}
+	}
+
+	return 0;
+
+err:
+	freeelfdynamic(d);
+	return -1;
+}
+
+/*
+ * Read the dynamic section, from .dynamic or from the PT_DYNAMIC
+ * segment, with the names it refers to, once: the handle keeps it for
+ * the reads that follow. The entries and names are allocated from the
+ * arena of the handle, and live as long as it.
+ */
+int
+readelfdynamic(FILE *f, Dynamic *d, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Tdynamic, 0, 0, d, sizeof(*d));
+	if (r <= 0)
+		return r;
+
+	r = readdynamic(f, d, fp);
+
+	return keepelftab(fp, Tdynamic, 0, 0, r, d, sizeof(*d));
+}
+
+/*
+ * Get the first entry of the dynamic section with a tag
+ */
+Dyn*
+elfdyntag(Dynamic *d, int64_t tag)
+{
+	uint32_t i;
+
+	for (i = 0; i < d->ndyn; i++) {
+		if (d->dyn[i].tag == tag)
+			return &d->dyn[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Forget a dynamic section, whose memory goes with the arena
+ */
+void
+freeelfdynamic(Dynamic *d)
+{
+	memset(d, 0, sizeof(*d));
+}
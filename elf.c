@@ -2,14 +2,22 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "bele.h"
 #include "elf.h"
 #include "dat.h"
 #include "fns.h"
 
-static int verbose;
+enum {
+	Hugesz = 2*1024*1024,	/* Smallest mapping worth huge pages */
+	Maxread = 1<<30,	/* Largest single read */
+};
 
 typedef struct Data Data;
 typedef struct Class Class;
@@ -30,20 +38,29 @@ struct Class {
 	int shentsize;
 	int phentsize;
 	int (*readelfehdr)(FILE*, Fhdr*);
-	int (*readelfshdr)(FILE*, Fhdr*);
-	int (*readelfphdr)(FILE*, Fhdr*);
+	int (*readelfshdr)(uint8_t*, Fhdr*);
+	int (*readelfphdr)(uint8_t*, Fhdr*);
 	int (*readelfstrndx)(FILE*, Fhdr*);
+	int (*unpackelfshdr)(uint8_t*, int, Shdr*, Fhdr*);
+	int (*decodeelfshdrs)(uint8_t*, uint32_t, Shdr*, Fhdr*);
+	int (*unpackelfphdr)(uint8_t*, int, Phdr*, Fhdr*);
 };
 
 static int readelf32ehdr(FILE*, Fhdr*);
-static int readelf32shdr(FILE*, Fhdr*);
-static int readelf32phdr(FILE*, Fhdr*);
+static int readelf32shdr(uint8_t*, Fhdr*);
+static int readelf32phdr(uint8_t*, Fhdr*);
 static int readelf32strndx(FILE*, Fhdr*);
+static int widenelf32shdr(uint8_t*, int, Shdr*, Fhdr*);
+static int decodeelf32shdrs(uint8_t*, uint32_t, Shdr*, Fhdr*);
+static int widenelf32phdr(uint8_t*, int, Phdr*, Fhdr*);
 
 static int readelf64ehdr(FILE*, Fhdr*);
-static int readelf64shdr(FILE*, Fhdr*);
-static int readelf64phdr(FILE*, Fhdr*);
+static int readelf64shdr(uint8_t*, Fhdr*);
+static int readelf64phdr(uint8_t*, Fhdr*);
 static int readelf64strndx(FILE*, Fhdr*);
+static int widenelf64shdr(uint8_t*, int, Shdr*, Fhdr*);
+static int decodeelf64shdrs(uint8_t*, uint32_t, Shdr*, Fhdr*);
+static int widenelf64phdr(uint8_t*, int, Phdr*, Fhdr*);
 
 static Data data[] = {
 	{
@@ -83,6 +100,9 @@ static Class class[] = {
 		NULL,
 		NULL,
 		NULL,
+		NULL,
+		NULL,
+		NULL,
 	},
 	{
 		ELFCLASS32,
@@ -94,6 +114,9 @@ static Class class[] = {
 		readelf32shdr,
 		readelf32phdr,
 		readelf32strndx,
+		widenelf32shdr,
+		decodeelf32shdrs,
+		widenelf32phdr,
 	},
 	{
 		ELFCLASS64,
@@ -105,9 +128,72 @@ static Class class[] = {
 		readelf64shdr,
 		readelf64phdr,
 		readelf64strndx,
+		widenelf64shdr,
+		decodeelf64shdrs,
+		widenelf64phdr,
 	}
 };
 
+/*
+ * Field widths of the ELF64 records, for bulk byte swapping
+ */
+static uint8_t sh64widths[] = { 4, 4, 8, 8, 8, 8, 4, 4, 8, 8, 0 };
+
+/*
+ * Read len bytes at offset off from a stream without a descriptor,
+ * holding its lock between the seek and the read
+ */
+static int
+readstream(FILE *f, void *buf, uint64_t len, uint64_t off)
+{
+	int r;
+
+	flockfile(f);
+	r = fseeko(f, off, SEEK_SET) < 0 || fread(buf, len, 1, f) != 1 ? -1 : 0;
+	funlockfile(f);
+
+	return r;
+}
+
+/*
+ * Read len bytes at offset off, from the mapping when there is one,
+ * or through the reader of the handle
+ */
+int
+readat(FILE *f, Fhdr *fp, void *buf, uint64_t len, uint64_t off)
+{
+	uint8_t *p;
+	ssize_t n;
+	int fd;
+
+	if (fp->map != NULL) {
+		if (off > fp->mapsize || len > fp->mapsize - off)
+			return -1;
+		memmove(buf, fp->map + off, len);
+		return 0;
+	}
+
+	if (fp->readat != NULL)
+		return fp->readat(fp->aux, off, len, buf);
+
+	/* Positional reads leave the stream position alone */
+	fd = fileno(f);
+	if (fd < 0)
+		return readstream(f, buf, len, off);
+
+	for (p = buf; len > 0; p += n, len -= n, off += n) {
+		n = pread(fd, p, len < Maxread ? len : Maxread, off);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 /*
  * Read ELF32 Header
  */
@@ -120,10 +206,7 @@ readelf32ehdr(FILE *f, Fhdr *fp)
 
 	p = buf;
 
-	if (fseek(f, 0, SEEK_SET) < 0)
-		return -1;
-
-	if (fread(p, fp->ehsize, 1, f) != 1)
+	if (readat(f, fp, p, fp->ehsize, 0) < 0)
 		return -1;
 
 	memmove(&e.ident, p, sizeof(e.ident));
@@ -142,7 +225,7 @@ readelf32ehdr(FILE *f, Fhdr *fp)
 	p += fp->get16(p, &e.shnum);
 	p += fp->get16(p, &e.shstrndx);
 
-	if (verbose)
+	if (fp->verbose)
 		printelf32ehdr(&e, fp);
 
 	if (e.type != ET_REL && e.type != ET_EXEC && e.type != ET_DYN && e.type != ET_CORE) {
@@ -155,13 +238,13 @@ readelf32ehdr(FILE *f, Fhdr *fp)
 		return -1;
 	}
 
-	if (fp->shentsize != e.shentsize) {
-		fprintf(stderr, "shentsize mismatch; want %u; got %u\n", fp->ehsize, e.ehsize);
+	if (e.shoff != 0 && fp->shentsize != e.shentsize) {
+		fprintf(stderr, "shentsize mismatch; want %u; got %u\n", fp->shentsize, e.shentsize);
 		return -1;
 	}
 
-	if (fp->phentsize != e.phentsize) {
-		fprintf(stderr, "phentsize mismatch; want %u; got %u\n", fp->ehsize, e.ehsize);
+	if (e.phnum != 0 && fp->phentsize != e.phentsize) {
+		fprintf(stderr, "phentsize mismatch; want %u; got %u\n", fp->phentsize, e.phentsize);
 		return -1;
 	}
 
@@ -191,10 +274,7 @@ readelf64ehdr(FILE *f, Fhdr *fp)
 
 	p = buf;
 
-	if (fseek(f, 0, SEEK_SET) < 0)
-		return -1;
-
-	if (fread(p, fp->ehsize , 1, f) != 1)
+	if (readat(f, fp, p, fp->ehsize, 0) < 0)
 		return -1;
 
 	memmove(&e.ident, p, sizeof(e.ident));
@@ -213,7 +293,7 @@ readelf64ehdr(FILE *f, Fhdr *fp)
 	p += fp->get16(p, &e.shnum);
 	p += fp->get16(p, &e.shstrndx);
 
-	if (verbose)
+	if (fp->verbose)
 		printelf64ehdr(&e, fp);
 
 	if (e.type != ET_REL && e.type != ET_EXEC && e.type != ET_DYN && e.type != ET_CORE) {
@@ -226,13 +306,13 @@ readelf64ehdr(FILE *f, Fhdr *fp)
 		return -1;
 	}
 
-	if (fp->shentsize != e.shentsize) {
-		fprintf(stderr, "shentsize mismatch; want %u; got %u\n", fp->ehsize, e.ehsize);
+	if (e.shoff != 0 && fp->shentsize != e.shentsize) {
+		fprintf(stderr, "shentsize mismatch; want %u; got %u\n", fp->shentsize, e.shentsize);
 		return -1;
 	}
 
-	if (fp->phentsize != e.phentsize) {
-		fprintf(stderr, "phentsize mismatch; want %u; got %u\n", fp->ehsize, e.ehsize);
+	if (e.phnum != 0 && fp->phentsize != e.phentsize) {
+		fprintf(stderr, "phentsize mismatch; want %u; got %u\n", fp->phentsize, e.phentsize);
 		return -1;
 	}
 
@@ -281,22 +361,19 @@ unpackelf32shdr(uint8_t *buf, int len, Elf32_Shdr *sh, Fhdr *fp)
  * Read ELF32 Section Header
  */
 static int
-readelf32shdr(FILE *f, Fhdr *fp)
+readelf32shdr(uint8_t *buf, Fhdr *fp)
 {
-	uint8_t buf[Sh32sz];
 	Elf32_Shdr sh;
 
-	if (fread(buf, fp->shentsize, 1, f) != 1)
-		return -1;
-
-	if (unpackelf32shdr(buf, sizeof(buf), &sh, fp) < 0)
+	if (unpackelf32shdr(buf, fp->shentsize, &sh, fp) < 0)
 		return -1;
 
 	fp->name = sh.name;
+	fp->flags = sh.flags;
 	fp->offset = sh.offset;
 	fp->size = sh.size;
 
-	if (verbose)
+	if (fp->verbose)
 		printelf32shdr(&sh, fp);
 
 	return 0;
@@ -331,18 +408,14 @@ unpackelf32phdr(uint8_t *buf, int len, Elf32_Phdr *ph, Fhdr *fp)
  * Read ELF32 Program Header
  */
 static int
-readelf32phdr(FILE *f, Fhdr *fp)
+readelf32phdr(uint8_t *buf, Fhdr *fp)
 {
-	uint8_t buf[Ph32sz];
 	Elf32_Phdr ph;
 
-	if (fread(buf, fp->phentsize, 1, f) != 1)
-		return -1;
-
-	if (unpackelf32phdr(buf, sizeof(buf), &ph, fp) < 0)
+	if (unpackelf32phdr(buf, fp->phentsize, &ph, fp) < 0)
 		return -1;
 
-	if (verbose)
+	if (fp->verbose)
 		printelf32phdr(&ph, fp);
 
 	return 0;
@@ -379,22 +452,19 @@ unpackelf64shdr(uint8_t *buf, int len, Elf64_Shdr *sh, Fhdr *fp)
  * Read ELF64 Section Header
  */
 static int
-readelf64shdr(FILE *f, Fhdr *fp)
+readelf64shdr(uint8_t *buf, Fhdr *fp)
 {
-	uint8_t buf[Sh64sz];
 	Elf64_Shdr sh;
 
-	if (fread(buf, fp->shentsize, 1, f) != 1)
-		return -1;
-
-	if (unpackelf64shdr(buf, sizeof(buf), &sh, fp) < 0)
+	if (unpackelf64shdr(buf, fp->shentsize, &sh, fp) < 0)
 		return -1;
 
 	fp->name = sh.name;
+	fp->flags = sh.flags;
 	fp->offset = sh.offset;
 	fp->size = sh.size;
 
-	if (verbose)
+	if (fp->verbose)
 		printelf64shdr(&sh, fp);
 
 	return 0;
@@ -429,23 +499,196 @@ unpackelf64phdr(uint8_t *buf, int len, Elf64_Phdr *ph, Fhdr *fp)
  * Read ELF64 Program Header
  */
 static int
-readelf64phdr(FILE *f, Fhdr *fp)
+readelf64phdr(uint8_t *buf, Fhdr *fp)
 {
-	uint8_t buf[Ph64sz];
 	Elf64_Phdr ph;
 
-	if (fread(buf, fp->phentsize, 1, f) != 1)
+	if (unpackelf64phdr(buf, fp->phentsize, &ph, fp) < 0)
 		return -1;
 
-	if (unpackelf64phdr(buf, sizeof(buf), &ph, fp) < 0)
+	if (fp->verbose)
+		printelf64phdr(&ph, fp);
+
+	return 0;
+}
+
+/*
+ * Unpack ELF32 Section Header into a portable Section Header
+ */
+static int
+widenelf32shdr(uint8_t *buf, int len, Shdr *s, Fhdr *fp)
+{
+	Elf32_Shdr sh;
+	int n;
+
+	n = unpackelf32shdr(buf, len, &sh, fp);
+	if (n < 0)
 		return -1;
 
-	if (verbose)
-		printelf64phdr(&ph, fp);
+	s->name = sh.name;
+	s->type = sh.type;
+	s->flags = sh.flags;
+	s->addr = sh.addr;
+	s->offset = sh.offset;
+	s->size = sh.size;
+	s->link = sh.link;
+	s->info = sh.info;
+	s->addralign = sh.addralign;
+	s->entsize = sh.entsize;
+
+	return n;
+}
+
+/*
+ * Unpack ELF64 Section Header into a portable Section Header
+ */
+static int
+widenelf64shdr(uint8_t *buf, int len, Shdr *s, Fhdr *fp)
+{
+	Elf64_Shdr sh;
+	int n;
+
+	n = unpackelf64shdr(buf, len, &sh, fp);
+	if (n < 0)
+		return -1;
+
+	s->name = sh.name;
+	s->type = sh.type;
+	s->flags = sh.flags;
+	s->addr = sh.addr;
+	s->offset = sh.offset;
+	s->size = sh.size;
+	s->link = sh.link;
+	s->info = sh.info;
+	s->addralign = sh.addralign;
+	s->entsize = sh.entsize;
+
+	return n;
+}
+
+/*
+ * Unpack ELF32 Program Header into a portable Program Header
+ */
+static int
+widenelf32phdr(uint8_t *buf, int len, Phdr *p, Fhdr *fp)
+{
+	Elf32_Phdr ph;
+	int n;
+
+	n = unpackelf32phdr(buf, len, &ph, fp);
+	if (n < 0)
+		return -1;
+
+	p->type = ph.type;
+	p->flags = ph.flags;
+	p->offset = ph.offset;
+	p->vaddr = ph.vaddr;
+	p->paddr = ph.paddr;
+	p->filesz = ph.filesz;
+	p->memsz = ph.memsz;
+	p->align = ph.align;
+
+	return n;
+}
+
+/*
+ * Unpack ELF64 Program Header into a portable Program Header
+ */
+static int
+widenelf64phdr(uint8_t *buf, int len, Phdr *p, Fhdr *fp)
+{
+	Elf64_Phdr ph;
+	int n;
+
+	n = unpackelf64phdr(buf, len, &ph, fp);
+	if (n < 0)
+		return -1;
+
+	p->type = ph.type;
+	p->flags = ph.flags;
+	p->offset = ph.offset;
+	p->vaddr = ph.vaddr;
+	p->paddr = ph.paddr;
+	p->filesz = ph.filesz;
+	p->memsz = ph.memsz;
+	p->align = ph.align;
+
+	return n;
+}
+
+/*
+ * Decode an ELF32 Section Header Table into portable Section Headers
+ */
+static int
+decodeelf32shdrs(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp)
+{
+	Elf32_Shdr tmp[64];
+	uint32_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < nelem(tmp) ? n - i : nelem(tmp);
+		memmove(tmp, src + (size_t)i * Sh32sz, (size_t)m * Sh32sz);
+		if (fp->data != hostdata())
+			swap32s(tmp, (size_t)m * Sh32sz / 4);
+		for (j = 0; j < m; j++) {
+			dst[i + j].name = tmp[j].name;
+			dst[i + j].type = tmp[j].type;
+			dst[i + j].flags = tmp[j].flags;
+			dst[i + j].addr = tmp[j].addr;
+			dst[i + j].offset = tmp[j].offset;
+			dst[i + j].size = tmp[j].size;
+			dst[i + j].link = tmp[j].link;
+			dst[i + j].info = tmp[j].info;
+			dst[i + j].addralign = tmp[j].addralign;
+			dst[i + j].entsize = tmp[j].entsize;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Decode an ELF64 Section Header Table into portable Section Headers,
+ * which share the ELF64 layout
+ */
+static int
+decodeelf64shdrs(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp)
+{
+	uint32_t i, m;
+
+	if (fp->data == hostdata()) {
+		memmove(dst, src, (size_t)n * Sh64sz);
+		return 0;
+	}
+
+	/* Swap in blocks that stay in cache */
+	for (i = 0; i < n; i += m) {
+		m = n - i < 64 ? n - i : 64;
+		memmove(dst + i, src + (size_t)i * Sh64sz, (size_t)m * Sh64sz);
+		if (swapents(dst + i, m, Sh64sz, sh64widths) < 0)
+			return -1;
+	}
 
 	return 0;
 }
 
+/*
+ * Decode a Section Header Table with the generic decoder of the class,
+ * the reference for the decoders selectcodec specializes
+ */
+int
+refdecodeelfshdrs(uint8_t *src, uint32_t n, Shdr *dst, Fhdr *fp)
+{
+	unsigned int i;
+
+	for (i = 0; i < nelem(class); i++) {
+		if (class[i].type == fp->class && class[i].decodeelfshdrs != NULL)
+			return class[i].decodeelfshdrs(src, n, dst, fp);
+	}
+
+	return -1;
+}
+
 /*
  * Read ELF ident
  */
@@ -456,11 +699,8 @@ readident(FILE *f, Fhdr *fp)
 	unsigned int i;
 	uint8_t *p;
 
-	if (fseek(f, 0, SEEK_SET) < 0)
-		return -1;
-
 	p = buf;
-	if (fread(p, EI_NIDENT, 1, f) != 1)
+	if (readat(f, fp, p, EI_NIDENT, 0) < 0)
 		return -1;
 
 	p += EI_NIDENT;
@@ -488,6 +728,9 @@ readident(FILE *f, Fhdr *fp)
 		fp->readelfshdr = class[i].readelfshdr;
 		fp->readelfphdr = class[i].readelfphdr;
 		fp->readelfstrndx = class[i].readelfstrndx;
+		fp->unpackelfshdr = class[i].unpackelfshdr;
+		fp->decodeelfshdrs = class[i].decodeelfshdrs;
+		fp->unpackelfphdr = class[i].unpackelfphdr;
 		fp->ehsize = class[i].ehsize;
 		fp->shentsize = class[i].shentsize;
 		fp->phentsize = class[i].phentsize;
@@ -518,9 +761,32 @@ readident(FILE *f, Fhdr *fp)
 	fp->osabi = buf[EI_OSABI];
 	fp->abiversion = buf[EI_ABIVERSION];
 
+	if (selectcodec(fp) < 0)
+		return -1;
+
 	return (int)(p - buf);
 }
 
+/*
+ * Read a table of n entries in a single read
+ */
+static uint8_t*
+readelftable(FILE *f, uint64_t off, uint32_t n, uint16_t entsize, Fhdr *fp)
+{
+	uint8_t *tab;
+
+	tab = malloc((size_t)n * entsize + 1);
+	if (tab == NULL)
+		return NULL;
+
+	if (n > 0 && readat(f, fp, tab, (uint64_t)n * entsize, off) < 0) {
+		free(tab);
+		return NULL;
+	}
+
+	return tab;
+}
+
 /*
  * Read ELF Section Headers
  */
@@ -528,15 +794,21 @@ int
 readelfshdrs(FILE *f, Fhdr *fp)
 {
 	unsigned int i;
+	uint8_t *tab;
 
-	if (fseek(f, fp->shoff, SEEK_SET) < 0)
+	tab = readelftable(f, fp->shoff, fp->shnum, fp->shentsize, fp);
+	if (tab == NULL)
 		return -1;
 
 	for (i = 0; i < fp->shnum; i++) {
-		if (fp->readelfshdr(f, fp) < 0)
+		if (fp->readelfshdr(tab + (size_t)i * fp->shentsize, fp) < 0) {
+			free(tab);
 			return -1;
+		}
 	}
 
+	free(tab);
+
 	return 0;
 }
 
@@ -547,15 +819,21 @@ int
 readelfphdrs(FILE *f, Fhdr *fp)
 {
 	unsigned int i;
+	uint8_t *tab;
 
-	if (fseek(f, fp->phoff, SEEK_SET) < 0)
+	tab = readelftable(f, fp->phoff, fp->phnum, fp->phentsize, fp);
+	if (tab == NULL)
 		return -1;
 
 	for (i = 0; i < fp->phnum; i++) {
-		if (fp->readelfphdr(f, fp) < 0)
+		if (fp->readelfphdr(tab + (size_t)i * fp->phentsize, fp) < 0) {
+			free(tab);
 			return -1;
+		}
 	}
 
+	free(tab);
+
 	return 0;
 }
 
@@ -568,10 +846,7 @@ readelf32strndx(FILE *f, Fhdr *fp)
 	uint8_t buf[Sh32sz];
 	Elf32_Shdr sh;
 
-	if (fseek(f, fp->shoff + (uint64_t)(fp->shstrndx * fp->shentsize), SEEK_SET) < 0)
-		return -1;
-
-	if (fread(buf, fp->shentsize, 1, f) != 1)
+	if (readat(f, fp, buf, fp->shentsize, fp->shoff + (uint64_t)fp->shstrndx * fp->shentsize) < 0)
 		return -1;
 
 	if (unpackelf32shdr(buf, sizeof(buf), &sh, fp) < 0)
@@ -592,10 +867,7 @@ readelf64strndx(FILE *f, Fhdr *fp)
 	uint8_t buf[Sh64sz];
 	Elf64_Shdr sh;
 
-	if (fseek(f, fp->shoff + (uint64_t)(fp->shstrndx * fp->shentsize), SEEK_SET) < 0)
-		return -1;
-
-	if (fread(buf, fp->shentsize, 1, f) != 1)
+	if (readat(f, fp, buf, fp->shentsize, fp->shoff + (uint64_t)fp->shstrndx * fp->shentsize) < 0)
 		return -1;
 
 	if (unpackelf64shdr(buf, sizeof(buf), &sh, fp) < 0)
@@ -607,26 +879,62 @@ readelf64strndx(FILE *f, Fhdr *fp)
 	return 0;
 }
 
+/*
+ * Read size bytes at offset into a buffer of the allocator a, or of
+ * the heap when a is NULL
+ */
 static uint8_t*
-newsection(FILE *f, uint64_t offset, uint64_t size)
+newsection(FILE *f, uint64_t offset, uint64_t size, Elfalloc *a, Fhdr *fp)
 {
 	uint8_t *sect;
 
-	sect = malloc(size);
+	sect = allocbuf(a, size);
 	if (sect == NULL)
 		return NULL;
 
-	if (fseek(f, offset, SEEK_SET) < 0) {
-		free(sect);
+	if (readat(f, fp, sect, size, offset) < 0) {
+		freebuf(a, sect);
 		return NULL;
 	}
 
-	if (fread(sect, size, 1, f) != 1) {
-		free(sect);
-		return NULL;
+	return sect;
+}
+
+/*
+ * Resolve extended section and segment numbering from the first
+ * Section Header
+ */
+static int
+readelfxnum(FILE *f, Fhdr *fp)
+{
+	uint8_t buf[Sh64sz];
+	Shdr sh;
+
+	if (fp->shoff == 0)
+		return 0;
+	if (fp->shnum != 0 && fp->shstrndx != SHN_XINDEX && fp->phnum != PN_XNUM)
+		return 0;
+
+	if (readat(f, fp, buf, fp->shentsize, fp->shoff) < 0)
+		return -1;
+
+	if (fp->unpackelfshdr(buf, fp->shentsize, &sh, fp) < 0)
+		return -1;
+
+	if (fp->shnum == 0) {
+		if (sh.size > UINT32_MAX)
+			return -1;
+		fp->shnum = sh.size;
 	}
 
-	return sect;
+	if (fp->shstrndx == SHN_XINDEX)
+		fp->shstrndx = sh.link;
+
+	/* Cores of more than 65534 segments */
+	if (fp->phnum == PN_XNUM)
+		fp->phnum = sh.info;
+
+	return 0;
 }
 
 /*
@@ -635,6 +943,9 @@ newsection(FILE *f, uint64_t offset, uint64_t size)
 static int
 readelfstrndx(FILE *f, Fhdr *fp)
 {
+	if (readelfxnum(f, fp) < 0)
+		return -1;
+
 	if (fp->shstrndx == SHN_UNDEF) {
 		fprintf(stderr, "missing string table\n");
 		return -1;
@@ -643,10 +954,20 @@ readelfstrndx(FILE *f, Fhdr *fp)
 	if (fp->readelfstrndx(f, fp) < 0)
 		return -1;
 
-	fp->strndx = newsection(f, fp->offset, fp->strndxsize);
+	if (fp->map != NULL) {
+		if (fp->offset > fp->mapsize || fp->strndxsize > fp->mapsize - fp->offset)
+			return -1;
+		fp->strndx = fp->map + fp->offset;
+		return 0;
+	}
+
+	fp->strndx = elfalloc(fp, fp->strndxsize);
 	if (fp->strndx == NULL)
 		return -1;
 
+	if (readat(f, fp, fp->strndx, fp->strndxsize, fp->offset) < 0)
+		return -1;
+
 	return 0;
 }
 
@@ -665,30 +986,64 @@ char* getstr(Fhdr *fp, uint32_t i)
 }
 
 /*
- * Read ELF Section Headers
+ * Find a section by name in the Section Header Table, leaving its
+ * header in fp
  */
-uint8_t*
-readelfsect(FILE *f, char *name, Fhdr *fp)
+static int
+findsect(FILE *f, char *name, Fhdr *fp)
 {
 	unsigned int i;
+	uint8_t *tab;
 	char *n;
 
-	if (fseek(f, fp->shoff, SEEK_SET) < 0)
-		return NULL;
+	tab = readelftable(f, fp->shoff, fp->shnum, fp->shentsize, fp);
+	if (tab == NULL)
+		return -1;
 
 	for (i = 0; i < fp->shnum; i++) {
-		if (fp->readelfshdr(f, fp) < 0)
-			return NULL;
+		if (fp->readelfshdr(tab + (size_t)i * fp->shentsize, fp) < 0)
+			break;
 		n = getstr(fp, fp->name);
 		if (n == NULL)
-			return NULL;
-		if (strcmp(n, name) == 0)
-			return newsection(f, fp->offset, fp->size);
+			break;
+		if (strcmp(n, name) == 0) {
+			free(tab);
+			return 0;
+		}
 	}
 
-	fprintf(stderr, "section %s not found\n", name);
+	free(tab);
 
-	return NULL;
+	if (i == fp->shnum)
+		fprintf(stderr, "section %s not found\n", name);
+
+	return -1;
+}
+
+/*
+ * Read ELF Section Headers
+ */
+uint8_t*
+readelfsect(FILE *f, char *name, Fhdr *fp)
+{
+	uint8_t *sect, *out;
+	Elfalloc *a;
+
+	if (findsect(f, name, fp) < 0)
+		return NULL;
+
+	a = elfallocator(fp);
+
+	if (!(fp->flags & SHF_COMPRESSED))
+		return newsection(f, fp->offset, fp->size, a, fp);
+
+	sect = newsection(f, fp->offset, fp->size, NULL, fp);
+	if (sect == NULL)
+		return NULL;
+	out = unpacksection(sect, fp->size, &fp->size, 1, a, fp);
+	free(sect);
+
+	return out;
 }
 
 /*
@@ -745,10 +1100,634 @@ readelfsection(FILE *f, char *name, uint64_t *size, Fhdr *fp)
 	return sect;
 }
 
+/*
+ * Read ELF Section into buf, decompressed. Returns the section size,
+ * reading nothing when it is larger than len, or -1.
+ */
+int64_t
+readelfsectionbuf(FILE *f, char *name, uint8_t *buf, uint64_t len, Fhdr *fp)
+{
+	Shdr sh;
+
+	memset(fp, 0, sizeof(*fp));
 
-void
-freeelf(Fhdr *fp)
+	if (readident(f, fp) < 0)
+		return -1;
+
+	if (fp->readelfehdr(f, fp) < 0)
+		return -1;
+
+	if (readelfstrndx(f, fp) < 0)
+		return -1;
+
+	if (findsect(f, name, fp) < 0)
+		return -1;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.type = SHT_PROGBITS;
+	sh.flags = fp->flags;
+	sh.offset = fp->offset;
+	sh.size = fp->size;
+
+	return readelfzsectionbuf(f, &sh, buf, len, 1, fp);
+}
+
+/*
+ * Tell whether the table of n entries at off is in the file, before
+ * memory is allocated for a count taken from the headers. Without a
+ * mapping, its last byte is read.
+ */
+static int
+checkelftable(FILE *f, uint64_t off, uint32_t n, uint16_t entsize, Fhdr *fp)
+{
+	uint64_t len;
+	uint8_t b;
+
+	len = (uint64_t)n * entsize;
+	if (len == 0)
+		return 0;
+	if (off + len < off)
+		return -1;
+
+	if (fp->map != NULL)
+		return off <= fp->mapsize && len <= fp->mapsize - off ? 0 : -1;
+
+	return readat(f, fp, &b, 1, off + len - 1);
+}
+
+/*
+ * Load the Section Header Table
+ */
+static int
+loadelfshdrs(FILE *f, Fhdr *fp)
+{
+	uint8_t *tab;
+	int r;
+
+	if (fp->shnum == 0)
+		return 0;
+
+	if (checkelftable(f, fp->shoff, fp->shnum, fp->shentsize, fp) < 0) {
+		fprintf(stderr, "section header table past the end of the file\n");
+		return -1;
+	}
+
+	fp->shdrs = elfalloc(fp, (uint64_t)fp->shnum * sizeof(fp->shdrs[0]));
+	if (fp->shdrs == NULL)
+		return -1;
+
+	/* Decode straight from the mapping when there is one */
+	if (fp->map != NULL)
+		return fp->decodeelfshdrs(fp->map + fp->shoff, fp->shnum, fp->shdrs, fp);
+
+	tab = readelftable(f, fp->shoff, fp->shnum, fp->shentsize, fp);
+	if (tab == NULL)
+		return -1;
+
+	r = fp->decodeelfshdrs(tab, fp->shnum, fp->shdrs, fp);
+
+	free(tab);
+
+	return r;
+}
+
+/*
+ * Decode the Program Header Table into ph
+ */
+int
+loadelfphdrs(FILE *f, Phdr *ph, Fhdr *fp)
 {
-	if (fp->strndx != NULL)
-		free(fp->strndx);
+	uint8_t *tab;
+	uint32_t i;
+
+	if (fp->phoff == 0)
+		return -1;
+
+	tab = readelftable(f, fp->phoff, fp->phnum, fp->phentsize, fp);
+	if (tab == NULL)
+		return -1;
+
+	for (i = 0; i < fp->phnum; i++) {
+		if (fp->unpackelfphdr(tab + (size_t)i * fp->phentsize, fp->phentsize, &ph[i], fp) < 0) {
+			free(tab);
+			return -1;
+		}
+	}
+
+	free(tab);
+
+	return 0;
+}
+
+/*
+ * Load the Program Header Table and index its PT_LOAD segments
+ */
+static int
+loadelfsegs(FILE *f, Fhdr *fp)
+{
+	if (fp->phoff == 0)
+		fp->phnum = 0;
+
+	if (fp->phnum > 0) {
+		if (checkelftable(f, fp->phoff, fp->phnum, fp->phentsize, fp) < 0) {
+			fprintf(stderr, "program header table past the end of the file\n");
+			return -1;
+		}
+		fp->phdrs = elfalloc(fp, (uint64_t)fp->phnum * sizeof(fp->phdrs[0]));
+		if (fp->phdrs == NULL)
+			return -1;
+		if (loadelfphdrs(f, fp->phdrs, fp) < 0)
+			return -1;
+	}
+
+	return indexelfloads(fp);
+}
+
+/*
+ * Open the ELF Header and the Program Header Table of a file only,
+ * for the functions that need no sections, like elfbuildid
+ */
+int
+openelfehdr(FILE *f, Fhdr *fp)
+{
+	memset(fp, 0, sizeof(*fp));
+
+	if (readident(f, fp) < 0 || fp->readelfehdr(f, fp) < 0)
+		return -1;
+
+	if (readelfxnum(f, fp) < 0)
+		return -1;
+
+	if (loadelfsegs(f, fp) < 0) {
+		freeelf(fp);
+		return -1;
+	}
+
+	fp->ref = 1;
+
+	return 0;
+}
+
+/*
+ * Load the headers of an ELF File, keeping the Section Header Table
+ * resident
+ */
+static int
+loadelf(FILE *f, Fhdr *fp)
+{
+	if (readident(f, fp) < 0)
+		goto err;
+
+	if (fp->readelfehdr(f, fp) < 0)
+		goto err;
+
+	/* A file stripped of its Section Header Table has no sections */
+	if (fp->shoff == 0)
+		fp->shnum = 0;
+	else if (readelfxnum(f, fp) < 0)
+		goto err;
+
+	/* Cores may have a Section Header for extended numbering only */
+	if (fp->shnum > 0 && !(fp->type == ET_CORE && fp->shstrndx == SHN_UNDEF)) {
+		if (readelfstrndx(f, fp) < 0)
+			goto err;
+	}
+
+	if (loadelfshdrs(f, fp) < 0)
+		goto err;
+
+	if (loadelfsegs(f, fp) < 0)
+		goto err;
+
+	fp->ref = 1;
+
+	return 0;
+
+err:
+	freeelf(fp);
+	return -1;
+}
+
+/*
+ * Open ELF File
+ */
+int
+openelf(FILE *f, Fhdr *fp)
+{
+	return openelfarena(f, NULL, fp);
+}
+
+/*
+ * Open ELF File, allocating its tables from the arena a. The arena
+ * outlives the handle, to be reset for the next file.
+ */
+int
+openelfarena(FILE *f, Arena *a, Fhdr *fp)
+{
+	memset(fp, 0, sizeof(*fp));
+
+	fp->arena = a;
+
+	return loadelf(f, fp);
+}
+
+/*
+ * Open an ELF image held in memory. Sections are views of the
+ * buffer, which must outlive the handle.
+ */
+int
+openelfmem(const void *buf, size_t len, Fhdr *fp)
+{
+	return openelfmemarena(buf, len, NULL, fp);
+}
+
+int
+openelfmemarena(const void *buf, size_t len, Arena *a, Fhdr *fp)
+{
+	memset(fp, 0, sizeof(*fp));
+
+	if (buf == NULL || len == 0)
+		return -1;
+
+	fp->map = (uint8_t*)buf;
+	fp->mapsize = len;
+	fp->mapmem = 1;
+	fp->arena = a;
+
+	return loadelf(NULL, fp);
+}
+
+/*
+ * Open an ELF image read through readat(aux, off, len, buf), which
+ * returns 0 once it has read all len bytes at off, or -1
+ */
+int
+openelfreader(int (*readat)(void*, uint64_t, uint64_t, void*), void *aux, Fhdr *fp)
+{
+	return openelfreaderarena(readat, aux, NULL, fp);
+}
+
+int
+openelfreaderarena(int (*readat)(void*, uint64_t, uint64_t, void*), void *aux, Arena *a, Fhdr *fp)
+{
+	memset(fp, 0, sizeof(*fp));
+
+	fp->readat = readat;
+	fp->aux = aux;
+	fp->arena = a;
+
+	return loadelf(NULL, fp);
+}
+
+/*
+ * Check the resident Section Header Table against the per-field
+ * decoder and the generic bulk decoder of the class
+ */
+int
+verifyelfshdrs(FILE *f, Fhdr *fp)
+{
+	unsigned int i;
+	uint8_t *tab;
+	Shdr sh, *ref;
+
+	if (fp->shdrs == NULL)
+		return -1;
+
+	tab = readelftable(f, fp->shoff, fp->shnum, fp->shentsize, fp);
+	if (tab == NULL)
+		return -1;
+
+	for (i = 0; i < fp->shnum; i++) {
+		if (fp->unpackelfshdr(tab + (size_t)i * fp->shentsize, fp->shentsize, &sh, fp) < 0
+		|| memcmp(&sh, &fp->shdrs[i], sizeof(sh)) != 0) {
+			fprintf(stderr, "section header %u mismatch\n", i);
+			free(tab);
+			return -1;
+		}
+	}
+
+	ref = malloc((size_t)fp->shnum * sizeof(ref[0]));
+	if (ref == NULL) {
+		free(tab);
+		return -1;
+	}
+
+	if (refdecodeelfshdrs(tab, fp->shnum, ref, fp) < 0
+	|| memcmp(ref, fp->shdrs, (size_t)fp->shnum * sizeof(ref[0])) != 0) {
+		fprintf(stderr, "section header table mismatch\n");
+		free(ref);
+		free(tab);
+		return -1;
+	}
+
+	free(ref);
+	free(tab);
+
+	return 0;
+}
+
+/*
+ * Get Section Header by index
+ */
+Shdr*
+elfshdr(Fhdr *fp, unsigned int i)
+{
+	if (fp->shdrs == NULL || i >= fp->shnum)
+		return NULL;
+
+	return &fp->shdrs[i];
+}
+
+/*
+ * Get next Section Header after prev, or the first one if prev is NULL
+ */
+Shdr*
+nextelfshdr(Fhdr *fp, Shdr *prev)
+{
+	if (fp->shdrs == NULL)
+		return NULL;
+
+	if (prev == NULL)
+		return fp->shnum > 0 ? &fp->shdrs[0] : NULL;
+
+	if (prev + 1 >= fp->shdrs + fp->shnum)
+		return NULL;
+
+	return prev + 1;
+}
+
+/*
+ * Get next Section Header of a type after prev
+ */
+Shdr*
+elfshdrtype(Fhdr *fp, uint32_t type, Shdr *prev)
+{
+	Shdr *sh;
+
+	for (sh = nextelfshdr(fp, prev); sh != NULL; sh = nextelfshdr(fp, sh)) {
+		if (sh->type == type)
+			return sh;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get Section Header name
+ */
+char*
+elfshdrstr(Fhdr *fp, Shdr *sh)
+{
+	return getstr(fp, sh->name);
+}
+
+/*
+ * Read ELF Section from its Section Header
+ */
+uint8_t*
+readelfshdrsection(FILE *f, Shdr *sh, Fhdr *fp)
+{
+	if (sh->type == SHT_NOBITS)
+		return NULL;
+
+	return newsection(f, sh->offset, sh->size, elfallocator(fp), fp);
+}
+
+/*
+ * Read ELF Section from its Section Header into buf. Returns the
+ * section size, reading nothing when it is larger than len, or -1.
+ */
+int64_t
+readelfshdrsectionbuf(FILE *f, Shdr *sh, uint8_t *buf, uint64_t len, Fhdr *fp)
+{
+	if (sh->type == SHT_NOBITS || sh->size > INT64_MAX)
+		return -1;
+
+	if (buf == NULL || len < sh->size)
+		return sh->size;
+
+	if (readat(f, fp, buf, sh->size, sh->offset) < 0)
+		return -1;
+
+	return sh->size;
+}
+
+/*
+ * Get the bytes of an ELF Section, as a view of the mapping when
+ * there is one or as a copy otherwise
+ */
+uint8_t*
+getsection(FILE *f, Shdr *sh, Fhdr *fp, int *mapped)
+{
+	*mapped = fp->map != NULL;
+
+	if (*mapped)
+		return (uint8_t*)mapelfshdrsection(fp, sh);
+
+	/* Copies stay on the heap, putsection doesn't know the handle */
+	if (sh->type == SHT_NOBITS)
+		return NULL;
+
+	return newsection(f, sh->offset, sh->size, NULL, fp);
+}
+
+/*
+ * Get the bytes of an ELF Section for the life of the handle, as a
+ * view of the mapping when there is one or as a copy in its arena
+ */
+uint8_t*
+keepsection(FILE *f, Shdr *sh, Fhdr *fp)
+{
+	uint8_t *sect;
+
+	if (fp->map != NULL)
+		return (uint8_t*)mapelfshdrsection(fp, sh);
+
+	if (sh->type == SHT_NOBITS || sh->size > SIZE_MAX - 1)
+		return NULL;
+
+	sect = elfalloc(fp, sh->size + 1);
+	if (sect == NULL)
+		return NULL;
+
+	if (readat(f, fp, sect, sh->size, sh->offset) < 0)
+		return NULL;
+
+	return sect;
+}
+
+/*
+ * Release bytes returned by getsection
+ */
+void
+putsection(uint8_t *sect, int mapped)
+{
+	if (!mapped)
+		free(sect);
+}
+
+/*
+ * Apply access hints to the mapping
+ */
+static void
+adviseelfmap(Fhdr *fp, int flags)
+{
+	if (flags & ELFMAP_WILLNEED)
+		madvise(fp->map, fp->mapsize, MADV_WILLNEED);
+
+	if (flags & ELFMAP_SEQUENTIAL)
+		madvise(fp->map, fp->mapsize, MADV_SEQUENTIAL);
+
+	if (flags & ELFMAP_RANDOM)
+		madvise(fp->map, fp->mapsize, MADV_RANDOM);
+
+#ifdef MADV_HUGEPAGE
+	if ((flags & ELFMAP_HUGEPAGE) && fp->mapsize >= Hugesz)
+		madvise(fp->map, fp->mapsize, MADV_HUGEPAGE);
+#endif
+}
+
+/*
+ * Map ELF File
+ */
+int
+openelfmap(char *path, int flags, Fhdr *fp)
+{
+	return openelfmaparena(path, flags, NULL, fp);
+}
+
+int
+openelfmaparena(char *path, int flags, Arena *a, Fhdr *fp)
+{
+	struct stat st;
+	int fd, r;
+
+	memset(fp, 0, sizeof(*fp));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	r = mapelffd(fd, st.st_size, flags, a, fp);
+	close(fd);
+
+	return r;
+}
+
+/*
+ * Map the ELF File open on fd, of size bytes. The descriptor can be
+ * closed once the handle is open.
+ */
+int
+mapelffd(int fd, int64_t size, int flags, Arena *a, Fhdr *fp)
+{
+	void *map;
+	int mflags;
+
+	memset(fp, 0, sizeof(*fp));
+
+	/* Files larger than the address space can't be mapped whole */
+	if (size <= 0 || (uint64_t)size > SIZE_MAX)
+		return -1;
+
+	mflags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	if (flags & ELFMAP_POPULATE)
+		mflags |= MAP_POPULATE;
+#endif
+
+	map = mmap(NULL, size, PROT_READ, mflags, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	fp->map = map;
+	fp->mapsize = size;
+	fp->arena = a;
+
+	adviseelfmap(fp, flags);
+
+	return loadelf(NULL, fp);
+}
+
+/*
+ * Get a view of an ELF Section from the mapping
+ */
+const uint8_t*
+mapelfshdrsection(Fhdr *fp, Shdr *sh)
+{
+	if (fp->map == NULL || sh->type == SHT_NOBITS)
+		return NULL;
+
+	if (sh->offset > fp->mapsize || sh->size > fp->mapsize - sh->offset)
+		return NULL;
+
+	return fp->map + sh->offset;
+}
+
+/*
+ * Get a view of a named ELF Section from the mapping
+ */
+const uint8_t*
+mapelfsection(Fhdr *fp, char *name, uint64_t *size)
+{
+	const uint8_t *sect;
+	Shdr *sh;
+
+	sh = elfshdrname(fp, name);
+	if (sh == NULL) {
+		fprintf(stderr, "section %s not found\n", name);
+		return NULL;
+	}
+
+	sect = mapelfshdrsection(fp, sh);
+	if (sect == NULL)
+		return NULL;
+
+	*size = sh->size;
+
+	return sect;
+}
+
+/*
+ * Take a reference to an open handle, to share it read-only between
+ * threads. Each reference is dropped with freeelf.
+ */
+Fhdr*
+increfelf(Fhdr *fp)
+{
+	__atomic_add_fetch(&fp->ref, 1, __ATOMIC_RELAXED);
+
+	return fp;
+}
+
+void
+freeelf(Fhdr *fp)
+{
+	/* The last reference releases the handle */
+	if (__atomic_sub_fetch(&fp->ref, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	/* The tables go with the arena */
+	if (fp->ownarena)
+		freeelfarena(fp->arena);
+	fp->arena = NULL;
+	fp->ownarena = 0;
+	fp->shindex = NULL;
+	fp->tabs = NULL;
+	fp->shdrs = NULL;
+	fp->phdrs = NULL;
+	fp->loads = NULL;
+	fp->nload = 0;
+	fp->strndx = NULL;
+
+	if (fp->map != NULL) {
+		if (!fp->mapmem)
+			munmap(fp->map, fp->mapsize);
+		fp->map = NULL;
+	}
 }
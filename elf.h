@@ -1,7 +1,95 @@
 typedef struct Fhdr Fhdr;
+typedef struct Shdr Shdr;
+typedef struct Phdr Phdr;
+typedef struct Note Note;
+typedef struct Symtab Symtab;
+typedef struct Symidx Symidx;
+typedef struct Sym Sym;
+typedef struct Symhash Symhash;
+typedef struct Reltab Reltab;
+typedef struct Dyn Dyn;
+typedef struct Dynamic Dynamic;
+typedef struct Ldso Ldso;
+typedef struct Dep Dep;
+typedef struct Deps Deps;
+typedef struct Chdr Chdr;
+typedef struct Zstream Zstream;
+typedef struct Sstream Sstream;
+typedef struct Shindex Shindex;
+typedef struct Scan Scan;
+typedef struct Prstatus Prstatus;
+typedef struct Corefile Corefile;
+typedef struct Core Core;
+typedef struct Lineunit Lineunit;
+typedef struct Linerange Linerange;
+typedef struct Linetab Linetab;
+typedef struct Lineloc Lineloc;
+typedef struct Cfifde Cfifde;
+typedef struct Cfitab Cfitab;
+typedef struct Cfirule Cfirule;
+typedef struct Cfirow Cfirow;
+typedef struct Arena Arena;
+typedef struct Elfalloc Elfalloc;
+typedef struct Cache Cache;
+typedef struct Cachestat Cachestat;
+typedef struct Elfidx Elfidx;
+typedef struct Elftab Elftab;
 
 /*
- * Portable ELF file header
+ * Portable ELF section header
+ */
+struct Shdr {
+	uint32_t	name;		/* Section name (String Table index) */
+	uint32_t	type;
+	uint64_t	flags;
+	uint64_t	addr;
+	uint64_t	offset;
+	uint64_t	size;
+	uint32_t	link;
+	uint32_t	info;
+	uint64_t	addralign;
+	uint64_t	entsize;
+};
+
+/*
+ * Portable ELF program header
+ */
+struct Phdr {
+	uint32_t	type;
+	uint32_t	flags;
+	uint64_t	offset;
+	uint64_t	vaddr;
+	uint64_t	paddr;
+	uint64_t	filesz;
+	uint64_t	memsz;
+	uint64_t	align;
+};
+
+/*
+ * ELF note, pointing into the note bytes
+ */
+struct Note {
+	uint32_t	type;
+	uint32_t	namesz;		/* Name size, with its NUL */
+	uint32_t	descsz;
+	char		*name;
+	uint8_t		*desc;
+};
+
+/*
+ * Allocator of the section buffers returned by the reads, like
+ * pooled or NUMA-local memory
+ */
+struct Elfalloc {
+	void*	(*alloc)(void *ctx, size_t size);
+	void	(*free)(void *ctx, void *p);
+	void	*ctx;
+};
+
+/*
+ * Portable ELF file header. The symbol, relocation, dynamic, hash,
+ * line and call frame tables read from it are read once, and live
+ * as long as the handle.
  */
 struct Fhdr {
 	/* ELF Data */
@@ -12,9 +100,24 @@ struct Fhdr {
 
 	/* ELF Class */
 	int (*readelfehdr)(FILE*, Fhdr*);
-	int (*readelfshdr)(FILE*, Fhdr*);
-	int (*readelfphdr)(FILE*, Fhdr*);
+	int (*readelfshdr)(uint8_t*, Fhdr*);
+	int (*readelfphdr)(uint8_t*, Fhdr*);
 	int (*readelfstrndx)(FILE*, Fhdr*);
+	int (*unpackelfshdr)(uint8_t*, int, Shdr*, Fhdr*);
+	int (*decodeelfshdrs)(uint8_t*, uint32_t, Shdr*, Fhdr*);
+	int (*unpackelfphdr)(uint8_t*, int, Phdr*, Fhdr*);
+	int (*decodeelfsyms)(uint8_t*, uint32_t, Symtab*);
+	void (*unpackelfsym)(uint8_t*, Sym*);
+	int (*decodeelfrels)(uint8_t*, uint32_t, int, Reltab*, uint32_t);
+
+	/* Memory Map */
+	uint8_t		*map;		/* Mapped file image */
+	uint64_t	mapsize;	/* Mapped file size */
+	int		mapmem;		/* Image is a caller buffer, not a mapping */
+
+	/* Reader */
+	int (*readat)(void*, uint64_t, uint64_t, void*);
+	void		*aux;		/* Reader context */
 
 	/* ELF Identification */
 	uint8_t		class;		/* File class */
@@ -32,26 +135,567 @@ struct Fhdr {
 	uint64_t	shoff;
 	uint16_t	ehsize;		/* ELF Header size */
 	uint16_t	phentsize;	/* Section Header size */
-	uint16_t	phnum;
+	uint32_t	phnum;
 	uint16_t	shentsize;	/* Program Header size */
-	uint16_t	shnum;
-	uint16_t	shstrndx;
+	uint32_t	shnum;
+	uint32_t	shstrndx;
 
 	/* Section Header */
 	uint32_t	name;
+	uint64_t	flags;
 	uint64_t	offset;
 	uint64_t	size;
 
 	/* String Table */
 	uint32_t	strndxsize;	/* String Table size */
 	uint8_t		*strndx;	/* Copy of String Table */
+
+	/* Section Header Table */
+	Shdr		*shdrs;		/* Decoded Section Headers */
+
+	/* Program Header Table */
+	Phdr		*phdrs;		/* Decoded Program Headers */
+	Phdr		**loads;	/* PT_LOAD segments by address, then by offset */
+	uint32_t	nload;
+
+	/* Section Name Index */
+	Shindex		*shindex;	/* Built on first use */
+
+	/* Tables */
+	Elftab		*tabs;		/* Read once, see findelftab */
+
+	/* Arena */
+	Arena		*arena;		/* Holds the tables above */
+	int		ownarena;	/* Arena is released with the handle */
+
+	/* Allocator */
+	Elfalloc	*alloc;		/* Of the section buffers, see setelfalloc */
+
+	/* Sharing */
+	int		ref;		/* References, see increfelf */
+	int		verbose;	/* Print headers as they are read */
+};
+
+/*
+ * Symbol Table, with one array per symbol field
+ */
+struct Symtab {
+	uint32_t	nsym;		/* Number of symbols */
+	uint64_t	*value;
+	uint64_t	*size;
+	uint32_t	*name;		/* String Table index */
+	uint32_t	*shndx;		/* Section index, extended indexes resolved */
+	uint8_t		*info;		/* Binding and type */
+	uint8_t		*other;		/* Visibility */
+
+	/* Private */
+	uint8_t		*strtab;	/* Linked String Table */
+	uint64_t	strtabsize;
+};
+
+/*
+ * Portable ELF symbol
+ */
+struct Sym {
+	uint32_t	name;		/* String Table index */
+	uint8_t		info;		/* Binding and type */
+	uint8_t		other;		/* Visibility */
+	uint16_t	shndx;
+	uint64_t	value;
+	uint64_t	size;
+};
+
+/*
+ * Dynamic symbol lookup through .gnu.hash or .hash
+ */
+struct Symhash {
+	/* Private */
+	uint32_t	type;		/* SHT_GNU_HASH or SHT_HASH */
+	uint8_t		class;
+	uint8_t		data;
+	uint8_t		*hash;		/* Hash section */
+	uint64_t	hashsize;
+	uint8_t		*syms;		/* Dynamic Symbol Table, undecoded */
+	uint32_t	nsym;
+	uint32_t	symsize;	/* Symbol size */
+	uint8_t		*strtab;	/* Dynamic String Table */
+	uint64_t	strtabsize;
+	void (*unpackelfsym)(uint8_t*, Sym*);
+};
+
+/*
+ * Relocation Table, with one array per relocation field
+ */
+struct Reltab {
+	uint32_t	nrel;		/* Number of relocations */
+	uint64_t	*offset;	/* Place, an address outside relocatable files */
+	int64_t		*addend;	/* 0 when the addend is in place */
+	uint32_t	*sym;		/* Symbol Table index */
+	uint32_t	*type;
+	uint32_t	*shndx;		/* Target section, SHN_UNDEF if none */
+};
+
+/*
+ * Portable ELF dynamic section entry
+ */
+struct Dyn {
+	int64_t		tag;
+	uint64_t	val;
+};
+
+/*
+ * Dynamic section, with the names it refers to
+ */
+struct Dynamic {
+	Dyn		*dyn;		/* Entries, up to DT_NULL */
+	uint32_t	ndyn;
+	char		**needed;	/* DT_NEEDED names, in order */
+	uint32_t	nneeded;
+	char		*soname;	/* NULL when absent */
+	char		*rpath;
+	char		*runpath;
+	uint64_t	flags;		/* DT_FLAGS */
+	uint64_t	flags1;		/* DT_FLAGS_1 */
+
+	/* Private */
+	uint8_t		*strtab;	/* Dynamic String Table */
+	uint64_t	strtabsize;
+};
+
+/*
+ * Shared library of a dependency closure
+ */
+struct Dep {
+	char		*name;		/* DT_NEEDED name, or the path of the file */
+	char		*path;		/* NULL when not found */
+	uint32_t	parent;		/* Dependency that first needed it */
+	uint64_t	dev;
+	uint64_t	ino;
+};
+
+/*
+ * Shared library dependency closure of a file
+ */
+struct Deps {
+	char		*path;
+	int		thread;		/* Worker thread calling back */
+	int		err;		/* -1 when the file couldn't be read */
+	Dep		*deps;		/* The file, then its libraries in load order */
+	uint32_t	ndep;
+	uint32_t	nmissing;	/* Libraries not found */
+};
+
+/*
+ * Portable ELF compression header
+ */
+struct Chdr {
+	uint32_t	type;		/* ELFCOMPRESS_ZLIB or ELFCOMPRESS_ZSTD */
+	uint64_t	size;		/* Uncompressed size */
+	uint64_t	addralign;	/* Uncompressed alignment */
+};
+
+/*
+ * Decompression stream over a compressed section
+ */
+struct Zstream {
+	Chdr		ch;
+
+	/* Private */
+	FILE		*f;
+	Fhdr		*fp;
+	uint64_t	off;		/* Next compressed byte to read */
+	uint64_t	end;		/* End of the compressed bytes */
+	uint64_t	out;		/* Bytes delivered */
+	uint8_t		*in;		/* Input buffer, NULL on a mapping */
+	uint8_t		*next;		/* Pending input */
+	uint64_t	avail;
+	void		*z;		/* Decompressor state */
+};
+
+/*
+ * Chunked stream over a section
+ */
+struct Sstream {
+	uint64_t	size;		/* Section size, uncompressed */
+
+	/* Private */
+	FILE		*f;
+	Fhdr		*fp;
+	uint64_t	off;		/* Next byte to read */
+	uint64_t	end;		/* End of the section */
+	int		compressed;
+	Zstream		zs;
+};
+
+/*
+ * Address to symbol index
+ */
+struct Symidx {
+	uint32_t	n;		/* Number of address ranges */
+
+	/* Private */
+	uint64_t	*keys;		/* Range starts, in Eytzinger order from 1 */
+	uint64_t	*keyend;	/* Range ends, in Eytzinger order */
+	uint32_t	*keysym;	/* Range symbols, in Eytzinger order */
+	uint64_t	*start;		/* Range starts, sorted */
+	uint64_t	*end;		/* Range ends, exclusive */
+	uint32_t	*sym;		/* Range symbols */
+	void		*mem;
+};
+
+/*
+ * Largest GNU build ID
+ */
+enum {
+	ELFBUILDID_MAX	= 64,
+};
+
+/*
+ * Section, symbol and address indexes of a file, mapped from an
+ * index file and used in place, see buildelfidx
+ */
+struct Elfidx {
+	uint8_t		buildid[ELFBUILDID_MAX];
+	uint32_t	buildidsize;
+	uint32_t	shnum;
+	Shdr		*shdrs;		/* Section Headers, read-only */
+	Symtab		st;		/* Symbols, read-only */
+	Symidx		ix;		/* Address index of the symbols */
+
+	/* Private */
+	uint8_t		*map;
+	uint64_t	mapsize;
+	uint8_t		*shstr;		/* Section Header String Table */
+	uint64_t	shstrsize;
+};
+
+/*
+ * Counters of a cache of handles
+ */
+struct Cachestat {
+	uint64_t	hits;
+	uint64_t	misses;
+	uint64_t	evictions;
+	uint64_t	entries;	/* Handles cached */
+	uint64_t	size;		/* Bytes charged to the budget */
+};
+
+/*
+ * Summary of a scanned file
+ */
+struct Scan {
+	char		*path;
+	int		thread;		/* Worker thread calling back */
+	int		err;		/* -1 when the file couldn't be read */
+	Fhdr		*fp;		/* Handle, valid during the callback */
+
+	/* ELF Header */
+	uint8_t		class;
+	uint8_t		data;
+	uint8_t		osabi;
+	uint16_t	type;
+	uint16_t	machine;
+	uint64_t	entry;
+	uint32_t	phnum;
+	uint32_t	shnum;
+
+	/* Sections */
+	uint64_t	textsize;	/* Read-only allocated sections */
+	uint64_t	datasize;	/* Writable allocated sections */
+	uint64_t	bsssize;	/* SHT_NOBITS allocated sections */
+	uint64_t	debugsize;	/* .debug sections */
+	uint64_t	nsym;		/* Symbol Table entries */
+	uint64_t	ndynsym;	/* Dynamic Symbol Table entries */
+
+	/* GNU build ID */
+	uint8_t		buildid[ELFBUILDID_MAX];
+	uint32_t	buildidsize;
+};
+
+/*
+ * Thread of a core, from its NT_PRSTATUS note
+ */
+struct Prstatus {
+	uint32_t	signo;		/* Signal that killed the process */
+	uint16_t	cursig;		/* Current signal */
+	uint32_t	pid;
+	uint32_t	ppid;
+	uint32_t	pgrp;
+	uint32_t	sid;
+	const uint8_t	*regs;		/* General registers, in the layout of the machine */
+	uint32_t	regsize;
+	const uint8_t	*fpregs;	/* NT_PRFPREG of the thread, or NULL */
+	uint32_t	fpregsize;
+};
+
+/*
+ * File mapped by a core process, from the NT_FILE note
+ */
+struct Corefile {
+	uint64_t	start;
+	uint64_t	end;
+	uint64_t	offset;		/* File offset of start */
+	char		*name;
+};
+
+/*
+ * Core file, with its memory read from the mapping
+ */
+struct Core {
+	Fhdr		fh;
+	Prstatus	*threads;	/* In note order, the faulting thread first */
+	uint32_t	nthread;
+	Corefile	*files;		/* By address */
+	uint32_t	nfile;
+	uint64_t	*auxv;		/* Type and value pairs, without AT_NULL */
+	uint32_t	nauxv;
+};
+
+/*
+ * Address to source line table, from .debug_line
+ */
+struct Linetab {
+	uint32_t	nunit;		/* Line number programs */
+
+	/* Private */
+	Fhdr		*fp;
+	uint8_t		*line;		/* .debug_line */
+	uint64_t	linesize;
+	uint8_t		*linestr;	/* .debug_line_str */
+	uint64_t	linestrsize;
+	uint8_t		*str;		/* .debug_str */
+	uint64_t	strsize;
+	uint64_t	*unitoff;	/* Offsets of the programs */
+	Lineunit	**units;	/* Decoded programs, NULL until used */
+	Linerange	*ranges;	/* Address ranges of the units, by start */
+	uint64_t	*reach;		/* Largest range end up to each range */
+	uint32_t	nrange;
+};
+
+/*
+ * Source position of an address
+ */
+struct Lineloc {
+	char		*file;		/* NULL when unknown */
+	char		*dir;		/* NULL when unknown or file is absolute */
+	uint32_t	line;		/* 0 when the code has no line */
+};
+
+/*
+ * Registers of the call frame rows, by DWARF number
+ */
+enum {
+	ELFCFI_NREG	= 32,
+};
+
+/*
+ * Call frame rule types
+ */
+enum {
+	ELFCFI_SAME,			/* Unchanged */
+	ELFCFI_UNDEF,			/* Not recoverable */
+	ELFCFI_OFFSET,			/* Saved at CFA+off */
+	ELFCFI_VALOFFSET,		/* Is CFA+off */
+	ELFCFI_REG,			/* In register reg */
+	ELFCFI_EXPR,			/* Saved at the address computed by expr */
+	ELFCFI_VALEXPR,			/* Is the value computed by expr */
+	ELFCFI_CFAREG,			/* CFA is register reg plus off */
+	ELFCFI_CFAEXPR,			/* CFA is the value computed by expr */
+};
+
+/*
+ * Rule to recover a register or the CFA
+ */
+struct Cfirule {
+	uint8_t		type;
+	uint32_t	reg;
+	int64_t		off;		/* Or the length of expr */
+	const uint8_t	*expr;		/* DWARF expression, in .eh_frame */
+};
+
+/*
+ * Row of the call frame information, for a range of PCs
+ */
+struct Cfirow {
+	uint64_t	start;
+	uint64_t	end;
+	Cfirule		cfa;		/* Canonical Frame Address */
+	uint32_t	ra;		/* Return address column */
+	Cfirule		rarule;		/* Rule of the return address column */
+	Cfirule		regs[ELFCFI_NREG];
+	uint8_t		signal;		/* Frame of a signal handler */
+};
+
+/*
+ * Call frame information of .eh_frame, by PC
+ */
+struct Cfitab {
+	uint32_t	nfde;		/* Frame Description Entries */
+
+	/* Private */
+	Fhdr		*fp;
+	uint8_t		*ehframe;	/* .eh_frame */
+	uint64_t	ehframesize;
+	uint64_t	ehframeaddr;
+	uint8_t		*hdr;		/* .eh_frame_hdr */
+	uint64_t	hdrsize;
+	uint64_t	hdraddr;
+	uint8_t		*table;		/* Search table of .eh_frame_hdr */
+	uint8_t		tableenc;
+	uint32_t	tableent;	/* Entry size */
+	uint64_t	*ents;		/* Start PC and offset pairs, without table */
+	Cfifde		**fdes;		/* Decoded FDEs, NULL until used */
+	uint32_t	sp;		/* Stack pointer register */
+};
+
+/*
+ * Symbol of an address without one, in batch lookups
+ */
+enum {
+	ELFSYM_NONE	= 0xffffffff,
+};
+
+/*
+ * Memory map flags
+ */
+enum {
+	ELFMAP_POPULATE		= 1<<0,	/* Prefault the whole mapping */
+	ELFMAP_WILLNEED		= 1<<1,	/* Start read-ahead of the whole file */
+	ELFMAP_SEQUENTIAL	= 1<<2,	/* Expect sequential access */
+	ELFMAP_RANDOM		= 1<<3,	/* Expect random access */
+	ELFMAP_HUGEPAGE		= 1<<4,	/* Use huge pages for large files */
 };
 
 /* Read */
 int readelf(FILE*, Fhdr*);
 uint8_t* readelfsection(FILE*, char*, uint64_t*, Fhdr*);
+int64_t readelfsectionbuf(FILE*, char*, uint8_t*, uint64_t, Fhdr*);
 void freeelf(Fhdr*);
 
+/* Handle */
+int openelf(FILE*, Fhdr*);
+int openelfarena(FILE*, Arena*, Fhdr*);
+Fhdr* increfelf(Fhdr*);
+int verifyelfshdrs(FILE*, Fhdr*);
+Shdr* elfshdr(Fhdr*, unsigned int);
+Shdr* elfshdrname(Fhdr*, char*);
+uint32_t elfshdrprefix(Fhdr*, char*, uint32_t**);
+Shdr* elfshdrtype(Fhdr*, uint32_t, Shdr*);
+Shdr* nextelfshdr(Fhdr*, Shdr*);
+char* elfshdrstr(Fhdr*, Shdr*);
+uint8_t* readelfshdrsection(FILE*, Shdr*, Fhdr*);
+int64_t readelfshdrsectionbuf(FILE*, Shdr*, uint8_t*, uint64_t, Fhdr*);
+
+/* Segments */
+Phdr* elfphdr(Fhdr*, unsigned int);
+Phdr* elfphdrtype(Fhdr*, uint32_t, Phdr*);
+int elfvaddroff(Fhdr*, uint64_t, uint64_t*);
+int elfoffvaddr(Fhdr*, uint64_t, uint64_t*);
+int64_t readelfvaddr(FILE*, Fhdr*, uint64_t, void*, uint64_t);
+
+/* Notes */
+int openelfehdr(FILE*, Fhdr*);
+int nextelfnote(uint8_t*, uint64_t, uint64_t, uint64_t*, Note*, Fhdr*);
+int readelfnotes(FILE*, Fhdr*, int (*)(void*, Note*), void*);
+int elfbuildid(FILE*, Fhdr*, uint8_t*);
+
+/* Relocations */
+int readelfreltab(FILE*, Shdr*, Reltab*, Fhdr*);
+int readelfrels(FILE*, Reltab*, Fhdr*);
+uint32_t elfrelgroup(Reltab*, uint32_t, uint32_t*);
+void freeelfreltab(Reltab*);
+
+/* Dynamic Section */
+int readelfdynamic(FILE*, Dynamic*, Fhdr*);
+Dyn* elfdyntag(Dynamic*, int64_t);
+void freeelfdynamic(Dynamic*);
+
+/* Dependencies */
+Ldso* openelfldso(char*, char*);
+int readelfdeps(Ldso*, char*, Deps*);
+int scanelfdeps(Ldso*, char**, uint32_t, int, void (*)(void*, Deps*), void*);
+void freeelfdeps(Deps*);
+void freeelfldso(Ldso*);
+
+/* Compressed Sections */
+int readelfchdr(uint8_t*, uint64_t, Chdr*, Fhdr*);
+uint8_t* readelfzsection(FILE*, Shdr*, uint64_t*, int, Fhdr*);
+int64_t readelfzsectionbuf(FILE*, Shdr*, uint8_t*, uint64_t, int, Fhdr*);
+int openelfzstream(FILE*, Shdr*, Zstream*, Fhdr*);
+int64_t readelfzstream(Zstream*, uint8_t*, uint64_t);
+void closeelfzstream(Zstream*);
+
+/* Streams */
+int openelfsstream(FILE*, Shdr*, Sstream*, Fhdr*);
+int64_t readelfsstream(Sstream*, uint8_t*, uint64_t);
+void closeelfsstream(Sstream*);
+int readelfchunks(FILE*, Shdr*, uint8_t*, uint64_t, int (*)(void*, uint8_t*, uint64_t), void*, Fhdr*);
+
+/* Symbols */
+int readelfsymtab(FILE*, Shdr*, Symtab*, Fhdr*);
+char* elfsymname(Symtab*, uint32_t);
+void freeelfsymtab(Symtab*);
+int buildelfsymidx(Symtab*, Symidx*);
+int readelfsymidx(FILE*, Symtab*, Symidx*, Fhdr*);
+int lookupelfsym(Symidx*, uint64_t, uint32_t*);
+int64_t lookupelfsyms(Symidx*, uint64_t*, uint32_t, uint32_t*);
+void freeelfsymidx(Symidx*);
+int buildelfidx(FILE*, Fhdr*, char*);
+int openelfidx(char*, uint8_t*, uint32_t, Elfidx*);
+int verifyelfidx(Elfidx*);
+char* elfidxshdrstr(Elfidx*, Shdr*);
+void freeelfidx(Elfidx*);
+int readelfsymhash(FILE*, Symhash*, Fhdr*);
+int64_t lookupelfdynsym(Symhash*, char*, Sym*);
+void freeelfsymhash(Symhash*);
+
+/* Map */
+int openelfmap(char*, int, Fhdr*);
+int openelfmem(const void*, size_t, Fhdr*);
+int openelfreader(int (*)(void*, uint64_t, uint64_t, void*), void*, Fhdr*);
+int openelfmaparena(char*, int, Arena*, Fhdr*);
+int openelfmemarena(const void*, size_t, Arena*, Fhdr*);
+int openelfreaderarena(int (*)(void*, uint64_t, uint64_t, void*), void*, Arena*, Fhdr*);
+const uint8_t* mapelfsection(Fhdr*, char*, uint64_t*);
+const uint8_t* mapelfshdrsection(Fhdr*, Shdr*);
+
+/* Core */
+int openelfcore(char*, int, Core*);
+const uint8_t* mapelfcoremem(Core*, uint64_t, uint64_t);
+int64_t readelfcoremem(Core*, uint64_t, void*, uint64_t);
+Corefile* elfcorefile(Core*, uint64_t);
+int elfcoreauxv(Core*, uint64_t, uint64_t*);
+void freeelfcore(Core*);
+
+/* Lines */
+int readelflines(FILE*, Linetab*, Fhdr*);
+int lookupelfline(Linetab*, uint64_t, Lineloc*);
+int64_t lookupelflines(Linetab*, uint64_t*, uint32_t, Lineloc*, int);
+void freeelflines(Linetab*);
+
+/* Call Frames */
+int readelfcfi(FILE*, Cfitab*, Fhdr*);
+const Cfirow* lookupelfcfi(Cfitab*, uint64_t);
+int unwindelfcfi(Cfitab*, const Cfirow*, uint64_t*, uint64_t*, int (*)(void*, uint64_t, uint64_t, void*), void*);
+void freeelfcfi(Cfitab*);
+
+/* Memory */
+Arena* newelfarena(uint64_t);
+void resetelfarena(Arena*);
+void freeelfarena(Arena*);
+void setelfalloc(Fhdr*, Elfalloc*);
+
+/* Cache */
+Cache* newelfcache(uint64_t, int);
+Fhdr* openelfcache(Cache*, char*);
+void putelfcache(Cache*, Fhdr*);
+void elfcachestat(Cache*, Cachestat*);
+void freeelfcache(Cache*);
+
+/* Scan */
+int scanelf(char**, uint32_t, int, int, void (*)(void*, Scan*), void*);
+int scanelfdir(char*, int, int, void (*)(void*, Scan*), void*);
+
 /* Print */
 void printelfhdr(Fhdr*);
 
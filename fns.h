@@ -9,3 +9,60 @@ void printelf32phdr(Elf32_Phdr*, Fhdr*);
 void printelf64phdr(Elf64_Phdr*, Fhdr*);
 
 char* getstr(Fhdr*, uint32_t);
+
+/*
+ * arena.c
+ */
+void* arenaalloc(Arena*, uint64_t);
+uint64_t arenasize(Arena*);
+void* elfalloc(Fhdr*, uint64_t);
+void* elfdup(Fhdr*, void*, uint64_t);
+int findelftab(Fhdr*, int, uint64_t, uint64_t, void*, size_t);
+int keepelftab(Fhdr*, int, uint64_t, uint64_t, int, void*, size_t);
+void keepallocator(Fhdr*, Elfalloc*);
+Elfalloc* elfallocator(Fhdr*);
+void* allocbuf(Elfalloc*, uint64_t);
+void freebuf(Elfalloc*, void*);
+
+/*
+ * dwarf.c
+ */
+uint64_t getdwfixed(Dwbuf*, int);
+uint64_t getdwuleb(Dwbuf*);
+int64_t getdwsleb(Dwbuf*);
+char* getdwcstr(Dwbuf*);
+uint8_t* getdwunitlen(Dwbuf*, uint8_t*);
+
+/*
+ * elf.c
+ */
+int readat(FILE*, Fhdr*, void*, uint64_t, uint64_t);
+uint8_t* getsection(FILE*, Shdr*, Fhdr*, int*);
+void putsection(uint8_t*, int);
+uint8_t* keepsection(FILE*, Shdr*, Fhdr*);
+int loadelfphdrs(FILE*, Phdr*, Fhdr*);
+int mapelffd(int, int64_t, int, Arena*, Fhdr*);
+int refdecodeelfshdrs(uint8_t*, uint32_t, Shdr*, Fhdr*);
+
+/*
+ * comp.c
+ */
+uint8_t* unpacksection(uint8_t*, uint64_t, uint64_t*, int, Elfalloc*, Fhdr*);
+
+/*
+ * dec.c
+ */
+int selectcodec(Fhdr*);
+
+/*
+ * seg.c
+ */
+int indexelfloads(Fhdr*);
+Phdr* findload(Fhdr*, uint64_t, int);
+
+/*
+ * swap.c
+ */
+int hostdata(void);
+void swap32s(void*, size_t);
+int swapents(void*, size_t, size_t, uint8_t*);
@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Index file, in the byte order of the host that wrote it: a header,
+ * then each column at a 64-byte aligned offset, used in place
+ */
+enum {
+	Idxversion = 1,
+	Idxorder = 0x01020304,
+	Idxalign = 64,
+};
+
+/*
+ * Columns of an index file
+ */
+enum {
+	Cshdr,		/* Section Headers */
+	Cshstr,		/* Section Header String Table */
+	Cvalue,		/* Symbol columns */
+	Csize,
+	Cname,
+	Cshndx,
+	Cinfo,
+	Cother,
+	Cstrtab,	/* Symbol String Table */
+	Ckeys,		/* Address index */
+	Ckeyend,
+	Ckeysym,
+	Cstart,
+	Cend,
+	Csym,
+	Ncol,
+};
+
+typedef struct Idxhdr Idxhdr;
+
+struct Idxhdr {
+	uint8_t		magic[8];
+	uint32_t	version;
+	uint32_t	order;		/* Idxorder, as written */
+	uint32_t	shdrsize;	/* Size of a Shdr */
+	uint32_t	buildidsize;
+	uint8_t		buildid[ELFBUILDID_MAX];
+	uint64_t	size;		/* File size */
+	uint64_t	sum;		/* Checksum of the columns */
+	uint32_t	shnum;
+	uint32_t	nsym;
+	uint32_t	nrange;
+	uint32_t	pad;
+	uint64_t	off[Ncol];
+	uint64_t	len[Ncol];
+};
+
+static const uint8_t idxmagic[8] = "\177ELFIDX";
+
+#define HDRLEN	((sizeof(Idxhdr) + Idxalign - 1) & ~(uint64_t)(Idxalign - 1))
+
+/*
+ * Checksum of 8-byte words, with the running sum h
+ */
+static uint64_t
+sumwords(uint64_t h, uint8_t *p, uint64_t len)
+{
+	uint64_t w;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		h ^= w;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
+
+/*
+ * Get the path of the index of build ID id in dir
+ */
+static char*
+idxpath(char *dir, uint8_t *id, uint32_t n)
+{
+	char *path, *s;
+	uint32_t i;
+
+	path = malloc(strlen(dir) + 2*n + 6);
+	if (path == NULL)
+		return NULL;
+
+	s = path + sprintf(path, "%s/", dir);
+	for (i = 0; i < n; i++) {
+		*s++ = "0123456789abcdef"[id[i] >> 4];
+		*s++ = "0123456789abcdef"[id[i] & 15];
+	}
+	strcpy(s, ".idx");
+
+	return path;
+}
+
+/*
+ * Expected length of each column
+ */
+static void
+collens(uint32_t shnum, uint32_t nsym, uint32_t nrange, uint64_t *len)
+{
+	len[Cshdr] = (uint64_t)shnum * sizeof(Shdr);
+	len[Cvalue] = (uint64_t)nsym * sizeof(uint64_t);
+	len[Csize] = (uint64_t)nsym * sizeof(uint64_t);
+	len[Cname] = (uint64_t)nsym * sizeof(uint32_t);
+	len[Cshndx] = (uint64_t)nsym * sizeof(uint32_t);
+	len[Cinfo] = nsym;
+	len[Cother] = nsym;
+	len[Ckeys] = ((uint64_t)nrange + 1) * sizeof(uint64_t);
+	len[Ckeyend] = ((uint64_t)nrange + 1) * sizeof(uint64_t);
+	len[Ckeysym] = ((uint64_t)nrange + 1) * sizeof(uint32_t);
+	len[Cstart] = (uint64_t)nrange * sizeof(uint64_t);
+	len[Cend] = (uint64_t)nrange * sizeof(uint64_t);
+	len[Csym] = (uint64_t)nrange * sizeof(uint32_t);
+}
+
+/*
+ * Write a column and its padding, adding them to the checksum
+ */
+static int
+putcol(FILE *w, void *p, uint64_t len, uint64_t *sum)
+{
+	uint8_t tail[Idxalign];
+	uint64_t n;
+
+	n = len & ~(uint64_t)(Idxalign - 1);
+	if (n > 0 && fwrite(p, 1, n, w) != n)
+		return -1;
+	*sum = sumwords(*sum, p, n);
+
+	if (len > n) {
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, (uint8_t*)p + n, len - n);
+		if (fwrite(tail, 1, Idxalign, w) != Idxalign)
+			return -1;
+		*sum = sumwords(*sum, tail, Idxalign);
+	}
+
+	return 0;
+}
+
+/*
+ * Write the index of an open file, of its Section Header Table, its
+ * Symbol Table, or Dynamic Symbol Table when stripped, and their
+ * address index, to dir under its GNU build ID. The file is written
+ * aside and renamed, so readers never see a partial index.
+ */
+int
+buildelfidx(FILE *f, Fhdr *fp, char *dir)
+{
+	uint8_t *col[Ncol];
+	char *path, *tmp;
+	uint64_t off;
+	Idxhdr h;
+	Symtab st;
+	Symidx ix;
+	FILE *w;
+	int i, n, fd;
+
+	memset(&h, 0, sizeof(h));
+	memset(&st, 0, sizeof(st));
+	memset(&ix, 0, sizeof(ix));
+
+	n = elfbuildid(f, fp, h.buildid);
+	if (n <= 0) {
+		fprintf(stderr, "missing build ID\n");
+		return -1;
+	}
+	h.buildidsize = n;
+
+	if (elfshdrtype(fp, SHT_SYMTAB, NULL) != NULL || elfshdrtype(fp, SHT_DYNSYM, NULL) != NULL) {
+		if (readelfsymidx(f, &st, &ix, fp) < 0)
+			return -1;
+	}
+
+	memcpy(h.magic, idxmagic, sizeof(h.magic));
+	h.version = Idxversion;
+	h.order = Idxorder;
+	h.shdrsize = sizeof(Shdr);
+	h.shnum = fp->shdrs != NULL ? fp->shnum : 0;
+	h.nsym = st.nsym;
+	h.nrange = ix.n;
+
+	collens(h.shnum, h.nsym, h.nrange, h.len);
+	h.len[Cshstr] = fp->strndx != NULL ? fp->strndxsize : 0;
+	h.len[Cstrtab] = st.strtab != NULL ? st.strtabsize : 0;
+
+	col[Cshdr] = (uint8_t*)fp->shdrs;
+	col[Cshstr] = fp->strndx;
+	col[Cvalue] = (uint8_t*)st.value;
+	col[Csize] = (uint8_t*)st.size;
+	col[Cname] = (uint8_t*)st.name;
+	col[Cshndx] = (uint8_t*)st.shndx;
+	col[Cinfo] = st.info;
+	col[Cother] = st.other;
+	col[Cstrtab] = st.strtab;
+	col[Ckeys] = (uint8_t*)ix.keys;
+	col[Ckeyend] = (uint8_t*)ix.keyend;
+	col[Ckeysym] = (uint8_t*)ix.keysym;
+	col[Cstart] = (uint8_t*)ix.start;
+	col[Cend] = (uint8_t*)ix.end;
+	col[Csym] = (uint8_t*)ix.sym;
+
+	/* A file without symbols has an empty index */
+	if (ix.keys == NULL) {
+		h.len[Ckeys] = 0;
+		h.len[Ckeyend] = 0;
+		h.len[Ckeysym] = 0;
+	}
+
+	off = HDRLEN;
+	for (i = 0; i < Ncol; i++) {
+		h.off[i] = off;
+		off += (h.len[i] + Idxalign - 1) & ~(uint64_t)(Idxalign - 1);
+	}
+	h.size = off;
+
+	path = idxpath(dir, h.buildid, h.buildidsize);
+	tmp = path != NULL ? malloc(strlen(path) + 8) : NULL;
+	if (tmp == NULL) {
+		free(path);
+		goto err;
+	}
+	sprintf(tmp, "%s.XXXXXX", path);
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		fprintf(stderr, "cannot create %s\n", tmp);
+		goto errpath;
+	}
+	fchmod(fd, 0644);
+	w = fdopen(fd, "wb");
+	if (w == NULL) {
+		close(fd);
+		goto errtmp;
+	}
+
+	/* The header goes last, once the checksum is known */
+	if (fseek(w, HDRLEN, SEEK_SET) < 0)
+		goto errw;
+	for (i = 0; i < Ncol; i++) {
+		if (h.len[i] > 0 && putcol(w, col[i], h.len[i], &h.sum) < 0)
+			goto errw;
+	}
+	if (fseek(w, 0, SEEK_SET) < 0 || fwrite(&h, 1, sizeof(h), w) != sizeof(h))
+		goto errw;
+	if (fclose(w) != 0)
+		goto errtmp;
+
+	if (rename(tmp, path) < 0)
+		goto errtmp;
+
+	free(tmp);
+	free(path);
+	freeelfsymidx(&ix);
+	freeelfsymtab(&st);
+
+	return 0;
+
+errw:
+	fclose(w);
+errtmp:
+	fprintf(stderr, "cannot write %s\n", path);
+	unlink(tmp);
+errpath:
+	free(tmp);
+	free(path);
+err:
+	freeelfsymidx(&ix);
+	freeelfsymtab(&st);
+	return -1;
+}
+
+/*
+ * Check the header of a mapped index against the file it maps
+ */
+static int
+checkhdr(Idxhdr *h, uint64_t size)
+{
+	uint64_t len[Ncol];
+	int i;
+
+	if (memcmp(h->magic, idxmagic, sizeof(h->magic)) != 0)
+		return -1;
+
+	if (h->version != Idxversion || h->order != Idxorder || h->shdrsize != sizeof(Shdr)) {
+		fprintf(stderr, "index of another version or host\n");
+		return -1;
+	}
+
+	if (h->size != size || h->buildidsize > ELFBUILDID_MAX)
+		return -1;
+
+	collens(h->shnum, h->nsym, h->nrange, len);
+	len[Cshstr] = h->len[Cshstr];
+	len[Cstrtab] = h->len[Cstrtab];
+	if (h->len[Ckeys] == 0) {
+		len[Ckeys] = 0;
+		len[Ckeyend] = 0;
+		len[Ckeysym] = 0;
+	}
+
+	for (i = 0; i < Ncol; i++) {
+		if (h->len[i] != len[i] || h->off[i] % Idxalign != 0 || h->off[i] < HDRLEN)
+			return -1;
+		if (h->off[i] > size || h->len[i] > size - h->off[i])
+			return -1;
+	}
+
+	/* An index comes with its table */
+	if (h->nrange > 0 && h->len[Ckeys] == 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Map the index of build ID id from dir. The tables are used in
+ * place: the header is checked, and the symbols of the address index
+ * are bounded by the Symbol Table, so that lookups stay within the
+ * index. The rest of the contents is checked by verifyelfidx.
+ */
+int
+openelfidx(char *dir, uint8_t *id, uint32_t n, Elfidx *x)
+{
+	struct stat st;
+	uint8_t *map;
+	char *path;
+	Idxhdr *h;
+	uint32_t i;
+	int fd;
+
+	memset(x, 0, sizeof(*x));
+
+	if (n == 0 || n > ELFBUILDID_MAX)
+		return -1;
+
+	path = idxpath(dir, id, n);
+	if (path == NULL)
+		return -1;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < HDRLEN || (uint64_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	x->map = map;
+	x->mapsize = st.st_size;
+
+	h = (Idxhdr*)map;
+	if (checkhdr(h, st.st_size) < 0 || h->buildidsize != n || memcmp(h->buildid, id, n) != 0) {
+		fprintf(stderr, "bad index\n");
+		freeelfidx(x);
+		return -1;
+	}
+
+	memcpy(x->buildid, h->buildid, n);
+	x->buildidsize = n;
+
+	x->shnum = h->shnum;
+	x->shdrs = (Shdr*)(map + h->off[Cshdr]);
+	x->shstr = map + h->off[Cshstr];
+	x->shstrsize = h->len[Cshstr];
+
+	x->st.nsym = h->nsym;
+	x->st.value = (uint64_t*)(map + h->off[Cvalue]);
+	x->st.size = (uint64_t*)(map + h->off[Csize]);
+	x->st.name = (uint32_t*)(map + h->off[Cname]);
+	x->st.shndx = (uint32_t*)(map + h->off[Cshndx]);
+	x->st.info = map + h->off[Cinfo];
+	x->st.other = map + h->off[Cother];
+	x->st.strtab = h->len[Cstrtab] > 0 ? map + h->off[Cstrtab] : NULL;
+	x->st.strtabsize = h->len[Cstrtab];
+
+	x->ix.n = h->nrange;
+	x->ix.keys = (uint64_t*)(map + h->off[Ckeys]);
+	x->ix.keyend = (uint64_t*)(map + h->off[Ckeyend]);
+	x->ix.keysym = (uint32_t*)(map + h->off[Ckeysym]);
+	x->ix.start = (uint64_t*)(map + h->off[Cstart]);
+	x->ix.end = (uint64_t*)(map + h->off[Cend]);
+	x->ix.sym = (uint32_t*)(map + h->off[Csym]);
+
+	/* Names are used in place, the tables must be terminated */
+	if ((x->shstrsize > 0 && x->shstr[x->shstrsize - 1] != '\0')
+	|| (x->st.strtabsize > 0 && x->st.strtab[x->st.strtabsize - 1] != '\0'))
+		goto bad;
+
+	/* Lookups index the symbols with the ranges */
+	for (i = 0; i < x->ix.n; i++) {
+		if (x->ix.sym[i] >= x->st.nsym || x->ix.keysym[i + 1] >= x->st.nsym)
+			goto bad;
+	}
+
+	return 0;
+
+bad:
+	fprintf(stderr, "bad index\n");
+	freeelfidx(x);
+	return -1;
+}
+
+/*
+ * Check the contents of an index against its checksum. Reads the
+ * whole index.
+ */
+int
+verifyelfidx(Elfidx *x)
+{
+	uint64_t sum;
+	Idxhdr *h;
+
+	h = (Idxhdr*)x->map;
+
+	sum = sumwords(0, x->map + HDRLEN, x->mapsize - HDRLEN);
+	if (sum != h->sum) {
+		fprintf(stderr, "index checksum mismatch\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the name of a Section Header of an index
+ */
+char*
+elfidxshdrstr(Elfidx *x, Shdr *sh)
+{
+	if (sh->name >= x->shstrsize)
+		return NULL;
+
+	return (char*)&x->shstr[sh->name];
+}
+
+void
+freeelfidx(Elfidx *x)
+{
+	if (x->map != NULL)
+		munmap(x->map, x->mapsize);
+	memset(x, 0, sizeof(*x));
+}
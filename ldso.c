@@ -0,0 +1,872 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	Nbucket = 4096,		/* Hash buckets of the caches */
+	Loading = 0,
+	Loaded,
+	Bad,			/* Missing, or not a usable ELF file */
+};
+
+/*
+ * ld.so.cache entry types
+ */
+enum {
+	Cacheelf	= 1,
+	Cachelibc6	= 3,
+	Cachetype	= 0xff,
+};
+
+typedef struct Obj Obj;
+typedef struct Path Path;
+typedef struct Centry Centry;
+typedef struct Chain Chain;
+typedef struct Job Job;
+
+/*
+ * Dynamic section of a file, shared by all the closures it belongs to
+ */
+struct Obj {
+	uint64_t	dev;
+	uint64_t	ino;
+	int		state;
+	uint8_t		class;
+	uint8_t		data;
+	uint16_t	type;
+	uint16_t	machine;
+	uint64_t	flags1;
+	char		*soname;
+	char		*rpath;
+	char		*runpath;
+	char		**needed;
+	uint32_t	nneeded;
+	void		*mem;		/* Storage of the names */
+	Obj		*next;
+};
+
+/*
+ * File looked up by path
+ */
+struct Path {
+	char		*path;
+	Obj		*obj;		/* NULL when missing or unusable */
+	Path		*next;
+};
+
+/*
+ * Library of ld.so.cache
+ */
+struct Centry {
+	char		*name;
+	char		*path;
+	Centry		*next;
+};
+
+struct Ldso {
+	char		*root;		/* Prefix of the absolute paths */
+	size_t		rootlen;
+	char		*libpath;	/* Like LD_LIBRARY_PATH */
+
+	/* ld.so.cache, in file order by name */
+	uint8_t		*cache;
+	Centry		*centries;
+	Centry		*cnames[Nbucket];
+
+	/* Files parsed, by identity and by path */
+	pthread_mutex_t	lk;
+	pthread_cond_t	loaded;
+	Obj		*objs[Nbucket];
+	Path		*paths[Nbucket];
+};
+
+/*
+ * Closure of a file being resolved
+ */
+struct Chain {
+	Ldso		*l;
+	Deps		*d;
+	Obj		**objs;		/* Object of each dependency */
+	uint32_t	cap;
+	char		*buf;		/* Candidate path */
+	size_t		bufsize;
+};
+
+struct Job {
+	Ldso		*l;
+	char		**paths;
+	uint32_t	npath;
+	uint32_t	next;
+	void (*fn)(void*, Deps*);
+	void		*arg;
+};
+
+static char *sysdirs[] = {
+	"/lib64",
+	"/usr/lib64",
+	"/lib",
+	"/usr/lib",
+};
+
+static uint32_t
+hashstr(char *s)
+{
+	uint32_t h;
+
+	/* FNV-1a */
+	for (h = 2166136261u; *s != '\0'; s++)
+		h = (h ^ (uint8_t)*s) * 16777619u;
+
+	return h;
+}
+
+static uint32_t
+hashid(uint64_t dev, uint64_t ino)
+{
+	uint64_t h;
+
+	h = (dev * 0x9e3779b97f4a7c15ull) ^ ino;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ull;
+
+	return h >> 32;
+}
+
+/*
+ * Index the libraries of ld.so.cache by name. Only the current
+ * format, written by glibc since 2.32 and after the old one before,
+ * is read; string offsets are from its header.
+ */
+static int
+readcache(Ldso *l)
+{
+	static char magic[] = "glibc-ld.so.cache1.1";
+	static char oldmagic[] = "ld.so-1.7.0";
+	uint32_t nlibs, i, key, val, n32;
+	uint64_t size, hdr, hwcap;
+	int32_t flags;
+	uint8_t *c, *e;
+	struct stat st;
+	Centry *ce;
+	char *path;
+	FILE *f;
+
+	path = malloc(l->rootlen + sizeof("/etc/ld.so.cache"));
+	if (path == NULL)
+		return -1;
+	memcpy(path, l->root, l->rootlen);
+	strcpy(path + l->rootlen, "/etc/ld.so.cache");
+
+	/* A system without the cache searches the default directories */
+	f = fopen(path, "rb");
+	free(path);
+	if (f == NULL)
+		return 0;
+
+	if (fstat(fileno(f), &st) < 0 || st.st_size < 48) {
+		fclose(f);
+		return 0;
+	}
+	size = st.st_size;
+
+	l->cache = malloc(size + 1);
+	if (l->cache == NULL || fread(l->cache, size, 1, f) != 1) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	l->cache[size] = '\0';
+	c = l->cache;
+
+	hdr = 0;
+	if (memcmp(c, oldmagic, sizeof(oldmagic) - 1) == 0) {
+		memcpy(&n32, c + 12, 4);
+		hdr = (16 + (uint64_t)n32 * 12 + 7) & ~7ull;
+	}
+	if (hdr + 48 > size || memcmp(c + hdr, magic, sizeof(magic) - 1) != 0)
+		return 0;
+
+	/* The cache is in the byte order of the system */
+	memcpy(&nlibs, c + hdr + 20, 4);
+	if (nlibs > (size - hdr - 48) / 24)
+		return 0;
+
+	l->centries = calloc(nlibs + 1, sizeof(l->centries[0]));
+	if (l->centries == NULL)
+		return -1;
+
+	/* Backwards, to keep the file order within a name */
+	for (i = nlibs; i-- > 0; ) {
+		e = c + hdr + 48 + (uint64_t)i * 24;
+		memcpy(&flags, e, 4);
+		memcpy(&key, e + 4, 4);
+		memcpy(&val, e + 8, 4);
+		memcpy(&hwcap, e + 16, 8);
+
+		/* Libraries of glibc-hwcaps subdirectories need the CPU */
+		if (hwcap != 0)
+			continue;
+		if ((flags & Cachetype) != Cacheelf && (flags & Cachetype) != Cachelibc6)
+			continue;
+		if (key >= size - hdr || val >= size - hdr)
+			continue;
+
+		ce = &l->centries[i];
+		ce->name = (char*)c + hdr + key;
+		ce->path = (char*)c + hdr + val;
+		n32 = hashstr(ce->name) & (Nbucket - 1);
+		ce->next = l->cnames[n32];
+		l->cnames[n32] = ce;
+	}
+
+	return 0;
+}
+
+/*
+ * Open a resolver of shared library dependencies, for the files of
+ * the system image under root, or of this system if root is NULL.
+ * The search path libpath, if not NULL, comes before the default
+ * ones like LD_LIBRARY_PATH.
+ */
+Ldso*
+openelfldso(char *root, char *libpath)
+{
+	Ldso *l;
+
+	l = calloc(1, sizeof(*l));
+	if (l == NULL)
+		return NULL;
+
+	if (root == NULL || strcmp(root, "/") == 0)
+		root = "";
+	l->rootlen = strlen(root);
+	while (l->rootlen > 0 && root[l->rootlen - 1] == '/')
+		l->rootlen--;
+
+	l->root = strdup(root);
+	l->libpath = libpath != NULL ? strdup(libpath) : NULL;
+	if (l->root == NULL || (libpath != NULL && l->libpath == NULL)) {
+		freeelfldso(l);
+		return NULL;
+	}
+
+	pthread_mutex_init(&l->lk, NULL);
+	pthread_cond_init(&l->loaded, NULL);
+
+	if (readcache(l) < 0) {
+		freeelfldso(l);
+		return NULL;
+	}
+
+	return l;
+}
+
+void
+freeelfldso(Ldso *l)
+{
+	Path *p, *np;
+	Obj *o, *no;
+	int i;
+
+	if (l == NULL)
+		return;
+
+	for (i = 0; i < Nbucket; i++) {
+		for (o = l->objs[i]; o != NULL; o = no) {
+			no = o->next;
+			free(o->mem);
+			free(o);
+		}
+		for (p = l->paths[i]; p != NULL; p = np) {
+			np = p->next;
+			free(p);
+		}
+	}
+
+	pthread_mutex_destroy(&l->lk);
+	pthread_cond_destroy(&l->loaded);
+
+	free(l->centries);
+	free(l->cache);
+	free(l->libpath);
+	free(l->root);
+	free(l);
+}
+
+/*
+ * Copy the names of the dynamic section into an object, in a single
+ * allocation
+ */
+static int
+copynames(Obj *o, Dynamic *d)
+{
+	size_t size;
+	uint32_t i;
+	char *s;
+
+	size = (d->nneeded + 1) * sizeof(char*);
+	for (i = 0; i < d->nneeded; i++)
+		size += strlen(d->needed[i]) + 1;
+	size += d->soname != NULL ? strlen(d->soname) + 1 : 0;
+	size += d->rpath != NULL ? strlen(d->rpath) + 1 : 0;
+	size += d->runpath != NULL ? strlen(d->runpath) + 1 : 0;
+
+	o->mem = malloc(size);
+	if (o->mem == NULL)
+		return -1;
+
+	o->needed = o->mem;
+	s = (char*)(o->needed + d->nneeded + 1);
+	for (i = 0; i < d->nneeded; i++) {
+		o->needed[i] = strcpy(s, d->needed[i]);
+		s += strlen(s) + 1;
+	}
+	o->nneeded = d->nneeded;
+
+	if (d->soname != NULL) {
+		o->soname = strcpy(s, d->soname);
+		s += strlen(s) + 1;
+	}
+	if (d->rpath != NULL) {
+		o->rpath = strcpy(s, d->rpath);
+		s += strlen(s) + 1;
+	}
+	if (d->runpath != NULL)
+		o->runpath = strcpy(s, d->runpath);
+	o->flags1 = d->flags1;
+
+	return 0;
+}
+
+/*
+ * Parse the ELF Header and the dynamic section of a file
+ */
+static int
+parseobj(Obj *o, char *path)
+{
+	Dynamic d;
+	Fhdr fh;
+	FILE *f;
+	int r;
+
+	f = fopen(path, "rb");
+	if (f == NULL)
+		return -1;
+
+	if (openelfehdr(f, &fh) < 0) {
+		fclose(f);
+		return -1;
+	}
+
+	/* Static executables have no dynamic section */
+	memset(&d, 0, sizeof(d));
+	r = 0;
+	if (elfphdrtype(&fh, PT_DYNAMIC, NULL) != NULL)
+		r = readelfdynamic(f, &d, &fh);
+
+	if (r == 0)
+		r = copynames(o, &d);
+	o->class = fh.class;
+	o->data = fh.data;
+	o->type = fh.type;
+	o->machine = fh.machine;
+
+	freeelfdynamic(&d);
+	freeelf(&fh);
+	fclose(f);
+
+	return r;
+}
+
+/*
+ * Get the object of a file, parsed once for all the threads: the
+ * first one publishes it as loading and the others wait for it
+ */
+static Obj*
+loadobj(Ldso *l, char *path, struct stat *st)
+{
+	uint32_t h;
+	Obj *o;
+	int r;
+
+	h = hashid(st->st_dev, st->st_ino) & (Nbucket - 1);
+
+	pthread_mutex_lock(&l->lk);
+	for (o = l->objs[h]; o != NULL; o = o->next) {
+		if (o->dev == (uint64_t)st->st_dev && o->ino == (uint64_t)st->st_ino)
+			break;
+	}
+	if (o != NULL) {
+		while (o->state == Loading)
+			pthread_cond_wait(&l->loaded, &l->lk);
+		pthread_mutex_unlock(&l->lk);
+		return o->state == Loaded ? o : NULL;
+	}
+
+	o = calloc(1, sizeof(*o));
+	if (o == NULL) {
+		pthread_mutex_unlock(&l->lk);
+		return NULL;
+	}
+	o->dev = st->st_dev;
+	o->ino = st->st_ino;
+	o->state = Loading;
+	o->next = l->objs[h];
+	l->objs[h] = o;
+	pthread_mutex_unlock(&l->lk);
+
+	r = parseobj(o, path);
+
+	pthread_mutex_lock(&l->lk);
+	o->state = r == 0 ? Loaded : Bad;
+	pthread_cond_broadcast(&l->loaded);
+	pthread_mutex_unlock(&l->lk);
+
+	return r == 0 ? o : NULL;
+}
+
+/*
+ * Get the object at a path, looking it up once for all the threads
+ */
+static Path*
+lookuppath(Ldso *l, char *path)
+{
+	struct stat st;
+	uint32_t h;
+	Path *p, *n;
+	size_t len;
+
+	h = hashstr(path) & (Nbucket - 1);
+
+	pthread_mutex_lock(&l->lk);
+	for (p = l->paths[h]; p != NULL; p = p->next) {
+		if (strcmp(p->path, path) == 0)
+			break;
+	}
+	pthread_mutex_unlock(&l->lk);
+	if (p != NULL)
+		return p;
+
+	len = strlen(path);
+	n = malloc(sizeof(*n) + len + 1);
+	if (n == NULL)
+		return NULL;
+	n->path = memcpy(n + 1, path, len + 1);
+	n->obj = NULL;
+
+	if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+		n->obj = loadobj(l, path, &st);
+
+	pthread_mutex_lock(&l->lk);
+	for (p = l->paths[h]; p != NULL; p = p->next) {
+		if (strcmp(p->path, path) == 0)
+			break;
+	}
+	if (p == NULL) {
+		n->next = l->paths[h];
+		l->paths[h] = n;
+		p = n;
+		n = NULL;
+	}
+	pthread_mutex_unlock(&l->lk);
+
+	free(n);
+
+	return p;
+}
+
+/*
+ * Make room for a candidate path of len bytes
+ */
+static int
+growbuf(Chain *c, size_t len)
+{
+	char *b;
+
+	if (len < c->bufsize)
+		return 0;
+
+	b = realloc(c->buf, len + 1);
+	if (b == NULL)
+		return -1;
+	c->buf = b;
+	c->bufsize = len + 1;
+
+	return 0;
+}
+
+/*
+ * Build the path of name in the directory dir of a search path,
+ * under the root, expanding $ORIGIN to the directory of the object.
+ * Directories with other substitutions are skipped.
+ */
+static int
+candidate(Chain *c, char *dir, size_t dirlen, char *name, char *origin)
+{
+	size_t n, olen;
+	char *p, *q;
+
+	olen = strrchr(origin, '/') != NULL ? (size_t)(strrchr(origin, '/') - origin) : 0;
+
+	/* Each $ORIGIN takes at least 7 bytes of dir */
+	n = c->l->rootlen;
+	if (growbuf(c, n + dirlen + (dirlen / 7 + 1) * olen + strlen(name) + 3) < 0)
+		return -1;
+	memcpy(c->buf, c->l->root, n);
+	if (n > 0 && dir[0] != '/' && dir[0] != '$')
+		c->buf[n++] = '/';
+
+	for (p = dir; p < dir + dirlen; ) {
+		if (*p != '$') {
+			c->buf[n++] = *p++;
+			continue;
+		}
+		if (dirlen - (p - dir) >= 7 && memcmp(p, "$ORIGIN", 7) == 0)
+			q = p + 7;
+		else if (dirlen - (p - dir) >= 9 && memcmp(p, "${ORIGIN}", 9) == 0)
+			q = p + 9;
+		else
+			return 0;
+		memcpy(c->buf + n, origin, olen);
+		n += olen;
+		p = q;
+	}
+
+	c->buf[n++] = '/';
+	strcpy(c->buf + n, name);
+
+	return 1;
+}
+
+/*
+ * Tell whether an object can be loaded with the file being resolved
+ */
+static int
+compatible(Obj *o, Obj *exe)
+{
+	return o->type == ET_DYN && o->class == exe->class && o->data == exe->data && o->machine == exe->machine;
+}
+
+/*
+ * Look for name in the directories of a colon-separated search path
+ */
+static Path*
+searchdirs(Chain *c, char *dirs, char *name, char *origin)
+{
+	char *dir, *end;
+	Path *p;
+	int r;
+
+	for (dir = dirs; dir != NULL && *dir != '\0'; dir = *end != '\0' ? end + 1 : end) {
+		end = strchr(dir, ':');
+		if (end == NULL)
+			end = dir + strlen(dir);
+		if (end == dir)
+			continue;
+
+		r = candidate(c, dir, end - dir, name, origin);
+		if (r <= 0)
+			continue;
+
+		p = lookuppath(c->l, c->buf);
+		if (p != NULL && p->obj != NULL && compatible(p->obj, c->objs[0]))
+			return p;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get the path of a dependency within the image, for $ORIGIN
+ */
+static char*
+imagepath(Chain *c, uint32_t i)
+{
+	char *path;
+
+	path = c->d->deps[i].path;
+	if (c->l->rootlen > 0 && strncmp(path, c->l->root, c->l->rootlen) == 0)
+		return path + c->l->rootlen;
+
+	return path;
+}
+
+/*
+ * Search a library needed by dependency i in the order of ld.so: the
+ * DT_RPATH of the dependency and of the ones that led to it, skipping
+ * those with a DT_RUNPATH, when it has none itself; the caller search
+ * path, its DT_RUNPATH, then ld.so.cache and the default directories
+ * unless it forbids them
+ */
+static Path*
+search(Chain *c, uint32_t i, char *name)
+{
+	Obj *o, *exe;
+	Centry *ce;
+	uint32_t j;
+	Path *p;
+	char *s;
+
+	o = c->objs[i];
+	exe = c->objs[0];
+
+	if (strchr(name, '/') != NULL) {
+		s = strrchr(name, '/');
+		if (candidate(c, name, s - name, s + 1, imagepath(c, i)) <= 0)
+			return NULL;
+		p = lookuppath(c->l, c->buf);
+		return p != NULL && p->obj != NULL && compatible(p->obj, exe) ? p : NULL;
+	}
+
+	/* Like ld.so, the DT_RPATH of an object with a DT_RUNPATH is ignored */
+	if (o->runpath == NULL) {
+		for (j = i; ; j = c->d->deps[j].parent) {
+			if (c->objs[j]->runpath == NULL) {
+				p = searchdirs(c, c->objs[j]->rpath, name, imagepath(c, j));
+				if (p != NULL)
+					return p;
+			}
+			if (j == 0)
+				break;
+		}
+	}
+
+	p = searchdirs(c, c->l->libpath, name, "");
+	if (p != NULL)
+		return p;
+
+	p = searchdirs(c, o->runpath, name, imagepath(c, i));
+	if (p != NULL)
+		return p;
+
+	if (o->flags1 & DF_1_NODEFLIB)
+		return NULL;
+
+	for (ce = c->l->cnames[hashstr(name) & (Nbucket - 1)]; ce != NULL; ce = ce->next) {
+		if (strcmp(ce->name, name) != 0)
+			continue;
+		s = strrchr(ce->path, '/');
+		if (s == NULL || candidate(c, ce->path, s - ce->path, s + 1, "") <= 0)
+			continue;
+		p = lookuppath(c->l, c->buf);
+		if (p != NULL && p->obj != NULL && compatible(p->obj, exe))
+			return p;
+	}
+
+	for (j = 0; j < nelem(sysdirs); j++) {
+		p = searchdirs(c, sysdirs[j], name, "");
+		if (p != NULL)
+			return p;
+	}
+
+	return NULL;
+}
+
+/*
+ * Tell whether a library of this name is already in the closure, by
+ * the name it was needed as or by its DT_SONAME
+ */
+static int
+loaded(Chain *c, char *name)
+{
+	uint32_t i;
+
+	for (i = 1; i < c->d->ndep; i++) {
+		if (strcmp(c->d->deps[i].name, name) == 0)
+			return 1;
+		if (c->objs[i] != NULL && c->objs[i]->soname != NULL && strcmp(c->objs[i]->soname, name) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+adddep(Chain *c, char *name, Path *p, uint32_t parent)
+{
+	Dep *deps, *d;
+	Obj **objs;
+	uint32_t cap;
+
+	if (c->d->ndep == c->cap) {
+		cap = c->cap ? 2 * c->cap : 16;
+		deps = realloc(c->d->deps, cap * sizeof(deps[0]));
+		if (deps == NULL)
+			return -1;
+		c->d->deps = deps;
+		objs = realloc(c->objs, cap * sizeof(objs[0]));
+		if (objs == NULL)
+			return -1;
+		c->objs = objs;
+		c->cap = cap;
+	}
+
+	d = &c->d->deps[c->d->ndep];
+	d->name = name;
+	d->path = p != NULL ? p->path : NULL;
+	d->parent = parent;
+	d->dev = p != NULL && p->obj != NULL ? p->obj->dev : 0;
+	d->ino = p != NULL && p->obj != NULL ? p->obj->ino : 0;
+	c->objs[c->d->ndep] = p != NULL ? p->obj : NULL;
+	c->d->ndep++;
+
+	if (p == NULL)
+		c->d->nmissing++;
+
+	return 0;
+}
+
+/*
+ * Resolve the shared library dependency closure of a file, in the
+ * breadth-first order ld.so loads it. The first dependency is the
+ * file itself. Names and paths belong to the resolver and are valid
+ * until it is freed.
+ */
+int
+readelfdeps(Ldso *l, char *path, Deps *d)
+{
+	uint32_t i, j, k;
+	Chain c;
+	Path *p;
+	char *name;
+
+	memset(d, 0, sizeof(*d));
+	memset(&c, 0, sizeof(c));
+	c.l = l;
+	c.d = d;
+
+	d->path = path;
+
+	p = lookuppath(l, path);
+	if (p == NULL || p->obj == NULL || adddep(&c, p->path, p, 0) < 0) {
+		d->err = -1;
+		goto out;
+	}
+
+	for (i = 0; i < d->ndep; i++) {
+		if (c.objs[i] == NULL)
+			continue;
+		for (j = 0; j < c.objs[i]->nneeded; j++) {
+			name = c.objs[i]->needed[j];
+			if (loaded(&c, name))
+				continue;
+			p = search(&c, i, name);
+
+			/* The same file under another name */
+			for (k = 0; p != NULL && k < d->ndep; k++) {
+				if (c.objs[k] == p->obj)
+					break;
+			}
+			if (p != NULL && k < d->ndep)
+				continue;
+
+			if (adddep(&c, name, p, i) < 0) {
+				d->err = -1;
+				goto out;
+			}
+		}
+	}
+
+out:
+	free(c.objs);
+	free(c.buf);
+
+	return d->err;
+}
+
+void
+freeelfdeps(Deps *d)
+{
+	free(d->deps);
+	memset(d, 0, sizeof(*d));
+}
+
+typedef struct Worker Worker;
+
+struct Worker {
+	Job		*j;
+	int		id;
+};
+
+static void*
+worker(void *v)
+{
+	Worker *w;
+	uint32_t i;
+	Deps d;
+	Job *j;
+
+	w = v;
+	j = w->j;
+
+	while ((i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < j->npath) {
+		readelfdeps(j->l, j->paths[i], &d);
+		d.thread = w->id;
+		j->fn(j->arg, &d);
+		freeelfdeps(&d);
+	}
+
+	return NULL;
+}
+
+/*
+ * Resolve the dependency closures of a list of files on nthread
+ * threads, calling fn on each. The files share the libraries parsed
+ * by the resolver.
+ */
+int
+scanelfdeps(Ldso *l, char **paths, uint32_t npath, int nthread, void (*fn)(void*, Deps*), void *arg)
+{
+	Worker *w;
+	pthread_t *th;
+	Job j;
+	int i, n;
+
+	if (nthread <= 0)
+		nthread = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthread <= 0)
+		nthread = 1;
+	if ((uint32_t)nthread > npath)
+		nthread = npath > 0 ? npath : 1;
+
+	memset(&j, 0, sizeof(j));
+	j.l = l;
+	j.paths = paths;
+	j.npath = npath;
+	j.fn = fn;
+	j.arg = arg;
+
+	th = malloc(nthread * sizeof(th[0]));
+	w = malloc(nthread * sizeof(w[0]));
+	if (th == NULL || w == NULL) {
+		free(th);
+		free(w);
+		return -1;
+	}
+
+	/* The calling thread resolves files too */
+	for (n = 0; n < nthread - 1; n++) {
+		w[n].j = &j;
+		w[n].id = n + 1;
+		if (pthread_create(&th[n], NULL, worker, &w[n]) != 0)
+			break;
+	}
+	w[nthread-1].j = &j;
+	w[nthread-1].id = 0;
+	worker(&w[nthread-1]);
+	for (i = 0; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	free(th);
+	free(w);
+
+	return 0;
+}
@@ -0,0 +1,1433 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Dwsect Dwsect;
+typedef struct Linehdr Linehdr;
+typedef struct Linerow Linerow;
+typedef struct Linefile Linefile;
+typedef struct Lineseq Lineseq;
+typedef struct Lineacc Lineacc;
+typedef struct Linejob Linejob;
+
+enum {
+	Lineend = 0xffffffff,		/* File of the row ending a sequence */
+};
+
+/*
+ * DWARF section held during the open
+ */
+struct Dwsect {
+	uint8_t		*p;
+	uint64_t	size;
+	int		mapped;
+};
+
+/*
+ * Line number program header
+ */
+struct Linehdr {
+	uint16_t	version;
+	uint8_t		offsz;		/* 8 in the 64-bit DWARF format */
+	uint8_t		addrsz;		/* DWARF 5 only */
+	uint8_t		minlen;		/* Minimum instruction length */
+	uint8_t		maxops;		/* Operations per instruction */
+	int8_t		linebase;
+	uint8_t		linerange;
+	uint8_t		opbase;		/* First special opcode */
+	uint8_t		*oplens;	/* Operands of the standard opcodes */
+	uint8_t		*tables;	/* Directory and file tables */
+	uint8_t		*prog;		/* Line number program */
+	uint8_t		*end;
+};
+
+/*
+ * Row of the line table, covering up to the next row
+ */
+struct Linerow {
+	uint64_t	addr;
+	uint32_t	line;
+	uint32_t	file;		/* Lineend ends a sequence */
+};
+
+struct Linefile {
+	char		*name;
+	char		*dir;		/* NULL when unknown or name is absolute */
+};
+
+/*
+ * Sequence of rows, with nondecreasing addresses
+ */
+struct Lineseq {
+	uint64_t	lo;
+	uint64_t	hi;
+	uint32_t	first;		/* First row */
+	uint32_t	n;
+};
+
+/*
+ * Line table of a compilation unit
+ */
+struct Lineunit {
+	Linerow		*rows;		/* Sequences, by address */
+	uint32_t	nrow;
+	Linefile	*files;
+	uint32_t	nfile;
+	uint32_t	fbase;		/* Index of the first file: 1 before DWARF 5 */
+};
+
+/*
+ * Address range of a compilation unit
+ */
+struct Linerange {
+	uint64_t	lo;
+	uint64_t	hi;
+	uint32_t	unit;
+};
+
+/*
+ * Rows and sequences emitted by a line number program
+ */
+struct Lineacc {
+	int		keep;		/* Keep the rows, not only the sequences */
+	int		nomem;
+	int		inseq;
+	uint64_t	lo;		/* Start of the current sequence */
+	uint32_t	first;		/* First row of the current sequence */
+	Linerow		*rows;
+	uint32_t	nrow;
+	uint32_t	rowcap;
+	Lineseq		*seqs;
+	uint32_t	nseq;
+	uint32_t	seqcap;
+};
+
+/*
+ * Compilation units to decode in a batch
+ */
+struct Linejob {
+	Linetab		*lt;
+	uint32_t	*todo;
+	uint32_t	n;
+	uint32_t	next;
+	int		err;
+};
+
+/* Published for units whose program is corrupt */
+static Lineunit badunit;
+
+/*
+ * Get a NUL-terminated string of a string section
+ */
+static char*
+sectstr(uint8_t *sect, uint64_t size, uint64_t off)
+{
+	if (sect == NULL || off >= size)
+		return NULL;
+
+	if (memchr(sect + off, '\0', size - off) == NULL)
+		return NULL;
+
+	return (char*)sect + off;
+}
+
+/*
+ * Read an attribute value. String forms resolve to a string, or NULL
+ * when it can't be resolved, like the indexed ones; the others to
+ * their value, if any.
+ */
+static int
+readform(Linetab *lt, Dwbuf *b, uint64_t form, Linehdr *h, uint64_t *val, char **s)
+{
+	uint64_t n;
+
+	*val = 0;
+	*s = NULL;
+
+	switch (form) {
+	case DW_FORM_flag_present:
+	case DW_FORM_implicit_const:
+		break;
+	case DW_FORM_data1:
+	case DW_FORM_ref1:
+	case DW_FORM_flag:
+	case DW_FORM_strx1:
+	case DW_FORM_addrx1:
+		*val = getdwfixed(b, 1);
+		break;
+	case DW_FORM_data2:
+	case DW_FORM_ref2:
+	case DW_FORM_strx2:
+	case DW_FORM_addrx2:
+		*val = getdwfixed(b, 2);
+		break;
+	case DW_FORM_strx3:
+	case DW_FORM_addrx3:
+		getdwfixed(b, 3);
+		break;
+	case DW_FORM_data4:
+	case DW_FORM_ref4:
+	case DW_FORM_ref_sup4:
+	case DW_FORM_strx4:
+	case DW_FORM_addrx4:
+		*val = getdwfixed(b, 4);
+		break;
+	case DW_FORM_data8:
+	case DW_FORM_ref8:
+	case DW_FORM_ref_sig8:
+	case DW_FORM_ref_sup8:
+		*val = getdwfixed(b, 8);
+		break;
+	case DW_FORM_data16:
+		getdwfixed(b, 16);
+		break;
+	case DW_FORM_sdata:
+		*val = getdwsleb(b);
+		break;
+	case DW_FORM_udata:
+	case DW_FORM_ref_udata:
+	case DW_FORM_strx:
+	case DW_FORM_addrx:
+	case DW_FORM_loclistx:
+	case DW_FORM_rnglistx:
+	case DW_FORM_GNU_addr_index:
+	case DW_FORM_GNU_str_index:
+		*val = getdwuleb(b);
+		break;
+	case DW_FORM_addr:
+		*val = getdwfixed(b, h->addrsz);
+		break;
+	case DW_FORM_ref_addr:
+		*val = getdwfixed(b, h->version == 2 ? h->addrsz : h->offsz);
+		break;
+	case DW_FORM_sec_offset:
+	case DW_FORM_strp_sup:
+	case DW_FORM_GNU_ref_alt:
+	case DW_FORM_GNU_strp_alt:
+		*val = getdwfixed(b, h->offsz);
+		break;
+	case DW_FORM_strp:
+		*val = getdwfixed(b, h->offsz);
+		*s = sectstr(lt->str, lt->strsize, *val);
+		break;
+	case DW_FORM_line_strp:
+		*val = getdwfixed(b, h->offsz);
+		*s = sectstr(lt->linestr, lt->linestrsize, *val);
+		break;
+	case DW_FORM_string:
+		*s = getdwcstr(b);
+		break;
+	case DW_FORM_block1:
+	case DW_FORM_block2:
+	case DW_FORM_block4:
+	case DW_FORM_block:
+	case DW_FORM_exprloc:
+		if (form == DW_FORM_block1)
+			n = getdwfixed(b, 1);
+		else if (form == DW_FORM_block2)
+			n = getdwfixed(b, 2);
+		else if (form == DW_FORM_block4)
+			n = getdwfixed(b, 4);
+		else
+			n = getdwuleb(b);
+		if (n > (uint64_t)(b->end - b->p))
+			return -1;
+		b->p += n;
+		break;
+	case DW_FORM_indirect:
+		return readform(lt, b, getdwuleb(b), h, val, s);
+	default:
+		return -1;
+	}
+
+	return b->err ? -1 : 0;
+}
+
+/*
+ * Read the header of the line number program at off
+ */
+static int
+readlinehdr(Linetab *lt, uint64_t off, Linehdr *h)
+{
+	uint64_t hdrlen;
+	Dwbuf b;
+
+	memset(h, 0, sizeof(*h));
+
+	b.p = lt->line + off;
+	b.end = lt->line + lt->linesize;
+	b.fp = lt->fp;
+	b.err = 0;
+
+	h->end = getdwunitlen(&b, &h->offsz);
+	if (h->end == NULL)
+		return -1;
+	b.end = h->end;
+
+	h->version = getdwfixed(&b, 2);
+	if (h->version < 2 || h->version > 5)
+		return -1;
+
+	if (h->version >= 5) {
+		h->addrsz = getdwfixed(&b, 1);
+		getdwfixed(&b, 1);
+	}
+
+	hdrlen = getdwfixed(&b, h->offsz);
+	if (b.err || hdrlen > (uint64_t)(b.end - b.p))
+		return -1;
+	h->prog = b.p + hdrlen;
+
+	h->minlen = getdwfixed(&b, 1);
+	h->maxops = h->version >= 4 ? getdwfixed(&b, 1) : 1;
+	getdwfixed(&b, 1);
+	h->linebase = (int8_t)getdwfixed(&b, 1);
+	h->linerange = getdwfixed(&b, 1);
+	h->opbase = getdwfixed(&b, 1);
+
+	if (b.err || h->linerange == 0 || h->maxops == 0 || h->opbase == 0)
+		return -1;
+
+	h->oplens = b.p;
+	if (h->opbase - 1 > h->prog - b.p)
+		return -1;
+	h->tables = b.p + h->opbase - 1;
+
+	return 0;
+}
+
+/*
+ * Read the directory and file tables of DWARF 2 to 4: NUL-terminated
+ * lists of names, the files with a directory index and two sizes
+ */
+static int
+readfiles4(Dwbuf *b, Lineunit *u)
+{
+	char **dirs, **p, *name;
+	uint32_t ndir, nfile;
+	uint64_t d;
+	Linefile *f;
+
+	dirs = NULL;
+	ndir = 0;
+	for (;;) {
+		name = getdwcstr(b);
+		if (name == NULL)
+			goto err;
+		if (*name == '\0')
+			break;
+		if ((ndir & (ndir - 1)) == 0) {
+			p = realloc(dirs, (ndir ? 2 * ndir : 1) * sizeof(dirs[0]));
+			if (p == NULL)
+				goto err;
+			dirs = p;
+		}
+		dirs[ndir++] = name;
+	}
+
+	nfile = 0;
+	for (;;) {
+		name = getdwcstr(b);
+		if (name == NULL)
+			goto err;
+		if (*name == '\0')
+			break;
+		d = getdwuleb(b);
+		getdwuleb(b);
+		getdwuleb(b);
+		if (b->err)
+			goto err;
+		if ((nfile & (nfile - 1)) == 0) {
+			f = realloc(u->files, (nfile ? 2 * nfile : 1) * sizeof(u->files[0]));
+			if (f == NULL)
+				goto err;
+			u->files = f;
+		}
+		f = &u->files[nfile++];
+		f->name = name;
+
+		/* Directory 0 is the one of the compilation, not listed */
+		f->dir = NULL;
+		if (*name != '/' && d > 0 && d <= ndir)
+			f->dir = dirs[d-1];
+	}
+	u->nfile = nfile;
+	u->fbase = 1;
+
+	free(dirs);
+	return 0;
+
+err:
+	free(dirs);
+	return -1;
+}
+
+/*
+ * Read an entry of a DWARF 5 directory or file table, laid out by its
+ * entry format
+ */
+static int
+readentry(Linetab *lt, Dwbuf *b, uint8_t *fmt, uint8_t nfmt, Linehdr *h, char **name, uint64_t *dir)
+{
+	uint64_t type, form, val;
+	uint8_t i;
+	Dwbuf f;
+	char *s;
+
+	f.p = fmt;
+	f.end = h->prog;
+	f.fp = lt->fp;
+	f.err = 0;
+
+	*name = NULL;
+	*dir = 0;
+	for (i = 0; i < nfmt; i++) {
+		type = getdwuleb(&f);
+		form = getdwuleb(&f);
+		if (f.err || readform(lt, b, form, h, &val, &s) < 0)
+			return -1;
+		if (type == DW_LNCT_path)
+			*name = s;
+		else if (type == DW_LNCT_directory_index)
+			*dir = val;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the directory and file tables of DWARF 5, described by entry
+ * formats. Directory 0 is the one of the compilation, and file 0 its
+ * primary source file.
+ */
+static int
+readfiles5(Linetab *lt, Dwbuf *b, Linehdr *h, Lineunit *u)
+{
+	uint64_t ndir, nfile, i, d;
+	uint8_t *fmt, nfmt;
+	char **dirs, *name;
+	Linefile *f;
+
+	dirs = NULL;
+
+	nfmt = getdwfixed(b, 1);
+	fmt = b->p;
+	for (i = 0; i < 2 * (uint64_t)nfmt; i++)
+		getdwuleb(b);
+	ndir = getdwuleb(b);
+	if (b->err || ndir > (uint64_t)(b->end - b->p))
+		goto err;
+
+	dirs = malloc((ndir + 1) * sizeof(dirs[0]));
+	if (dirs == NULL)
+		goto err;
+	for (i = 0; i < ndir; i++) {
+		if (readentry(lt, b, fmt, nfmt, h, &dirs[i], &d) < 0)
+			goto err;
+	}
+
+	nfmt = getdwfixed(b, 1);
+	fmt = b->p;
+	for (i = 0; i < 2 * (uint64_t)nfmt; i++)
+		getdwuleb(b);
+	nfile = getdwuleb(b);
+	if (b->err || nfile > (uint64_t)(b->end - b->p))
+		goto err;
+
+	u->files = malloc((nfile + 1) * sizeof(u->files[0]));
+	if (u->files == NULL)
+		goto err;
+	for (i = 0; i < nfile; i++) {
+		if (readentry(lt, b, fmt, nfmt, h, &name, &d) < 0)
+			goto err;
+		f = &u->files[i];
+		f->name = name;
+		f->dir = NULL;
+		if (name != NULL && *name != '/' && d < ndir)
+			f->dir = dirs[d];
+	}
+	u->nfile = nfile;
+	u->fbase = 0;
+
+	free(dirs);
+	return 0;
+
+err:
+	free(dirs);
+	return -1;
+}
+
+/*
+ * Add a row to the current sequence. Rows are kept only where the
+ * position changes, and the last row at an address wins.
+ */
+static void
+emitrow(Lineacc *a, uint64_t addr, uint32_t file, uint32_t line, int end)
+{
+	Linerow *r;
+	Lineseq *s;
+
+	if (a->nomem)
+		return;
+
+	if (!a->inseq) {
+		a->inseq = 1;
+		a->lo = addr;
+		a->first = a->nrow;
+	}
+
+	if (a->keep) {
+		r = a->nrow > a->first ? &a->rows[a->nrow-1] : NULL;
+		if (!end && r != NULL && r->addr == addr) {
+			r->file = file;
+			r->line = line;
+			goto seq;
+		}
+		if (!end && r != NULL && r->file == file && r->line == line)
+			goto seq;
+		if (a->nrow == a->rowcap) {
+			a->rowcap = a->rowcap ? 2 * a->rowcap : 64;
+			r = realloc(a->rows, a->rowcap * sizeof(a->rows[0]));
+			if (r == NULL) {
+				a->nomem = 1;
+				return;
+			}
+			a->rows = r;
+		}
+		r = &a->rows[a->nrow++];
+		r->addr = addr;
+		r->file = end ? Lineend : file;
+		r->line = line;
+	}
+
+seq:
+	if (!end)
+		return;
+
+	a->inseq = 0;
+
+	/* Empty sequences are dropped */
+	if (addr <= a->lo) {
+		a->nrow = a->first;
+		return;
+	}
+
+	if (a->nseq == a->seqcap) {
+		a->seqcap = a->seqcap ? 2 * a->seqcap : 16;
+		s = realloc(a->seqs, a->seqcap * sizeof(a->seqs[0]));
+		if (s == NULL) {
+			a->nomem = 1;
+			return;
+		}
+		a->seqs = s;
+	}
+	s = &a->seqs[a->nseq++];
+	s->lo = a->lo;
+	s->hi = addr;
+	s->first = a->first;
+	s->n = a->nrow - a->first;
+}
+
+/*
+ * Run a line number program, emitting its rows
+ */
+static int
+runprogram(Linetab *lt, Linehdr *h, Lineacc *a)
+{
+	uint64_t addr, opidx, adv, len, n, j;
+	uint32_t file, line;
+	uint8_t op, adj;
+	Dwbuf b, e;
+
+	b.p = h->prog;
+	b.end = h->end;
+	b.fp = lt->fp;
+	b.err = 0;
+
+	addr = 0;
+	opidx = 0;
+	file = 1;
+	line = 1;
+
+	while (b.p < b.end) {
+		op = getdwfixed(&b, 1);
+		adv = 0;
+
+		if (op >= h->opbase) {
+			adj = op - h->opbase;
+			adv = adj / h->linerange;
+			line += h->linebase + adj % h->linerange;
+		} else {
+			switch (op) {
+			case 0:
+				len = getdwuleb(&b);
+				if (b.err || len == 0 || len > (uint64_t)(b.end - b.p))
+					return -1;
+				e = b;
+				e.end = b.p + len;
+				b.p += len;
+				switch (getdwfixed(&e, 1)) {
+				case DW_LNE_end_sequence:
+					emitrow(a, addr, file, line, 1);
+					addr = 0;
+					opidx = 0;
+					file = 1;
+					line = 1;
+					break;
+				case DW_LNE_set_address:
+					if (len - 1 != 4 && len - 1 != 8)
+						return -1;
+					addr = getdwfixed(&e, len - 1);
+					opidx = 0;
+					break;
+				}
+				continue;
+			case DW_LNS_copy:
+				break;
+			case DW_LNS_advance_pc:
+				adv = getdwuleb(&b);
+				break;
+			case DW_LNS_advance_line:
+				line += getdwsleb(&b);
+				continue;
+			case DW_LNS_set_file:
+				file = getdwuleb(&b);
+				continue;
+			case DW_LNS_const_add_pc:
+				adv = (255 - h->opbase) / h->linerange;
+				break;
+			case DW_LNS_fixed_advance_pc:
+				addr += getdwfixed(&b, 2);
+				opidx = 0;
+				continue;
+			default:
+				/* Skip the operands of the others */
+				n = h->oplens[op-1];
+				for (j = 0; j < n; j++)
+					getdwuleb(&b);
+				continue;
+			}
+		}
+
+		if (h->maxops == 1) {
+			addr += h->minlen * adv;
+		} else {
+			addr += h->minlen * ((opidx + adv) / h->maxops);
+			opidx = (opidx + adv) % h->maxops;
+		}
+
+		/* Special opcodes and DW_LNS_copy append a row */
+		if (op >= h->opbase || op == DW_LNS_copy)
+			emitrow(a, addr, file, line, 0);
+	}
+
+	if (b.err)
+		return -1;
+
+	/* Rows of an unterminated sequence are dropped */
+	if (a->inseq)
+		a->nrow = a->first;
+
+	return 0;
+}
+
+static int
+seqcmp(const void *a, const void *b)
+{
+	const Lineseq *x, *y;
+
+	x = a;
+	y = b;
+
+	if (x->lo != y->lo)
+		return x->lo < y->lo ? -1 : 1;
+
+	return x->first < y->first ? -1 : x->first > y->first;
+}
+
+/*
+ * Lay out the rows by address: the sequences are sorted, and each
+ * one is already in order
+ */
+static int
+sortrows(Lineacc *a)
+{
+	Linerow *rows;
+	uint32_t i, n;
+
+	for (i = 1; i < a->nseq; i++) {
+		if (a->seqs[i].lo < a->seqs[i-1].hi)
+			break;
+	}
+	if (i == a->nseq)
+		return 0;
+
+	qsort(a->seqs, a->nseq, sizeof(a->seqs[0]), seqcmp);
+
+	rows = malloc((a->nrow + 1) * sizeof(rows[0]));
+	if (rows == NULL)
+		return -1;
+
+	n = 0;
+	for (i = 0; i < a->nseq; i++) {
+		memcpy(rows + n, a->rows + a->seqs[i].first, a->seqs[i].n * sizeof(rows[0]));
+		n += a->seqs[i].n;
+	}
+
+	free(a->rows);
+	a->rows = rows;
+	a->nrow = n;
+
+	return 0;
+}
+
+/*
+ * Copy a unit decoded on the heap to the arena of the handle, in one
+ * block
+ */
+static Lineunit*
+keepunit(Linetab *lt, Lineunit *t)
+{
+	Lineunit *u;
+
+	u = elfalloc(lt->fp, sizeof(*u) + (uint64_t)t->nrow * sizeof(t->rows[0]) + (uint64_t)t->nfile * sizeof(t->files[0]));
+	if (u == NULL)
+		return NULL;
+
+	*u = *t;
+	u->rows = (Linerow*)(u + 1);
+	u->files = (Linefile*)(u->rows + t->nrow);
+	if (t->nrow > 0)
+		memcpy(u->rows, t->rows, t->nrow * sizeof(t->rows[0]));
+	if (t->nfile > 0)
+		memcpy(u->files, t->files, t->nfile * sizeof(t->files[0]));
+
+	return u;
+}
+
+/*
+ * Decode the line number program of a unit. A corrupt program
+ * decodes to no rows. Returns NULL when out of memory.
+ */
+static Lineunit*
+decodeunit(Linetab *lt, uint32_t i)
+{
+	Lineunit t, *u;
+	Linehdr h;
+	Lineacc a;
+	Dwbuf b;
+	int r;
+
+	if (readlinehdr(lt, lt->unitoff[i], &h) < 0)
+		return &badunit;
+
+	memset(&t, 0, sizeof(t));
+
+	b.p = h.tables;
+	b.end = h.prog;
+	b.fp = lt->fp;
+	b.err = 0;
+
+	if (h.version >= 5)
+		r = readfiles5(lt, &b, &h, &t);
+	else
+		r = readfiles4(&b, &t);
+	if (r < 0) {
+		free(t.files);
+		return &badunit;
+	}
+
+	memset(&a, 0, sizeof(a));
+	a.keep = 1;
+
+	if (runprogram(lt, &h, &a) < 0 || a.nomem || sortrows(&a) < 0) {
+		r = a.nomem;
+		free(a.rows);
+		free(a.seqs);
+		free(t.files);
+		return r ? NULL : &badunit;
+	}
+	free(a.seqs);
+
+	t.rows = a.rows;
+	t.nrow = a.nrow;
+
+	/* Rows and files grow on the heap, and are kept at their size */
+	u = keepunit(lt, &t);
+
+	free(t.rows);
+	free(t.files);
+
+	return u;
+}
+
+/*
+ * Get the decoded line table of a unit, decoding it on first use.
+ * Units decoded by several threads at once are published once.
+ */
+static Lineunit*
+getunit(Linetab *lt, uint32_t i)
+{
+	Lineunit *u, *old;
+
+	u = __atomic_load_n(&lt->units[i], __ATOMIC_ACQUIRE);
+	if (u != NULL)
+		return u;
+
+	u = decodeunit(lt, i);
+	if (u == NULL)
+		return NULL;
+
+	/* The unit of a thread losing the race stays in the arena */
+	old = NULL;
+	if (!__atomic_compare_exchange_n(&lt->units[i], &old, u, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		u = old;
+
+	return u;
+}
+
+/*
+ * Get the unit of the line number program at off
+ */
+static int64_t
+unitindex(Linetab *lt, uint64_t off)
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = lt->nunit;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (lt->unitoff[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == lt->nunit || lt->unitoff[lo] != off)
+		return -1;
+
+	return lo;
+}
+
+static int
+addrange(Linetab *lt, uint64_t lo, uint64_t hi, uint32_t unit, uint32_t *cap)
+{
+	Linerange *r;
+
+	if (lt->nrange == *cap) {
+		*cap = *cap ? 2 * *cap : 64;
+		r = realloc(lt->ranges, *cap * sizeof(lt->ranges[0]));
+		if (r == NULL)
+			return -1;
+		lt->ranges = r;
+	}
+
+	r = &lt->ranges[lt->nrange++];
+	r->lo = lo;
+	r->hi = hi;
+	r->unit = unit;
+
+	return 0;
+}
+
+/*
+ * Get the DW_AT_stmt_list of the compilation unit at off in
+ * .debug_info: the attributes of its first entry are walked with
+ * their abbreviation
+ */
+static int
+stmtlist(Linetab *lt, Dwsect *info, Dwsect *abbrev, uint64_t off, uint64_t *stmt)
+{
+	uint64_t aoff, code, name, form, val;
+	Linehdr h;
+	Dwbuf b, ab;
+	uint8_t ut;
+	char *s;
+
+	if (off >= info->size)
+		return -1;
+
+	memset(&h, 0, sizeof(h));
+
+	b.p = info->p + off;
+	b.end = info->p + info->size;
+	b.fp = lt->fp;
+	b.err = 0;
+
+	b.end = getdwunitlen(&b, &h.offsz);
+	if (b.end == NULL)
+		return -1;
+
+	h.version = getdwfixed(&b, 2);
+	if (h.version < 2 || h.version > 5)
+		return -1;
+
+	if (h.version >= 5) {
+		ut = getdwfixed(&b, 1);
+		h.addrsz = getdwfixed(&b, 1);
+		aoff = getdwfixed(&b, h.offsz);
+		if (ut == DW_UT_skeleton || ut == DW_UT_split_compile)
+			getdwfixed(&b, 8);
+		else if (ut == DW_UT_type || ut == DW_UT_split_type)
+			return -1;
+	} else {
+		aoff = getdwfixed(&b, h.offsz);
+		h.addrsz = getdwfixed(&b, 1);
+	}
+
+	code = getdwuleb(&b);
+	if (b.err || code == 0 || aoff >= abbrev->size)
+		return -1;
+
+	ab.p = abbrev->p + aoff;
+	ab.end = abbrev->p + abbrev->size;
+	ab.fp = lt->fp;
+	ab.err = 0;
+
+	/* Find the abbreviation, most often the first */
+	for (;;) {
+		val = getdwuleb(&ab);
+		if (ab.err || val == 0)
+			return -1;
+		if (val == code)
+			break;
+		getdwuleb(&ab);
+		getdwfixed(&ab, 1);
+		do {
+			name = getdwuleb(&ab);
+			form = getdwuleb(&ab);
+			if (form == DW_FORM_implicit_const)
+				getdwsleb(&ab);
+		} while (!ab.err && (name != 0 || form != 0));
+	}
+	getdwuleb(&ab);
+	getdwfixed(&ab, 1);
+
+	for (;;) {
+		name = getdwuleb(&ab);
+		form = getdwuleb(&ab);
+		if (ab.err || (name == 0 && form == 0))
+			return -1;
+		if (form == DW_FORM_implicit_const)
+			getdwsleb(&ab);
+		if (name == DW_AT_stmt_list) {
+			if (form != DW_FORM_sec_offset && form != DW_FORM_data4 && form != DW_FORM_data8)
+				return -1;
+			*stmt = getdwfixed(&b, form == DW_FORM_sec_offset ? h.offsz : form == DW_FORM_data4 ? 4 : 8);
+			return b.err ? -1 : 0;
+		}
+		if (readform(lt, &b, form, &h, &val, &s) < 0)
+			return -1;
+	}
+}
+
+/*
+ * Index the address ranges of .debug_aranges by unit. Units they
+ * cover are marked in covered.
+ */
+static int
+readaranges(Linetab *lt, Dwsect *ar, Dwsect *info, Dwsect *abbrev, uint8_t *covered, uint32_t *cap)
+{
+	uint64_t cuoff, lastcu, stmt, lo, len, tuple, pad;
+	uint8_t *set, offsz, asz, segsz;
+	int64_t unit;
+	Dwbuf b;
+
+	b.p = ar->p;
+	b.end = ar->p + ar->size;
+	b.fp = lt->fp;
+	b.err = 0;
+
+	lastcu = ~(uint64_t)0;
+	unit = -1;
+
+	while (b.p < ar->p + ar->size) {
+		set = b.p;
+		b.end = ar->p + ar->size;
+		b.end = getdwunitlen(&b, &offsz);
+		if (b.end == NULL)
+			break;
+
+		if (getdwfixed(&b, 2) != 2)
+			goto next;
+		cuoff = getdwfixed(&b, offsz);
+		asz = getdwfixed(&b, 1);
+		segsz = getdwfixed(&b, 1);
+		if (asz != 4 && asz != 8)
+			goto next;
+
+		/* Tuples are aligned to their size from the set */
+		tuple = 2 * asz + segsz;
+		pad = (tuple - (b.p - set) % tuple) % tuple;
+		if (pad > (uint64_t)(b.end - b.p))
+			goto next;
+		b.p += pad;
+
+		if (cuoff != lastcu) {
+			lastcu = cuoff;
+			unit = -1;
+			if (stmtlist(lt, info, abbrev, cuoff, &stmt) == 0)
+				unit = unitindex(lt, stmt);
+		}
+		if (unit < 0)
+			goto next;
+
+		for (;;) {
+			getdwfixed(&b, segsz);
+			lo = getdwfixed(&b, asz);
+			len = getdwfixed(&b, asz);
+			if (b.err || (lo == 0 && len == 0))
+				break;
+			if (len == 0 || lo + len < lo)
+				continue;
+			if (addrange(lt, lo, lo + len, unit, cap) < 0)
+				return -1;
+			covered[unit] = 1;
+		}
+
+	next:
+		b.p = b.end;
+		b.err = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Index the address ranges of a unit .debug_aranges doesn't cover,
+ * from the sequences of its program
+ */
+static int
+scanunit(Linetab *lt, uint32_t i, uint32_t *cap)
+{
+	Linehdr h;
+	Lineacc a;
+	uint32_t j;
+	int r;
+
+	if (readlinehdr(lt, lt->unitoff[i], &h) < 0)
+		return 0;
+
+	memset(&a, 0, sizeof(a));
+
+	r = 0;
+	if (runprogram(lt, &h, &a) == 0 && !a.nomem) {
+		for (j = 0; j < a.nseq && r == 0; j++)
+			r = addrange(lt, a.seqs[j].lo, a.seqs[j].hi, i, cap);
+	}
+	if (a.nomem)
+		r = -1;
+
+	free(a.seqs);
+
+	return r;
+}
+
+static int
+rangecmp(const void *a, const void *b)
+{
+	const Linerange *x, *y;
+
+	x = a;
+	y = b;
+
+	if (x->lo != y->lo)
+		return x->lo < y->lo ? -1 : 1;
+
+	return x->unit < y->unit ? -1 : x->unit > y->unit;
+}
+
+/*
+ * Get a DWARF section, decompressed. Sections kept by the table are
+ * allocated from the arena of the handle, those held during the open
+ * on the heap, whatever the allocator of the handle.
+ */
+static int
+getdwsect(FILE *f, Fhdr *fp, char *name, int keep, Dwsect *d)
+{
+	Elfalloc a;
+	uint8_t *sect;
+	int mapped;
+	Shdr *sh;
+
+	memset(d, 0, sizeof(*d));
+
+	sh = elfshdrname(fp, name);
+	if (sh == NULL || sh->type == SHT_NOBITS || sh->size == 0)
+		return -1;
+
+	if (sh->flags & SHF_COMPRESSED) {
+		sect = getsection(f, sh, fp, &mapped);
+		if (sect == NULL)
+			return -1;
+		keepallocator(fp, &a);
+		d->p = unpacksection(sect, sh->size, &d->size, 1, keep ? &a : NULL, fp);
+		putsection(sect, mapped);
+	} else if (keep) {
+		d->p = keepsection(f, sh, fp);
+		d->size = sh->size;
+	} else {
+		d->p = getsection(f, sh, fp, &d->mapped);
+		d->size = sh->size;
+	}
+
+	return d->p != NULL ? 0 : -1;
+}
+
+static void
+putdwsect(Dwsect *d)
+{
+	if (d->p != NULL)
+		putsection(d->p, d->mapped);
+}
+
+/*
+ * Decode the line number programs
+ */
+static int
+readlines(FILE *f, Linetab *lt, Fhdr *fp)
+{
+	Dwsect line, linestr, str, ar, info, abbrev;
+	uint32_t cap, i, n;
+	uint8_t *covered;
+	uint8_t offsz;
+	uint64_t *off, *p;
+	Linerange *ranges;
+	Dwbuf b;
+	int r;
+
+	memset(lt, 0, sizeof(*lt));
+	lt->fp = fp;
+
+	if (getdwsect(f, fp, ".debug_line", 1, &line) < 0) {
+		fprintf(stderr, "line number section not found\n");
+		return -1;
+	}
+	lt->line = line.p;
+	lt->linesize = line.size;
+
+	if (getdwsect(f, fp, ".debug_line_str", 1, &linestr) == 0) {
+		lt->linestr = linestr.p;
+		lt->linestrsize = linestr.size;
+	}
+
+	if (getdwsect(f, fp, ".debug_str", 1, &str) == 0) {
+		lt->str = str.p;
+		lt->strsize = str.size;
+	}
+
+	/* Units follow each other */
+	b.p = lt->line;
+	b.end = lt->line + lt->linesize;
+	b.fp = fp;
+	b.err = 0;
+	off = NULL;
+	n = 0;
+	while (b.p < b.end) {
+		if ((n & (n - 1)) == 0) {
+			p = realloc(off, (n ? 2 * n : 1) * sizeof(off[0]));
+			if (p == NULL) {
+				free(off);
+				goto err;
+			}
+			off = p;
+		}
+		off[n] = b.p - lt->line;
+		b.p = getdwunitlen(&b, &offsz);
+		if (b.p == NULL)
+			break;
+		n++;
+	}
+	lt->nunit = n;
+
+	lt->unitoff = elfdup(fp, off, (uint64_t)n * sizeof(off[0]));
+	free(off);
+	if (lt->unitoff == NULL)
+		goto err;
+
+	lt->units = elfalloc(fp, (uint64_t)(n + 1) * sizeof(lt->units[0]));
+	if (lt->units == NULL)
+		goto err;
+	memset(lt->units, 0, (uint64_t)(n + 1) * sizeof(lt->units[0]));
+
+	covered = calloc(n + 1, 1);
+	if (covered == NULL)
+		goto err;
+
+	cap = 0;
+	r = 0;
+	if (getdwsect(f, fp, ".debug_aranges", 0, &ar) == 0) {
+		if (getdwsect(f, fp, ".debug_info", 0, &info) == 0) {
+			if (getdwsect(f, fp, ".debug_abbrev", 0, &abbrev) == 0) {
+				r = readaranges(lt, &ar, &info, &abbrev, covered, &cap);
+				putdwsect(&abbrev);
+			}
+			putdwsect(&info);
+		}
+		putdwsect(&ar);
+	}
+	if (r < 0) {
+		free(covered);
+		goto err;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!covered[i] && scanunit(lt, i, &cap) < 0) {
+			free(covered);
+			goto err;
+		}
+	}
+	free(covered);
+
+	qsort(lt->ranges, lt->nrange, sizeof(lt->ranges[0]), rangecmp);
+
+	/* Ranges may overlap: lookups walk back while one could reach */
+	lt->reach = elfalloc(fp, (uint64_t)(lt->nrange + 1) * sizeof(lt->reach[0]));
+	if (lt->reach == NULL)
+		goto err;
+	for (i = 0; i < lt->nrange; i++) {
+		lt->reach[i] = lt->ranges[i].hi;
+		if (i > 0 && lt->reach[i-1] > lt->reach[i])
+			lt->reach[i] = lt->reach[i-1];
+	}
+
+	/* The ranges grow on the heap, and are kept at their size */
+	ranges = elfdup(fp, lt->ranges, (uint64_t)lt->nrange * sizeof(lt->ranges[0]));
+	if (ranges == NULL)
+		goto err;
+	free(lt->ranges);
+	lt->ranges = ranges;
+
+	return 0;
+
+err:
+	free(lt->ranges);
+	freeelflines(lt);
+	return -1;
+}
+
+/*
+ * Read the line number programs of .debug_line, and index the
+ * addresses of their compilation units. The programs are decoded
+ * on the first lookup into their unit, so only the units sampled
+ * cost memory. The handle keeps the table for the reads that follow;
+ * it is allocated from the arena of the handle, and lives as long as
+ * it.
+ *
+ * Units are found by address through .debug_aranges; the programs
+ * of the units it doesn't list, or of all of them without it, are
+ * run once to index their sequences.
+ */
+int
+readelflines(FILE *f, Linetab *lt, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Tlines, 0, 0, lt, sizeof(*lt));
+	if (r <= 0)
+		return r;
+
+	r = readlines(f, lt, fp);
+
+	return keepelftab(fp, Tlines, 0, 0, r, lt, sizeof(*lt));
+}
+
+/*
+ * Get the unit of an address, or -1
+ */
+static int64_t
+findunit(Linetab *lt, uint64_t addr)
+{
+	uint32_t lo, hi, mid;
+	int64_t i;
+
+	lo = 0;
+	hi = lt->nrange;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (lt->ranges[mid].lo <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = (int64_t)lo - 1; i >= 0 && lt->reach[i] > addr; i--) {
+		if (addr < lt->ranges[i].hi)
+			return lt->ranges[i].unit;
+	}
+
+	return -1;
+}
+
+/*
+ * Find the row of an address in a decoded unit
+ */
+static int
+findrow(Lineunit *u, uint64_t addr, Lineloc *loc)
+{
+	uint32_t lo, hi, mid, f;
+	Linerow *r;
+
+	lo = 0;
+	hi = u->nrow;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (u->rows[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0 || u->rows[lo-1].file == Lineend)
+		return -1;
+
+	r = &u->rows[lo-1];
+	loc->line = r->line;
+
+	f = r->file - u->fbase;
+	if (r->file >= u->fbase && f < u->nfile) {
+		loc->file = u->files[f].name;
+		loc->dir = u->files[f].dir;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the source position of an address, as a link-time address of
+ * the file: the file name, its directory when it is relative and
+ * known, and the line
+ */
+int
+lookupelfline(Linetab *lt, uint64_t addr, Lineloc *loc)
+{
+	Lineunit *u;
+	int64_t i;
+
+	memset(loc, 0, sizeof(*loc));
+
+	i = findunit(lt, addr);
+	if (i < 0)
+		return -1;
+
+	u = getunit(lt, i);
+	if (u == NULL)
+		return -1;
+
+	return findrow(u, addr, loc);
+}
+
+static void*
+lineworker(void *v)
+{
+	Linejob *j;
+	uint32_t i;
+
+	j = v;
+
+	while ((i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < j->n) {
+		if (getunit(j->lt, j->todo[i]) == NULL)
+			__atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+ * Get the source positions of n addresses. The units they fall in
+ * that aren't decoded yet are decoded first, on up to nthread
+ * threads; 0 uses one per processor. Addresses without a position
+ * get a zeroed Lineloc. Returns the number of addresses with one.
+ */
+int64_t
+lookupelflines(Linetab *lt, uint64_t *addrs, uint32_t n, Lineloc *locs, int nthread)
+{
+	uint8_t *seen;
+	pthread_t *th;
+	int64_t *unit, found;
+	Linejob j;
+	uint32_t i;
+	int k, t;
+
+	unit = malloc((n + 1) * sizeof(unit[0]));
+	seen = calloc(lt->nunit + 1, 1);
+	j.todo = malloc((lt->nunit + 1) * sizeof(j.todo[0]));
+	if (unit == NULL || seen == NULL || j.todo == NULL) {
+		found = -1;
+		goto out;
+	}
+
+	j.lt = lt;
+	j.n = 0;
+	j.next = 0;
+	j.err = 0;
+	for (i = 0; i < n; i++) {
+		unit[i] = findunit(lt, addrs[i]);
+		if (unit[i] < 0 || seen[unit[i]])
+			continue;
+		seen[unit[i]] = 1;
+		if (__atomic_load_n(&lt->units[unit[i]], __ATOMIC_ACQUIRE) == NULL)
+			j.todo[j.n++] = unit[i];
+	}
+
+	if (nthread <= 0)
+		nthread = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthread <= 0)
+		nthread = 1;
+	if ((uint32_t)nthread > j.n)
+		nthread = j.n > 0 ? j.n : 1;
+
+	th = malloc(nthread * sizeof(th[0]));
+	if (th == NULL) {
+		found = -1;
+		goto out;
+	}
+
+	/* The calling thread decodes units too */
+	for (t = 0; t < nthread - 1; t++) {
+		if (pthread_create(&th[t], NULL, lineworker, &j) != 0)
+			break;
+	}
+	lineworker(&j);
+	for (k = 0; k < t; k++)
+		pthread_join(th[k], NULL);
+	free(th);
+
+	if (j.err) {
+		found = -1;
+		goto out;
+	}
+
+	found = 0;
+	for (i = 0; i < n; i++) {
+		memset(&locs[i], 0, sizeof(locs[i]));
+		if (unit[i] < 0)
+			continue;
+		if (findrow(lt->units[unit[i]], addrs[i], &locs[i]) == 0)
+			found++;
+	}
+
+out:
+	free(unit);
+	free(seen);
+	free(j.todo);
+
+	return found;
+}
+
+/*
+ * Forget a line table, whose memory goes with the arena
+ */
+void
+freeelflines(Linetab *lt)
+{
+	memset(lt, 0, sizeof(*lt));
+}
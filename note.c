@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Buildid Buildid;
+
+struct Buildid {
+	uint8_t		*id;
+	int		n;
+};
+
+/*
+ * Decode the note at *off of note bytes laid out with the given
+ * alignment, and move *off past it. Returns 1 for a note, 0 after
+ * the last one, or -1.
+ */
+int
+nextelfnote(uint8_t *buf, uint64_t len, uint64_t align, uint64_t *off, Note *n, Fhdr *fp)
+{
+	uint64_t o, desc, next;
+	uint8_t *p;
+
+	/* Notes are 4-byte aligned, or 8-byte aligned like GNU properties */
+	align = align == 8 ? 8 : 4;
+
+	o = *off;
+	if (o >= len)
+		return 0;
+	if (len - o < Nhdrsz)
+		return -1;
+
+	p = buf + o;
+	p += fp->get32(p, &n->namesz);
+	p += fp->get32(p, &n->descsz);
+	p += fp->get32(p, &n->type);
+
+	desc = (o + Nhdrsz + n->namesz + align - 1) & ~(align - 1);
+	next = (desc + n->descsz + align - 1) & ~(align - 1);
+	if (desc > len || n->descsz > len - desc)
+		return -1;
+
+	n->name = (char*)p;
+	if (n->namesz > 0 && n->name[n->namesz - 1] != '\0')
+		return -1;
+	n->desc = buf + desc;
+
+	*off = next < len ? next : len;
+
+	return 1;
+}
+
+/*
+ * Call fn on each note of note bytes
+ */
+static int
+walknotes(uint8_t *buf, uint64_t len, uint64_t align, int (*fn)(void*, Note*), void *arg, Fhdr *fp)
+{
+	uint64_t off;
+	Note n;
+	int r;
+
+	off = 0;
+	while ((r = nextelfnote(buf, len, align, &off, &n, fp)) > 0) {
+		r = fn(arg, &n);
+		if (r != 0)
+			return r;
+	}
+
+	return r;
+}
+
+/*
+ * Call fn on the notes of the SHT_NOTE sections
+ */
+static int
+sectnotes(FILE *f, Fhdr *fp, int (*fn)(void*, Note*), void *arg)
+{
+	uint8_t *buf;
+	uint32_t i;
+	int mapped;
+	Shdr *sh;
+	int r;
+
+	for (i = 0; i < fp->shnum; i++) {
+		sh = &fp->shdrs[i];
+		if (sh->type != SHT_NOTE)
+			continue;
+
+		buf = getsection(f, sh, fp, &mapped);
+		if (buf == NULL)
+			return -1;
+		r = walknotes(buf, sh->size, sh->addralign, fn, arg, fp);
+		putsection(buf, mapped);
+		if (r != 0)
+			return r;
+	}
+
+	return 0;
+}
+
+/*
+ * Call fn on the notes of the PT_NOTE segments
+ */
+static int
+segnotes(FILE *f, Fhdr *fp, int (*fn)(void*, Note*), void *arg)
+{
+	uint8_t *buf;
+	uint32_t i;
+	Phdr *ph;
+	int r;
+
+	/* Handles filled by readelf don't keep the table */
+	ph = fp->phdrs;
+	if (ph == NULL && fp->phnum > 0) {
+		ph = malloc(fp->phnum * sizeof(ph[0]));
+		if (ph == NULL)
+			return -1;
+		if (loadelfphdrs(f, ph, fp) < 0) {
+			free(ph);
+			return -1;
+		}
+	}
+
+	r = 0;
+	for (i = 0; i < fp->phnum && r == 0; i++) {
+		if (ph[i].type != PT_NOTE || ph[i].filesz == 0)
+			continue;
+
+		if (fp->map != NULL) {
+			if (ph[i].offset > fp->mapsize || ph[i].filesz > fp->mapsize - ph[i].offset) {
+				r = -1;
+				break;
+			}
+			r = walknotes(fp->map + ph[i].offset, ph[i].filesz, ph[i].align, fn, arg, fp);
+			continue;
+		}
+
+		buf = malloc(ph[i].filesz);
+		if (buf == NULL || readat(f, fp, buf, ph[i].filesz, ph[i].offset) < 0) {
+			free(buf);
+			r = -1;
+			break;
+		}
+		r = walknotes(buf, ph[i].filesz, ph[i].align, fn, arg, fp);
+		free(buf);
+	}
+
+	if (ph != fp->phdrs)
+		free(ph);
+
+	return r;
+}
+
+/*
+ * Call fn on each note of the file, from the SHT_NOTE sections when
+ * the Section Header Table is loaded and from the PT_NOTE segments
+ * otherwise, or always for a core. Returns 0, -1, or the first
+ * non-zero value of fn.
+ */
+int
+readelfnotes(FILE *f, Fhdr *fp, int (*fn)(void*, Note*), void *arg)
+{
+	if (fp->shdrs != NULL && fp->type != ET_CORE)
+		return sectnotes(f, fp, fn, arg);
+
+	return segnotes(f, fp, fn, arg);
+}
+
+static int
+buildidnote(void *arg, Note *n)
+{
+	Buildid *b;
+
+	b = arg;
+
+	if (n->type != NT_GNU_BUILD_ID || n->namesz != 4 || strcmp(n->name, "GNU") != 0)
+		return 0;
+	if (n->descsz == 0 || n->descsz > ELFBUILDID_MAX)
+		return 0;
+
+	memcpy(b->id, n->desc, n->descsz);
+	b->n = n->descsz;
+
+	return 1;
+}
+
+/*
+ * Get the GNU build ID, of up to ELFBUILDID_MAX bytes, from the
+ * PT_NOTE segments, or from the SHT_NOTE sections of a file without
+ * them. A handle opened with openelfehdr is enough. Returns the size
+ * of the build ID, or -1.
+ */
+int
+elfbuildid(FILE *f, Fhdr *fp, uint8_t *id)
+{
+	Buildid b;
+
+	b.id = id;
+	b.n = -1;
+
+	if (segnotes(f, fp, buildidnote, &b) == 1)
+		return b.n;
+
+	if (fp->shdrs != NULL && sectnotes(f, fp, buildidnote, &b) == 1)
+		return b.n;
+
+	return -1;
+}
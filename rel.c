@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Relkey Relkey;
+
+struct Relkey {
+	uint32_t	shndx;
+	uint32_t	i;
+	uint64_t	offset;
+};
+
+/*
+ * Relative relocation type of each machine, given to the entries of
+ * SHT_RELR sections
+ */
+static struct {
+	uint16_t machine;
+	uint32_t type;
+} relative[] = {
+	{ EM_386,	8 },
+	{ EM_X86_64,	8 },
+	{ EM_ARM,	23 },
+	{ EM_AARCH64,	1027 },
+	{ EM_PPC,	22 },
+	{ EM_PPC64,	22 },
+	{ EM_S390,	12 },
+	{ EM_RISCV,	3 },
+};
+
+static uint32_t
+relativetype(uint16_t machine)
+{
+	unsigned int i;
+
+	for (i = 0; i < nelem(relative); i++) {
+		if (relative[i].machine == machine)
+			return relative[i].type;
+	}
+
+	return 0;
+}
+
+/*
+ * Size of the relocation arrays of n relocations
+ */
+static uint64_t
+relcolsize(uint32_t n)
+{
+	return (uint64_t)n * (2*sizeof(uint64_t) + 3*sizeof(uint32_t)) + 1;
+}
+
+/*
+ * Lay the relocation arrays out in the block p
+ */
+static void
+setrelcols(Reltab *rt, uint8_t *p, uint32_t n)
+{
+	rt->offset = (uint64_t*)p;
+	rt->addend = (int64_t*)(rt->offset + n);
+	rt->sym = (uint32_t*)(rt->addend + n);
+	rt->type = rt->sym + n;
+	rt->shndx = rt->type + n;
+}
+
+/*
+ * Get a word of a SHT_RELR section
+ */
+static uint64_t
+getrelr(uint8_t *p, Fhdr *fp)
+{
+	uint32_t v32;
+	uint64_t v;
+
+	if (fp->class == ELFCLASS32) {
+		fp->get32(p, &v32);
+		return v32;
+	}
+
+	fp->get64(p, &v);
+
+	return v;
+}
+
+/*
+ * Count the relocations packed in a SHT_RELR section: an even word is
+ * an address, an odd word a bitmap of the words following the last
+ * address
+ */
+static uint64_t
+countrelr(uint8_t *sect, uint64_t size, Fhdr *fp)
+{
+	uint64_t w, n, e;
+	uint8_t *p;
+
+	w = fp->class == ELFCLASS32 ? 4 : 8;
+
+	n = 0;
+	for (p = sect; p + w <= sect + size; p += w) {
+		e = getrelr(p, fp);
+		n += (e & 1) == 0 ? 1 : __builtin_popcountll(e >> 1);
+	}
+
+	return n;
+}
+
+/*
+ * Unpack a SHT_RELR section into the arrays, from index at
+ */
+static void
+decoderelr(uint8_t *sect, uint64_t size, Reltab *rt, uint32_t at, uint32_t n, Fhdr *fp)
+{
+	uint64_t w, e, base, i;
+	uint32_t type, j;
+	uint8_t *p;
+
+	w = fp->class == ELFCLASS32 ? 4 : 8;
+	type = relativetype(fp->machine);
+
+	/* The addends are in place, like for SHT_REL */
+	for (j = at; j < at + n; j++) {
+		rt->sym[j] = 0;
+		rt->type[j] = type;
+		rt->addend[j] = 0;
+	}
+
+	base = 0;
+	for (p = sect; p + w <= sect + size; p += w) {
+		e = getrelr(p, fp);
+		if ((e & 1) == 0) {
+			rt->offset[at++] = e;
+			base = e + w;
+			continue;
+		}
+		for (i = 0, e >>= 1; e != 0; i++, e >>= 1) {
+			if (e & 1)
+				rt->offset[at++] = base + i * w;
+		}
+		base += (8 * w - 1) * w;
+	}
+}
+
+/*
+ * Get the number of relocations of a section, or -1
+ */
+static int64_t
+countrels(FILE *f, Shdr *sh, Fhdr *fp)
+{
+	uint64_t entsize, n;
+	uint8_t *sect;
+	int mapped;
+
+	switch (sh->type) {
+	case SHT_REL:
+		entsize = fp->class == ELFCLASS32 ? Rel32sz : Rel64sz;
+		break;
+	case SHT_RELA:
+		entsize = fp->class == ELFCLASS32 ? Rela32sz : Rela64sz;
+		break;
+	case SHT_RELR:
+		entsize = fp->class == ELFCLASS32 ? 4 : 8;
+		break;
+	default:
+		fprintf(stderr, "section is not a relocation table\n");
+		return -1;
+	}
+
+	if (sh->entsize != 0 && sh->entsize != entsize) {
+		fprintf(stderr, "relocation entsize mismatch; want %" PRIu64 "; got %" PRIu64 "\n", entsize, sh->entsize);
+		return -1;
+	}
+
+	if (sh->type != SHT_RELR || sh->size == 0)
+		return sh->size / entsize;
+
+	sect = getsection(f, sh, fp, &mapped);
+	if (sect == NULL)
+		return -1;
+	n = countrelr(sect, sh->size, fp);
+	putsection(sect, mapped);
+
+	return n;
+}
+
+/*
+ * Decode the relocations of a section into the arrays, from index at
+ */
+static int
+decoderels(FILE *f, Shdr *sh, Reltab *rt, uint32_t at, uint32_t n, Fhdr *fp)
+{
+	uint8_t *sect;
+	int mapped;
+
+	if (n == 0)
+		return 0;
+
+	sect = getsection(f, sh, fp, &mapped);
+	if (sect == NULL)
+		return -1;
+
+	if (sh->type == SHT_RELR)
+		decoderelr(sect, sh->size, rt, at, n, fp);
+	else
+		fp->decodeelfrels(sect, n, sh->type == SHT_RELA, rt, at);
+
+	putsection(sect, mapped);
+
+	return 0;
+}
+
+static int
+addrcmp(const void *a, const void *b)
+{
+	const Shdr *x, *y;
+
+	x = *(Shdr**)a;
+	y = *(Shdr**)b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+ * Get the allocated sections by address, to find the targets of
+ * dynamic relocations. The .tbss sections overlap the sections that
+ * follow them and hold no relocation targets.
+ */
+static Shdr**
+allocsections(Fhdr *fp, uint32_t *n)
+{
+	Shdr **tab, *sh;
+	uint32_t i;
+
+	tab = malloc((fp->shnum + 1) * sizeof(tab[0]));
+	if (tab == NULL)
+		return NULL;
+
+	*n = 0;
+	for (i = 0; i < fp->shnum; i++) {
+		sh = &fp->shdrs[i];
+		if (!(sh->flags & SHF_ALLOC) || sh->size == 0)
+			continue;
+		if ((sh->flags & SHF_TLS) && sh->type == SHT_NOBITS)
+			continue;
+		tab[(*n)++] = sh;
+	}
+
+	qsort(tab, *n, sizeof(tab[0]), addrcmp);
+
+	return tab;
+}
+
+/*
+ * Set the target sections of relocations at index at, from the
+ * section info of relocatable files and by address otherwise
+ */
+static void
+targetrels(Shdr *sh, Shdr **alloc, uint32_t nalloc, Reltab *rt, uint32_t at, uint32_t n, Fhdr *fp)
+{
+	uint32_t i, lo, hi, mid;
+	uint64_t off;
+	Shdr *s;
+
+	if (alloc == NULL) {
+		for (i = at; i < at + n; i++)
+			rt->shndx[i] = sh->info;
+		return;
+	}
+
+	s = NULL;
+	for (i = at; i < at + n; i++) {
+		off = rt->offset[i];
+
+		/* Places mostly follow each other */
+		if (s == NULL || off < s->addr || off - s->addr >= s->size) {
+			lo = 0;
+			hi = nalloc;
+			while (lo < hi) {
+				mid = lo + (hi - lo) / 2;
+				if (alloc[mid]->addr <= off)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			s = lo > 0 ? alloc[lo-1] : NULL;
+			if (s != NULL && off - s->addr >= s->size)
+				s = NULL;
+		}
+
+		rt->shndx[i] = s != NULL ? s - fp->shdrs : SHN_UNDEF;
+	}
+}
+
+static int
+relkeycmp(const void *a, const void *b)
+{
+	const Relkey *x, *y;
+
+	x = a;
+	y = b;
+
+	if (x->shndx != y->shndx)
+		return x->shndx < y->shndx ? -1 : 1;
+	if (x->offset != y->offset)
+		return x->offset < y->offset ? -1 : 1;
+
+	return x->i < y->i ? -1 : x->i > y->i;
+}
+
+/*
+ * Order the relocations by target section, then by place, through
+ * a copy of the arrays on the heap
+ */
+static int
+sortrels(Reltab *rt)
+{
+	Reltab old;
+	Relkey *key;
+	uint32_t i, k;
+	uint8_t *p;
+
+	for (i = 1; i < rt->nrel; i++) {
+		if (rt->shndx[i-1] > rt->shndx[i])
+			break;
+		if (rt->shndx[i-1] == rt->shndx[i] && rt->offset[i-1] > rt->offset[i])
+			break;
+	}
+	if (i >= rt->nrel)
+		return 0;
+
+	key = malloc(rt->nrel * sizeof(key[0]));
+	if (key == NULL)
+		return -1;
+
+	for (i = 0; i < rt->nrel; i++) {
+		key[i].shndx = rt->shndx[i];
+		key[i].i = i;
+		key[i].offset = rt->offset[i];
+	}
+	qsort(key, rt->nrel, sizeof(key[0]), relkeycmp);
+
+	p = malloc(relcolsize(rt->nrel));
+	if (p == NULL) {
+		free(key);
+		return -1;
+	}
+	memcpy(p, rt->offset, relcolsize(rt->nrel));
+	setrelcols(&old, p, rt->nrel);
+
+	for (i = 0; i < rt->nrel; i++) {
+		k = key[i].i;
+		rt->offset[i] = old.offset[k];
+		rt->addend[i] = old.addend[k];
+		rt->sym[i] = old.sym[k];
+		rt->type[i] = old.type[k];
+		rt->shndx[i] = old.shndx[k];
+	}
+
+	free(p);
+	free(key);
+
+	return 0;
+}
+
+/*
+ * Read relocation sections into a single table
+ */
+static int
+readrels(FILE *f, Shdr **shs, uint32_t nsh, Reltab *rt, Fhdr *fp)
+{
+	uint32_t i, at, nalloc;
+	Shdr **alloc;
+	uint64_t total;
+	int64_t *n;
+	uint8_t *p;
+
+	memset(rt, 0, sizeof(*rt));
+
+	n = malloc((nsh + 1) * sizeof(n[0]));
+	if (n == NULL)
+		return -1;
+
+	/* Dynamic relocations target the section of their address */
+	alloc = NULL;
+	nalloc = 0;
+	if (fp->type != ET_REL && fp->shdrs != NULL) {
+		alloc = allocsections(fp, &nalloc);
+		if (alloc == NULL)
+			goto err;
+	}
+
+	total = 0;
+	for (i = 0; i < nsh; i++) {
+		n[i] = countrels(f, shs[i], fp);
+		if (n[i] < 0)
+			goto err;
+		total += n[i];
+	}
+	if (total > UINT32_MAX)
+		goto err;
+
+	p = elfalloc(fp, relcolsize(total));
+	if (p == NULL)
+		goto err;
+	setrelcols(rt, p, total);
+	rt->nrel = total;
+
+	for (i = 0, at = 0; i < nsh; at += n[i], i++) {
+		if (decoderels(f, shs[i], rt, at, n[i], fp) < 0)
+			goto err;
+		targetrels(shs[i], alloc, nalloc, rt, at, n[i], fp);
+	}
+
+	if (sortrels(rt) < 0)
+		goto err;
+
+	free(alloc);
+	free(n);
+
+	return 0;
+
+err:
+	free(alloc);
+	free(n);
+	freeelfreltab(rt);
+	return -1;
+}
+
+/*
+ * Read a SHT_REL, SHT_RELA or SHT_RELR section, sorted by place, once
+ * per section: the handle keeps it for the reads that follow. Its
+ * arrays are allocated from the arena of the handle, and live as
+ * long as it.
+ */
+int
+readelfreltab(FILE *f, Shdr *sh, Reltab *rt, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Treltab, sh->offset, sh->size, rt, sizeof(*rt));
+	if (r <= 0)
+		return r;
+
+	r = readrels(f, &sh, 1, rt, fp);
+
+	return keepelftab(fp, Treltab, sh->offset, sh->size, r, rt, sizeof(*rt));
+}
+
+/*
+ * Decode all the relocation sections of a file
+ */
+static int
+readallrels(FILE *f, Reltab *rt, Fhdr *fp)
+{
+	uint32_t i, nsh;
+	Shdr **shs;
+	uint32_t t;
+	int r;
+
+	shs = malloc((fp->shnum + 1) * sizeof(shs[0]));
+	if (shs == NULL)
+		return -1;
+
+	nsh = 0;
+	for (i = 0; i < fp->shnum; i++) {
+		t = fp->shdrs[i].type;
+		if (t == SHT_REL || t == SHT_RELA || t == SHT_RELR)
+			shs[nsh++] = &fp->shdrs[i];
+	}
+
+	r = readrels(f, shs, nsh, rt, fp);
+
+	free(shs);
+
+	return r;
+}
+
+/*
+ * Read all the relocation sections of a file, grouped by target
+ * section and sorted by place within each group, once: the handle
+ * keeps them for the reads that follow
+ */
+int
+readelfrels(FILE *f, Reltab *rt, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Trels, 0, 0, rt, sizeof(*rt));
+	if (r <= 0)
+		return r;
+
+	r = readallrels(f, rt, fp);
+
+	return keepelftab(fp, Trels, 0, 0, r, rt, sizeof(*rt));
+}
+
+/*
+ * Get the relocations of a target section, as the index of the first
+ * one in *first. Returns their number.
+ */
+uint32_t
+elfrelgroup(Reltab *rt, uint32_t shndx, uint32_t *first)
+{
+	uint32_t lo, hi, mid, start;
+
+	lo = 0;
+	hi = rt->nrel;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rt->shndx[mid] < shndx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	hi = rt->nrel;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rt->shndx[mid] <= shndx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = start;
+
+	return lo - start;
+}
+
+/*
+ * Forget a Relocation Table, whose memory goes with the arena
+ */
+void
+freeelfreltab(Reltab *rt)
+{
+	memset(rt, 0, sizeof(*rt));
+}
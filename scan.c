@@ -0,0 +1,624 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Kinds of work
+ */
+enum {
+	Wfile,		/* File given by the caller */
+	Wfound,		/* File found by a walk */
+	Wdir,		/* Directory to walk */
+};
+
+typedef struct Work Work;
+typedef struct Deque Deque;
+typedef struct Pool Pool;
+
+/*
+ * File or directory to scan
+ */
+struct Work {
+	char		*path;
+	uint8_t		kind;
+	uint8_t		own;		/* Path is ours to free */
+};
+
+/*
+ * Work of a thread. The owner pushes and pops at hi, thieves steal
+ * from lo, where the oldest and usually largest work sits.
+ */
+struct Deque {
+	pthread_mutex_t	lk;
+	Work		*w;
+	uint32_t	lo;
+	uint32_t	hi;
+	uint32_t	cap;
+};
+
+struct Pool {
+	Deque		*dq;
+	int		nthread;
+	uint64_t	pending;	/* Work queued or running */
+	uint64_t	queued;		/* Work on the deques */
+
+	/* Idle threads and descriptors wait on lk */
+	pthread_mutex_t	lk;
+	pthread_cond_t	workcv;
+	pthread_cond_t	fdcv;
+	int		idle;		/* Threads waiting for work */
+	int		fds;		/* Descriptors still available */
+
+	void (*fn)(void*, Scan*);
+	void		*arg;
+
+	Arena		**arena;	/* Arena of each thread, reset per file */
+};
+
+typedef struct Worker Worker;
+
+struct Worker {
+	Pool		*pool;
+	int		id;
+};
+
+static int
+push(Pool *p, int id, Work *w)
+{
+	Deque *d;
+	Work *nw;
+	uint32_t cap;
+
+	d = &p->dq[id];
+
+	pthread_mutex_lock(&d->lk);
+
+	if (d->hi == d->cap) {
+		/* Reclaim the stolen front first */
+		if (d->lo > 0) {
+			memmove(d->w, d->w + d->lo, (d->hi - d->lo) * sizeof(d->w[0]));
+			d->hi -= d->lo;
+			d->lo = 0;
+		}
+		if (d->hi == d->cap) {
+			cap = d->cap ? 2 * d->cap : 64;
+			nw = realloc(d->w, cap * sizeof(d->w[0]));
+			if (nw == NULL) {
+				pthread_mutex_unlock(&d->lk);
+				return -1;
+			}
+			d->w = nw;
+			d->cap = cap;
+		}
+	}
+
+	d->w[d->hi++] = *w;
+
+	pthread_mutex_unlock(&d->lk);
+
+	/* Wake a thread waiting for work */
+	__atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&p->idle, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p->lk);
+		pthread_cond_signal(&p->workcv);
+		pthread_mutex_unlock(&p->lk);
+	}
+
+	return 0;
+}
+
+static int
+pop(Pool *p, int id, Work *w)
+{
+	Deque *d;
+	int r;
+
+	d = &p->dq[id];
+
+	pthread_mutex_lock(&d->lk);
+
+	r = -1;
+	if (d->hi > d->lo) {
+		*w = d->w[--d->hi];
+		r = 0;
+	}
+
+	pthread_mutex_unlock(&d->lk);
+
+	if (r == 0)
+		__atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+
+	return r;
+}
+
+/*
+ * Take half of the work of another thread, returning one item and
+ * queueing the rest on our own deque
+ */
+static int
+steal(Pool *p, int id, Work *w)
+{
+	uint32_t n, i;
+	Deque *v;
+	Work *t;
+	int k;
+
+	for (k = 1; k < p->nthread; k++) {
+		v = &p->dq[(id + k) % p->nthread];
+
+		pthread_mutex_lock(&v->lk);
+		n = (v->hi - v->lo + 1) / 2;
+		if (n == 0) {
+			pthread_mutex_unlock(&v->lk);
+			continue;
+		}
+		t = malloc(n * sizeof(t[0]));
+		if (t == NULL) {
+			pthread_mutex_unlock(&v->lk);
+			return -1;
+		}
+		memcpy(t, v->w + v->lo, n * sizeof(t[0]));
+		v->lo += n;
+		pthread_mutex_unlock(&v->lk);
+		__atomic_sub_fetch(&p->queued, n, __ATOMIC_SEQ_CST);
+
+		*w = t[0];
+		for (i = 1; i < n; i++)
+			push(p, id, &t[i]);
+		free(t);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Wait for a free descriptor
+ */
+static void
+takefd(Pool *p)
+{
+	pthread_mutex_lock(&p->lk);
+	while (p->fds == 0)
+		pthread_cond_wait(&p->fdcv, &p->lk);
+	p->fds--;
+	pthread_mutex_unlock(&p->lk);
+}
+
+static void
+putfd(Pool *p)
+{
+	pthread_mutex_lock(&p->lk);
+	p->fds++;
+	pthread_cond_signal(&p->fdcv);
+	pthread_mutex_unlock(&p->lk);
+}
+
+/*
+ * Wait until there is work to steal. Returns -1 once all the work
+ * is done.
+ */
+static int
+waitwork(Pool *p)
+{
+	int r;
+
+	pthread_mutex_lock(&p->lk);
+
+	__atomic_add_fetch(&p->idle, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0
+	&& __atomic_load_n(&p->pending, __ATOMIC_SEQ_CST) > 0)
+		pthread_cond_wait(&p->workcv, &p->lk);
+	__atomic_sub_fetch(&p->idle, 1, __ATOMIC_SEQ_CST);
+
+	r = __atomic_load_n(&p->pending, __ATOMIC_SEQ_CST) == 0 ? -1 : 0;
+
+	pthread_mutex_unlock(&p->lk);
+
+	return r;
+}
+
+/*
+ * Finish a piece of work, waking everyone after the last one
+ */
+static void
+donework(Pool *p)
+{
+	if (__atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST) > 0)
+		return;
+
+	pthread_mutex_lock(&p->lk);
+	pthread_cond_broadcast(&p->workcv);
+	pthread_mutex_unlock(&p->lk);
+}
+
+static int
+fdreadat(void *aux, uint64_t off, uint64_t len, void *buf)
+{
+	uint8_t *b;
+	ssize_t n;
+	int fd;
+
+	fd = *(int*)aux;
+
+	for (b = buf; len > 0; b += n, len -= n, off += n) {
+		n = pread(fd, b, len, off);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Summarize the sections of a file
+ */
+static void
+scansects(Fhdr *fp, Scan *s)
+{
+	uint32_t i;
+	Shdr *sh;
+	char *n;
+
+	for (i = 0; i < fp->shnum; i++) {
+		sh = &fp->shdrs[i];
+
+		switch (sh->type) {
+		case SHT_SYMTAB:
+			s->nsym += sh->entsize ? sh->size / sh->entsize : 0;
+			break;
+		case SHT_DYNSYM:
+			s->ndynsym += sh->entsize ? sh->size / sh->entsize : 0;
+			break;
+		}
+
+		if (sh->flags & SHF_ALLOC) {
+			if (sh->type == SHT_NOBITS)
+				s->bsssize += sh->size;
+			else if (sh->flags & SHF_WRITE)
+				s->datasize += sh->size;
+			else
+				s->textsize += sh->size;
+			continue;
+		}
+
+		n = elfshdrstr(fp, sh);
+		if (n != NULL && strncmp(n, ".debug", 6) == 0)
+			s->debugsize += sh->size;
+	}
+}
+
+/*
+ * Scan one file. Files of a walk that aren't ELF files are skipped.
+ */
+static void
+scanfile(Pool *p, int id, Work *w)
+{
+	uint8_t mag[4];
+	int fd, n;
+	Fhdr fp;
+	Scan s;
+
+	memset(&s, 0, sizeof(s));
+	s.path = w->path;
+	s.thread = id;
+	s.err = -1;
+
+	takefd(p);
+
+	fd = open(w->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		goto out;
+
+	if (fdreadat(&fd, 0, sizeof(mag), mag) < 0 || memcmp(mag, "\177ELF", 4) != 0) {
+		close(fd);
+		if (w->kind == Wfound)
+			goto skip;
+		goto out;
+	}
+
+	if (openelfreaderarena(fdreadat, &fd, p->arena[id], &fp) < 0) {
+		close(fd);
+		goto reset;
+	}
+
+	s.err = 0;
+	s.class = fp.class;
+	s.data = fp.data;
+	s.osabi = fp.osabi;
+	s.type = fp.type;
+	s.machine = fp.machine;
+	s.entry = fp.entry;
+	s.phnum = fp.phnum;
+	s.shnum = fp.shnum;
+	scansects(&fp, &s);
+	n = elfbuildid(NULL, &fp, s.buildid);
+	s.buildidsize = n > 0 ? n : 0;
+
+	s.fp = &fp;
+	p->fn(p->arg, &s);
+	freeelf(&fp);
+	close(fd);
+	putfd(p);
+	if (p->arena[id] != NULL)
+		resetelfarena(p->arena[id]);
+	return;
+
+reset:
+	if (p->arena[id] != NULL)
+		resetelfarena(p->arena[id]);
+out:
+	putfd(p);
+	p->fn(p->arg, &s);
+	return;
+
+skip:
+	putfd(p);
+}
+
+/*
+ * Queue the entries of a directory. Symbolic links aren't followed.
+ */
+static void
+walkdir(Pool *p, int id, Work *w)
+{
+	struct dirent *de;
+	struct stat st;
+	size_t len;
+	Work c;
+	DIR *d;
+	Scan s;
+
+	takefd(p);
+
+	d = opendir(w->path);
+	if (d == NULL) {
+		putfd(p);
+		memset(&s, 0, sizeof(s));
+		s.path = w->path;
+		s.thread = id;
+		s.err = -1;
+		p->fn(p->arg, &s);
+		return;
+	}
+
+	len = strlen(w->path);
+	while ((de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		c.path = malloc(len + strlen(de->d_name) + 2);
+		if (c.path == NULL)
+			break;
+		sprintf(c.path, "%s/%s", w->path, de->d_name);
+
+		switch (de->d_type) {
+		case DT_DIR:
+			c.kind = Wdir;
+			break;
+		case DT_REG:
+			c.kind = Wfound;
+			break;
+		case DT_UNKNOWN:
+			if (lstat(c.path, &st) == 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+				c.kind = S_ISDIR(st.st_mode) ? Wdir : Wfound;
+				break;
+			}
+			/* fall through */
+		default:
+			free(c.path);
+			continue;
+		}
+
+		c.own = 1;
+		__atomic_add_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+		if (push(p, id, &c) < 0) {
+			__atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+			free(c.path);
+		}
+	}
+
+	closedir(d);
+	putfd(p);
+}
+
+static void*
+worker(void *v)
+{
+	Worker *k;
+	Pool *p;
+	Work w;
+
+	k = v;
+	p = k->pool;
+
+	for (;;) {
+		if (pop(p, k->id, &w) == 0 || steal(p, k->id, &w) == 0) {
+			if (w.kind == Wdir)
+				walkdir(p, k->id, &w);
+			else
+				scanfile(p, k->id, &w);
+			if (w.own)
+				free(w.path);
+			donework(p);
+			continue;
+		}
+		if (waitwork(p) < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Run the pool over the work queued on its deques
+ */
+static int
+runpool(Pool *p)
+{
+	pthread_t *th;
+	Worker *k;
+	int i, n;
+
+	th = malloc(p->nthread * sizeof(th[0]));
+	k = malloc(p->nthread * sizeof(k[0]));
+	if (th == NULL || k == NULL) {
+		free(th);
+		free(k);
+		return -1;
+	}
+
+	for (i = 0; i < p->nthread; i++) {
+		k[i].pool = p;
+		k[i].id = i;
+	}
+
+	/* The calling thread is worker 0 */
+	for (n = 1; n < p->nthread; n++) {
+		if (pthread_create(&th[n], NULL, worker, &k[n]) != 0)
+			break;
+	}
+	worker(&k[0]);
+	for (i = 1; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	free(th);
+	free(k);
+
+	return 0;
+}
+
+static int
+newpool(Pool *p, int nthread, int maxfd, void (*fn)(void*, Scan*), void *arg)
+{
+	int i;
+
+	memset(p, 0, sizeof(*p));
+
+	if (nthread <= 0)
+		nthread = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthread <= 0)
+		nthread = 1;
+
+	p->dq = calloc(nthread, sizeof(p->dq[0]));
+	if (p->dq == NULL)
+		return -1;
+	p->arena = calloc(nthread, sizeof(p->arena[0]));
+	if (p->arena == NULL) {
+		free(p->dq);
+		return -1;
+	}
+	for (i = 0; i < nthread; i++) {
+		pthread_mutex_init(&p->dq[i].lk, NULL);
+		/* Without one the handles allocate their own */
+		p->arena[i] = newelfarena(0);
+	}
+	pthread_mutex_init(&p->lk, NULL);
+	pthread_cond_init(&p->workcv, NULL);
+	pthread_cond_init(&p->fdcv, NULL);
+
+	p->nthread = nthread;
+	p->fds = maxfd > 0 ? maxfd : nthread;
+	p->fn = fn;
+	p->arg = arg;
+
+	return 0;
+}
+
+static void
+freepool(Pool *p)
+{
+	int i;
+
+	for (i = 0; i < p->nthread; i++) {
+		pthread_mutex_destroy(&p->dq[i].lk);
+		free(p->dq[i].w);
+		freeelfarena(p->arena[i]);
+	}
+	free(p->dq);
+	free(p->arena);
+	pthread_mutex_destroy(&p->lk);
+	pthread_cond_destroy(&p->workcv);
+	pthread_cond_destroy(&p->fdcv);
+}
+
+/*
+ * Scan a list of files on nthread threads, with at most maxfd of
+ * them open at once, calling fn on each
+ */
+int
+scanelf(char **paths, uint32_t npath, int nthread, int maxfd, void (*fn)(void*, Scan*), void *arg)
+{
+	Pool p;
+	Work w;
+	uint32_t i;
+	int r;
+
+	if (newpool(&p, nthread, maxfd, fn, arg) < 0)
+		return -1;
+
+	/* Contiguous runs, so that threads start on their own files */
+	r = 0;
+	for (i = 0; i < npath; i++) {
+		w.path = paths[i];
+		w.kind = Wfile;
+		w.own = 0;
+		if (push(&p, (uint64_t)i * p.nthread / npath, &w) < 0) {
+			r = -1;
+			break;
+		}
+		p.pending++;
+	}
+
+	if (r == 0)
+		r = runpool(&p);
+
+	freepool(&p);
+
+	return r;
+}
+
+/*
+ * Scan the ELF files of a directory tree on nthread threads, with
+ * at most maxfd files and directories open at once, calling fn on
+ * each
+ */
+int
+scanelfdir(char *root, int nthread, int maxfd, void (*fn)(void*, Scan*), void *arg)
+{
+	Pool p;
+	Work w;
+	int r;
+
+	if (newpool(&p, nthread, maxfd, fn, arg) < 0)
+		return -1;
+
+	w.path = root;
+	w.kind = Wdir;
+	w.own = 0;
+	r = push(&p, 0, &w);
+	if (r == 0) {
+		p.pending = 1;
+		r = runpool(&p);
+	}
+
+	freepool(&p);
+
+	return r;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+typedef struct Sname Sname;
+
+struct Sname {
+	char *name;
+	uint32_t i;
+};
+
+/*
+ * Section Name Index, published whole so that concurrent readers
+ * of a shared handle see it built or not at all
+ */
+struct Shindex {
+	uint32_t	mask;
+	uint32_t	*sorted;	/* Section indexes sorted by name */
+	uint64_t	hash[];		/* Name hash and index + 1, open addressing */
+};
+
+/*
+ * FNV-1a hash of a section name
+ */
+static uint32_t
+namehash(char *s)
+{
+	uint32_t h;
+
+	h = 2166136261u;
+	while (*s != '\0') {
+		h ^= (uint8_t)*s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static int
+snamecmp(const void *a, const void *b)
+{
+	const Sname *x, *y;
+	int r;
+
+	x = a;
+	y = b;
+
+	r = strcmp(x->name, y->name);
+	if (r != 0)
+		return r;
+
+	return x->i < y->i ? -1 : x->i > y->i;
+}
+
+/*
+ * Build the hash and sorted indexes over the section names, once
+ */
+static Shindex*
+buildshindex(Fhdr *fp)
+{
+	uint32_t i, j, n, size;
+	Shindex *ix, *old;
+	Sname *names;
+	uint64_t e;
+	uint32_t h;
+	char *s;
+
+	ix = __atomic_load_n(&fp->shindex, __ATOMIC_ACQUIRE);
+	if (ix != NULL)
+		return ix;
+
+	if (fp->shdrs == NULL)
+		return NULL;
+
+	size = 16;
+	while (size < 2 * (uint64_t)fp->shnum)
+		size <<= 1;
+
+	names = malloc(fp->shnum * sizeof(names[0]) + 1);
+	if (names == NULL)
+		return NULL;
+	ix = elfalloc(fp, sizeof(*ix) + size * sizeof(ix->hash[0]) + fp->shnum * sizeof(ix->sorted[0]));
+	if (ix == NULL) {
+		free(names);
+		return NULL;
+	}
+	memset(ix, 0, sizeof(*ix) + size * sizeof(ix->hash[0]));
+	ix->mask = size - 1;
+	ix->sorted = (uint32_t*)(ix->hash + size);
+
+	n = 0;
+	for (i = 0; i < fp->shnum; i++) {
+		s = getstr(fp, fp->shdrs[i].name);
+		if (s == NULL)
+			continue;
+
+		/* First section wins, like a linear scan */
+		h = namehash(s);
+		e = (uint64_t)h << 32 | (i + 1);
+		for (j = h & ix->mask;; j = (j + 1) & ix->mask) {
+			if (ix->hash[j] == 0) {
+				ix->hash[j] = e;
+				break;
+			}
+			if ((uint32_t)(ix->hash[j] >> 32) == h
+			&& strcmp(getstr(fp, fp->shdrs[(uint32_t)ix->hash[j] - 1].name), s) == 0)
+				break;
+		}
+
+		names[n].name = s;
+		names[n].i = i;
+		n++;
+	}
+
+	qsort(names, n, sizeof(names[0]), snamecmp);
+	for (i = 0; i < n; i++)
+		ix->sorted[i] = names[i].i;
+	for (; i < fp->shnum; i++)
+		ix->sorted[i] = UINT32_MAX;
+
+	free(names);
+
+	/* Another thread may have won the race, ix stays in the arena */
+	old = NULL;
+	if (!__atomic_compare_exchange_n(&fp->shindex, &old, ix, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return old;
+
+	return ix;
+}
+
+/*
+ * Get Section Header by name
+ */
+Shdr*
+elfshdrname(Fhdr *fp, char *name)
+{
+	uint32_t h, j, i;
+	Shindex *ix;
+	uint64_t e;
+
+	ix = buildshindex(fp);
+	if (ix == NULL)
+		return NULL;
+
+	h = namehash(name);
+	for (j = h & ix->mask;; j = (j + 1) & ix->mask) {
+		e = ix->hash[j];
+		if (e == 0)
+			return NULL;
+		if ((uint32_t)(e >> 32) != h)
+			continue;
+		i = (uint32_t)e - 1;
+		if (strcmp(getstr(fp, fp->shdrs[i].name), name) == 0)
+			return &fp->shdrs[i];
+	}
+}
+
+/*
+ * Get the indexes of the sections whose name starts with prefix,
+ * in name order. Returns the number of sections.
+ */
+uint32_t
+elfshdrprefix(Fhdr *fp, char *prefix, uint32_t **idx)
+{
+	uint32_t lo, hi, mid, first;
+	Shindex *ix;
+	size_t len;
+	char *s;
+
+	ix = buildshindex(fp);
+	if (ix == NULL)
+		return 0;
+
+	len = strlen(prefix);
+
+	/* Named sections come first in sorted */
+	lo = 0;
+	hi = fp->shnum;
+	while (hi > lo && ix->sorted[hi - 1] == UINT32_MAX)
+		hi--;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		s = getstr(fp, fp->shdrs[ix->sorted[mid]].name);
+		if (strncmp(s, prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	first = lo;
+
+	while (lo < fp->shnum && ix->sorted[lo] != UINT32_MAX) {
+		s = getstr(fp, fp->shdrs[ix->sorted[lo]].name);
+		if (strncmp(s, prefix, len) != 0)
+			break;
+		lo++;
+	}
+
+	*idx = &ix->sorted[first];
+
+	return lo - first;
+}
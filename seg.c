@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+static int
+vaddrcmp(const void *a, const void *b)
+{
+	const Phdr *x, *y;
+
+	x = *(Phdr**)a;
+	y = *(Phdr**)b;
+
+	return x->vaddr < y->vaddr ? -1 : x->vaddr > y->vaddr;
+}
+
+static int
+offsetcmp(const void *a, const void *b)
+{
+	const Phdr *x, *y;
+
+	x = *(Phdr**)a;
+	y = *(Phdr**)b;
+
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/*
+ * Sort the PT_LOAD segments by address and by file offset
+ */
+int
+indexelfloads(Fhdr *fp)
+{
+	uint32_t i, n;
+
+	n = 0;
+	for (i = 0; i < fp->phnum; i++) {
+		if (fp->phdrs[i].type == PT_LOAD)
+			n++;
+	}
+
+	fp->loads = elfalloc(fp, 2 * n * sizeof(fp->loads[0]));
+	if (fp->loads == NULL)
+		return -1;
+
+	n = 0;
+	for (i = 0; i < fp->phnum; i++) {
+		if (fp->phdrs[i].type == PT_LOAD)
+			fp->loads[n++] = &fp->phdrs[i];
+	}
+	memcpy(fp->loads + n, fp->loads, n * sizeof(fp->loads[0]));
+
+	qsort(fp->loads, n, sizeof(fp->loads[0]), vaddrcmp);
+	qsort(fp->loads + n, n, sizeof(fp->loads[0]), offsetcmp);
+	fp->nload = n;
+
+	return 0;
+}
+
+/*
+ * Get the PT_LOAD segment of the last start at or below x, from
+ * the segments sorted by address (byoff = 0) or by file offset
+ */
+Phdr*
+findload(Fhdr *fp, uint64_t x, int byoff)
+{
+	uint32_t lo, hi, mid;
+	Phdr **l;
+
+	l = fp->loads + (byoff ? fp->nload : 0);
+
+	lo = 0;
+	hi = fp->nload;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((byoff ? l[mid]->offset : l[mid]->vaddr) <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo > 0 ? l[lo - 1] : NULL;
+}
+
+/*
+ * Get Program Header by index
+ */
+Phdr*
+elfphdr(Fhdr *fp, unsigned int i)
+{
+	if (fp->phdrs == NULL || i >= fp->phnum)
+		return NULL;
+
+	return &fp->phdrs[i];
+}
+
+/*
+ * Get the next Program Header of a type after prev, or the first
+ * one if prev is NULL
+ */
+Phdr*
+elfphdrtype(Fhdr *fp, uint32_t type, Phdr *prev)
+{
+	uint32_t i;
+
+	if (fp->phdrs == NULL)
+		return NULL;
+
+	i = prev == NULL ? 0 : prev - fp->phdrs + 1;
+	for (; i < fp->phnum; i++) {
+		if (fp->phdrs[i].type == type)
+			return &fp->phdrs[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Translate a virtual address to a file offset. Addresses of the
+ * zero-filled tail of a segment have none.
+ */
+int
+elfvaddroff(Fhdr *fp, uint64_t vaddr, uint64_t *off)
+{
+	Phdr *ph;
+
+	ph = findload(fp, vaddr, 0);
+	if (ph == NULL || vaddr - ph->vaddr >= ph->filesz)
+		return -1;
+
+	*off = ph->offset + (vaddr - ph->vaddr);
+
+	return 0;
+}
+
+/*
+ * Translate a file offset to a virtual address
+ */
+int
+elfoffvaddr(Fhdr *fp, uint64_t off, uint64_t *vaddr)
+{
+	Phdr *ph;
+
+	ph = findload(fp, off, 1);
+	if (ph == NULL || off - ph->offset >= ph->filesz)
+		return -1;
+
+	*vaddr = ph->vaddr + (off - ph->offset);
+
+	return 0;
+}
+
+/*
+ * Read len bytes of the memory image at vaddr from the file, across
+ * adjacent segments, zero-filling what the file doesn't hold.
+ * Returns the number of bytes read, short at the end of the mapped
+ * addresses, or -1.
+ */
+int64_t
+readelfvaddr(FILE *f, Fhdr *fp, uint64_t vaddr, void *buf, uint64_t len)
+{
+	uint64_t n, o, done;
+	uint8_t *p;
+	Phdr *ph;
+
+	p = buf;
+
+	for (done = 0; done < len; done += n, vaddr += n) {
+		ph = findload(fp, vaddr, 0);
+		if (ph == NULL || vaddr - ph->vaddr >= ph->memsz)
+			break;
+
+		o = vaddr - ph->vaddr;
+		n = len - done;
+		if (o < ph->filesz) {
+			if (n > ph->filesz - o)
+				n = ph->filesz - o;
+			if (readat(f, fp, p + done, n, ph->offset + o) < 0)
+				return -1;
+		} else {
+			if (n > ph->memsz - o)
+				n = ph->memsz - o;
+			memset(p + done, 0, n);
+		}
+	}
+
+	return done;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Start reading len bytes at off ahead of their use
+ */
+static void
+adviseahead(FILE *f, Fhdr *fp, uint64_t off, uint64_t len)
+{
+	uintptr_t p, mask;
+
+	if (len == 0 || fp->mapmem)
+		return;
+
+	if (fp->map != NULL) {
+		mask = sysconf(_SC_PAGESIZE) - 1;
+		p = (uintptr_t)(fp->map + off) & ~mask;
+		madvise((void*)p, (uintptr_t)(fp->map + off + len) - p, MADV_WILLNEED);
+		return;
+	}
+
+#ifdef POSIX_FADV_WILLNEED
+	if (f != NULL)
+		posix_fadvise(fileno(f), off, len, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+ * Open a chunked stream over a section, decompressed when it is
+ * compressed
+ */
+int
+openelfsstream(FILE *f, Shdr *sh, Sstream *s, Fhdr *fp)
+{
+	memset(s, 0, sizeof(*s));
+
+	if (sh->type == SHT_NOBITS)
+		return -1;
+
+	s->f = f;
+	s->fp = fp;
+
+	if (sh->flags & SHF_COMPRESSED) {
+		if (openelfzstream(f, sh, &s->zs, fp) < 0)
+			return -1;
+		s->compressed = 1;
+		s->size = s->zs.ch.size;
+		return 0;
+	}
+
+	if (fp->map != NULL && mapelfshdrsection(fp, sh) == NULL)
+		return -1;
+
+	s->off = sh->offset;
+	s->end = sh->offset + sh->size;
+	s->size = sh->size;
+
+	return 0;
+}
+
+/*
+ * Read the next chunk of up to len bytes of the section into buf.
+ * Returns the number of bytes read, 0 at the end of the section,
+ * or -1.
+ */
+int64_t
+readelfsstream(Sstream *s, uint8_t *buf, uint64_t len)
+{
+	if (s->compressed)
+		return readelfzstream(&s->zs, buf, len);
+
+	if (len > s->end - s->off)
+		len = s->end - s->off;
+	if (len == 0)
+		return 0;
+
+	if (readat(s->f, s->fp, buf, len, s->off) < 0)
+		return -1;
+	s->off += len;
+
+	/* The next chunk arrives while this one is processed */
+	adviseahead(s->f, s->fp, s->off, len < s->end - s->off ? len : s->end - s->off);
+
+	return len;
+}
+
+void
+closeelfsstream(Sstream *s)
+{
+	if (s->compressed)
+		closeelfzstream(&s->zs);
+
+	s->compressed = 0;
+}
+
+/*
+ * Call fn on each chunk of up to len bytes of a section, read into
+ * buf. The chunks of an uncompressed section of a mapped file are
+ * views of the mapping, and buf may be NULL. Returns 0 at the end
+ * of the section, -1 on error, or the first non-zero value returned
+ * by fn.
+ */
+int
+readelfchunks(FILE *f, Shdr *sh, uint8_t *buf, uint64_t len, int (*fn)(void*, uint8_t*, uint64_t), void *arg, Fhdr *fp)
+{
+	Sstream s;
+	int64_t n;
+	int r;
+
+	if (len == 0 || openelfsstream(f, sh, &s, fp) < 0)
+		return -1;
+
+	r = 0;
+
+	if (fp->map != NULL && !s.compressed) {
+		for (; s.off < s.end && r == 0; s.off += n) {
+			n = len < s.end - s.off ? len : s.end - s.off;
+			adviseahead(f, fp, s.off + n, len < s.end - s.off - n ? len : s.end - s.off - n);
+			r = fn(arg, fp->map + s.off, n);
+		}
+		closeelfsstream(&s);
+		return r;
+	}
+
+	while (r == 0 && (n = readelfsstream(&s, buf, len)) > 0)
+		r = fn(arg, buf, n);
+	if (n < 0)
+		r = -1;
+
+	closeelfsstream(&s);
+
+	return r;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	Maxent = 64,	/* Largest record swapents handles */
+};
+
+/*
+ * Data encoding of the host
+ */
+int
+hostdata(void)
+{
+	union {
+		uint16_t s;
+		uint8_t b[2];
+	} u;
+
+	u.s = 1;
+
+	return u.b[0] == 1 ? ELFDATA2LSB : ELFDATA2MSB;
+}
+
+/*
+ * Reverse the bytes of n 32-bit words in place
+ */
+void
+swap32s(void *v, size_t n)
+{
+	uint8_t *p;
+	uint32_t x;
+	size_t i;
+
+	p = v;
+	for (i = 0; i < n; i++) {
+		memcpy(&x, p + 4*i, sizeof(x));
+		x = __builtin_bswap32(x);
+		memcpy(p + 4*i, &x, sizeof(x));
+	}
+}
+
+/*
+ * Reverse the bytes of each field of n records of entsize bytes in
+ * place. The field widths of a record are given by the zero
+ * terminated widths array.
+ */
+int
+swapents(void *v, size_t n, size_t entsize, uint8_t *widths)
+{
+	uint8_t perm[Maxent], tmp[Maxent];
+	int8_t word[Maxent/8];
+	size_t i, j, k, o;
+	int uniform, words;
+	uint64_t x;
+	uint8_t *p;
+
+	if (entsize > Maxent)
+		return -1;
+
+	/* perm[j] is the byte of the record that lands at j */
+	o = 0;
+	uniform = 1;
+	for (k = 0; widths[k] != 0; k++) {
+		if (o + widths[k] > entsize)
+			return -1;
+		if (widths[k] != 4)
+			uniform = 0;
+		for (j = 0; j < widths[k]; j++)
+			perm[o + j] = o + widths[k] - 1 - j;
+		o += widths[k];
+	}
+	if (o != entsize)
+		return -1;
+
+	if (uniform) {
+		swap32s(v, n * entsize / 4);
+		return 0;
+	}
+
+	/*
+	 * Each 64-bit word holds either one 64-bit field (word[k] = 0)
+	 * or two 32-bit fields (word[k] = 32), swapped with a 64-bit
+	 * byte swap and a rotation.
+	 */
+	words = entsize % 8 == 0;
+	for (k = 0; words && k < entsize / 8; k++) {
+		word[k] = -1;
+		if (perm[8*k] == 8*k + 7 && perm[8*k + 7] == 8*k)
+			word[k] = 0;
+		if (perm[8*k] == 8*k + 3 && perm[8*k + 4] == 8*k + 7)
+			word[k] = 32;
+		if (word[k] < 0)
+			words = 0;
+	}
+
+	p = v;
+	for (i = 0; i < n; i++, p += entsize) {
+		if (!words) {
+			for (j = 0; j < entsize; j++)
+				tmp[j] = p[perm[j]];
+			memcpy(p, tmp, entsize);
+			continue;
+		}
+		for (k = 0; k < entsize / 8; k++) {
+			memcpy(&x, p + 8*k, sizeof(x));
+			x = __builtin_bswap64(x);
+			if (word[k] != 0)
+				x = x >> 32 | x << 32;
+			memcpy(p + 8*k, &x, sizeof(x));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * Allocate the symbol arrays in a single block of the arena
+ */
+static int
+allocsymtab(Symtab *st, uint32_t n, Fhdr *fp)
+{
+	uint8_t *p;
+
+	p = elfalloc(fp, (uint64_t)n * (2*sizeof(uint64_t) + 2*sizeof(uint32_t) + 2) + 1);
+	if (p == NULL)
+		return -1;
+
+	st->nsym = n;
+	st->value = (uint64_t*)p;
+	st->size = st->value + n;
+	st->name = (uint32_t*)(st->size + n);
+	st->shndx = st->name + n;
+	st->info = (uint8_t*)(st->shndx + n);
+	st->other = st->info + n;
+
+	return 0;
+}
+
+/*
+ * Get the index of a Section Header of the table, or of a copy of
+ * one, or -1. Addresses are compared as integers, sh may point
+ * anywhere.
+ */
+static int64_t
+shdrindex(Shdr *sh, Fhdr *fp)
+{
+	uintptr_t p, lo;
+	uint32_t i;
+	Shdr *s;
+
+	if (fp->shdrs == NULL)
+		return -1;
+
+	p = (uintptr_t)sh;
+	lo = (uintptr_t)fp->shdrs;
+	if (p >= lo && p - lo < (uint64_t)fp->shnum * sizeof(Shdr) && (p - lo) % sizeof(Shdr) == 0)
+		return (p - lo) / sizeof(Shdr);
+
+	for (i = 0; i < fp->shnum; i++) {
+		s = &fp->shdrs[i];
+		if (s->type == sh->type && s->offset == sh->offset && s->size == sh->size && s->link == sh->link)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Resolve SHN_XINDEX section indexes through the SHT_SYMTAB_SHNDX
+ * section linked to the Symbol Table
+ */
+static int
+readelfxindex(FILE *f, Shdr *sh, Symtab *st, Fhdr *fp)
+{
+	uint8_t *sect;
+	int64_t idx;
+	uint32_t i;
+	Shdr *x;
+	int mapped;
+
+	for (i = 0; i < st->nsym; i++) {
+		if (st->shndx[i] == SHN_XINDEX)
+			break;
+	}
+	if (i == st->nsym)
+		return 0;
+
+	idx = shdrindex(sh, fp);
+	if (idx < 0)
+		return -1;
+
+	for (x = elfshdrtype(fp, SHT_SYMTAB_SHNDX, NULL); x != NULL; x = elfshdrtype(fp, SHT_SYMTAB_SHNDX, x)) {
+		if (x->link == idx)
+			break;
+	}
+	if (x == NULL || x->size / 4 < st->nsym)
+		return -1;
+
+	sect = getsection(f, x, fp, &mapped);
+	if (sect == NULL)
+		return -1;
+
+	for (; i < st->nsym; i++) {
+		if (st->shndx[i] == SHN_XINDEX)
+			fp->get32(sect + 4*(size_t)i, &st->shndx[i]);
+	}
+
+	putsection(sect, mapped);
+
+	return 0;
+}
+
+/*
+ * Read the linked String Table
+ */
+static int
+readelfsymstr(FILE *f, Shdr *sh, Symtab *st, Fhdr *fp)
+{
+	Shdr *str;
+
+	str = elfshdr(fp, sh->link);
+	if (str == NULL || str->type != SHT_STRTAB || str->size == 0)
+		return -1;
+
+	st->strtab = keepsection(f, str, fp);
+	if (st->strtab == NULL)
+		return -1;
+	st->strtabsize = str->size;
+
+	/* Names are used in place, the table must be terminated */
+	if (st->strtab[st->strtabsize - 1] != '\0')
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Decode a Symbol Table
+ */
+static int
+readsymtab(FILE *f, Shdr *sh, Symtab *st, Fhdr *fp)
+{
+	uint64_t entsize, n;
+	uint8_t *sect;
+	int mapped;
+
+	memset(st, 0, sizeof(*st));
+
+	if (sh->type != SHT_SYMTAB && sh->type != SHT_DYNSYM) {
+		fprintf(stderr, "section is not a symbol table\n");
+		return -1;
+	}
+
+	entsize = fp->class == ELFCLASS32 ? Sym32sz : Sym64sz;
+	if (sh->entsize != 0 && sh->entsize != entsize) {
+		fprintf(stderr, "symbol entsize mismatch; want %" PRIu64 "; got %" PRIu64 "\n", entsize, sh->entsize);
+		return -1;
+	}
+
+	n = sh->size / entsize;
+	if (n > UINT32_MAX)
+		return -1;
+
+	if (allocsymtab(st, n, fp) < 0)
+		return -1;
+
+	if (n > 0) {
+		sect = getsection(f, sh, fp, &mapped);
+		if (sect == NULL)
+			goto err;
+		fp->decodeelfsyms(sect, n, st);
+		putsection(sect, mapped);
+	}
+
+	if (readelfxindex(f, sh, st, fp) < 0)
+		goto err;
+
+	if (readelfsymstr(f, sh, st, fp) < 0)
+		goto err;
+
+	return 0;
+
+err:
+	freeelfsymtab(st);
+	return -1;
+}
+
+/*
+ * Read ELF Symbol Table, once per section: the handle keeps it for
+ * the reads that follow. Its arrays are allocated from the arena of
+ * the handle, and live as long as it.
+ */
+int
+readelfsymtab(FILE *f, Shdr *sh, Symtab *st, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Tsymtab, sh->offset, sh->size, st, sizeof(*st));
+	if (r <= 0)
+		return r;
+
+	r = readsymtab(f, sh, st, fp);
+
+	return keepelftab(fp, Tsymtab, sh->offset, sh->size, r, st, sizeof(*st));
+}
+
+/*
+ * Get the name of symbol i
+ */
+char*
+elfsymname(Symtab *st, uint32_t i)
+{
+	if (i >= st->nsym || st->strtab == NULL)
+		return NULL;
+
+	if (st->name[i] >= st->strtabsize)
+		return NULL;
+
+	return (char*)&st->strtab[st->name[i]];
+}
+
+/*
+ * Forget a Symbol Table, whose memory goes with the arena
+ */
+void
+freeelfsymtab(Symtab *st)
+{
+	memset(st, 0, sizeof(*st));
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "dat.h"
+#include "fns.h"
+
+#define GET32(h, p) ((h)->data == ELFDATA2LSB ? LE32(p) : BE32(p))
+#define GET64(h, p) ((h)->data == ELFDATA2LSB ? LE64(p) : BE64(p))
+
+/*
+ * SysV ELF hash
+ */
+static uint32_t
+elfhash(char *name)
+{
+	uint32_t h, g;
+	uint8_t *s;
+
+	h = 0;
+	for (s = (uint8_t*)name; *s != '\0'; s++) {
+		h = (h << 4) + *s;
+		g = h & 0xf0000000;
+		if (g != 0)
+			h ^= g >> 24;
+		h &= ~g;
+	}
+
+	return h;
+}
+
+/*
+ * GNU hash
+ */
+static uint32_t
+gnuhash(char *name)
+{
+	uint32_t h;
+	uint8_t *s;
+
+	h = 5381;
+	for (s = (uint8_t*)name; *s != '\0'; s++)
+		h = h * 33 + *s;
+
+	return h;
+}
+
+/*
+ * Compare symbol i with name, decoding only that symbol
+ */
+static int
+matchsym(Symhash *h, uint32_t i, char *name, Sym *s)
+{
+	if (i >= h->nsym)
+		return 0;
+
+	h->unpackelfsym(h->syms + (size_t)i * h->symsize, s);
+
+	if (s->shndx == SHN_UNDEF || s->name >= h->strtabsize)
+		return 0;
+
+	return strcmp((char*)h->strtab + s->name, name) == 0;
+}
+
+/*
+ * Look up a name in a SysV hash table
+ */
+static int64_t
+lookupsysv(Symhash *h, char *name, Sym *s)
+{
+	uint32_t nbucket, nchain, i, n;
+	uint8_t *bucket, *chain;
+
+	if (h->hashsize < 8)
+		return -1;
+
+	nbucket = GET32(h, h->hash);
+	nchain = GET32(h, h->hash + 4);
+	if (nbucket == 0 || (2 + (uint64_t)nbucket + nchain) * 4 > h->hashsize)
+		return -1;
+
+	bucket = h->hash + 8;
+	chain = bucket + 4*(size_t)nbucket;
+
+	/* Bound the walk in case the chains loop */
+	i = GET32(h, bucket + 4*(size_t)(elfhash(name) % nbucket));
+	for (n = 0; i != 0 && i < nchain && n < nchain; n++) {
+		if (matchsym(h, i, name, s))
+			return i;
+		i = GET32(h, chain + 4*(size_t)i);
+	}
+
+	return -1;
+}
+
+/*
+ * Look up a name in a GNU hash table, whose bloom filter rejects
+ * most absent names without touching the symbols
+ */
+static int64_t
+lookupgnu(Symhash *h, char *name, Sym *s)
+{
+	uint32_t nbucket, symoffset, nbloom, shift, h1, h2, i;
+	uint8_t *bloom, *bucket, *chain;
+	uint64_t word, mask, nchain;
+	uint32_t bits;
+
+	if (h->hashsize < 16)
+		return -1;
+
+	nbucket = GET32(h, h->hash);
+	symoffset = GET32(h, h->hash + 4);
+	nbloom = GET32(h, h->hash + 8);
+	shift = GET32(h, h->hash + 12);
+
+	bits = h->class == ELFCLASS32 ? 32 : 64;
+	if (nbucket == 0 || nbloom == 0 || symoffset > h->nsym)
+		return -1;
+	if (16 + (uint64_t)nbloom * (bits / 8) + (uint64_t)nbucket * 4 > h->hashsize)
+		return -1;
+
+	bloom = h->hash + 16;
+	bucket = bloom + (size_t)nbloom * (bits / 8);
+	chain = bucket + 4*(size_t)nbucket;
+	nchain = (h->hashsize - (chain - h->hash)) / 4;
+
+	h1 = gnuhash(name);
+
+	word = bits == 32 ? GET32(h, bloom + 4*(size_t)(h1 / 32 % nbloom)) : GET64(h, bloom + 8*(size_t)(h1 / 64 % nbloom));
+	mask = (uint64_t)1 << (h1 % bits) | (uint64_t)1 << ((h1 >> shift) % bits);
+	if ((word & mask) != mask)
+		return -1;
+
+	i = GET32(h, bucket + 4*(size_t)(h1 % nbucket));
+	if (i < symoffset)
+		return -1;
+
+	for (; i - symoffset < nchain; i++) {
+		h2 = GET32(h, chain + 4*(size_t)(i - symoffset));
+		if ((h1 | 1) == (h2 | 1) && matchsym(h, i, name, s))
+			return i;
+		if (h2 & 1)
+			break;
+	}
+
+	return -1;
+}
+
+/*
+ * Decode the dynamic symbol hash table
+ */
+static int
+readsymhash(FILE *f, Symhash *h, Fhdr *fp)
+{
+	Shdr *hs, *ss, *str;
+
+	memset(h, 0, sizeof(*h));
+
+	hs = elfshdrtype(fp, SHT_GNU_HASH, NULL);
+	if (hs == NULL)
+		hs = elfshdrtype(fp, SHT_HASH, NULL);
+	if (hs == NULL) {
+		fprintf(stderr, "missing hash table\n");
+		return -1;
+	}
+
+	ss = elfshdr(fp, hs->link);
+	if (ss == NULL || ss->type != SHT_DYNSYM)
+		return -1;
+
+	str = elfshdr(fp, ss->link);
+	if (str == NULL || str->type != SHT_STRTAB || str->size == 0)
+		return -1;
+
+	h->type = hs->type;
+	h->class = fp->class;
+	h->data = fp->data;
+	h->symsize = fp->class == ELFCLASS32 ? Sym32sz : Sym64sz;
+	h->unpackelfsym = fp->unpackelfsym;
+
+	if (ss->size / h->symsize > UINT32_MAX)
+		return -1;
+	h->nsym = ss->size / h->symsize;
+
+	h->hash = keepsection(f, hs, fp);
+	h->syms = keepsection(f, ss, fp);
+	h->strtab = keepsection(f, str, fp);
+	h->hashsize = hs->size;
+	h->strtabsize = str->size;
+	if (h->hash == NULL || h->syms == NULL || h->strtab == NULL)
+		goto err;
+
+	/* Names are compared in place, the table must be terminated */
+	if (h->strtab[h->strtabsize - 1] != '\0')
+		goto err;
+
+	/* The bloom shift must be less than the bits of a bloom word */
+	if (h->type == SHT_GNU_HASH) {
+		if (h->hashsize < 16 || GET32(h, h->hash + 12) >= (h->class == ELFCLASS32 ? 32 : 64)) {
+			fprintf(stderr, "bad GNU hash table\n");
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	freeelfsymhash(h);
+	return -1;
+}
+
+/*
+ * Read the dynamic symbol hash table, preferring .gnu.hash to .hash,
+ * along with the Dynamic Symbol and String Tables it indexes, once:
+ * the handle keeps it for the reads that follow. Copies of the
+ * sections are allocated from the arena of the handle.
+ */
+int
+readelfsymhash(FILE *f, Symhash *h, Fhdr *fp)
+{
+	int r;
+
+	r = findelftab(fp, Tsymhash, 0, 0, h, sizeof(*h));
+	if (r <= 0)
+		return r;
+
+	r = readsymhash(f, h, fp);
+
+	return keepelftab(fp, Tsymhash, 0, 0, r, h, sizeof(*h));
+}
+
+/*
+ * Look up a defined dynamic symbol by name. Returns its index in the
+ * Dynamic Symbol Table and decodes it into s, or -1.
+ */
+int64_t
+lookupelfdynsym(Symhash *h, char *name, Sym *s)
+{
+	if (h->hash == NULL)
+		return -1;
+
+	if (h->type == SHT_GNU_HASH)
+		return lookupgnu(h, name, s);
+
+	return lookupsysv(h, name, s);
+}
+
+/*
+ * Forget a hash table, whose memory goes with the arena
+ */
+void
+freeelfsymhash(Symhash *h)
+{
+	h->hash = NULL;
+	h->syms = NULL;
+	h->strtab = NULL;
+}